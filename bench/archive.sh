@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Compares exporting a commit the old way (checkout, then tar the working
+# tree) with `archive`, for both tar and tar.gz.
+#
+# Usage: bench/archive.sh [files] [file-kb]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+FILES=${1:-5000}
+FILE_KB=${2:-16}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+mkdir "$WORK/repo"
+cd "$WORK/repo"
+"$MYGIT" init > /dev/null
+for f in $(seq 1 "$FILES"); do
+    mkdir -p "d$(( f / 100 ))"
+    # Compressible but not trivially so
+    seq "$f" $(( f + FILE_KB * 180 )) > "d$(( f / 100 ))/f$f"
+done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+commit=$("$MYGIT" rev-parse HEAD)
+
+start=$(now_ms)
+"$MYGIT" checkout "$commit" > /dev/null
+tar --exclude=.mygit -cf "$WORK/old.tar" .
+echo "checkout + tar:        $(( $(now_ms) - start )) ms"
+
+start=$(now_ms)
+"$MYGIT" checkout "$commit" > /dev/null
+tar --exclude=.mygit -czf "$WORK/old.tgz" .
+echo "checkout + tar -z:     $(( $(now_ms) - start )) ms"
+
+start=$(now_ms)
+"$MYGIT" archive "$commit" > "$WORK/new.tar"
+echo "archive:               $(( $(now_ms) - start )) ms ($(( $(stat -c %s "$WORK/new.tar") / 1024 )) KB)"
+
+start=$(now_ms)
+"$MYGIT" archive --format=tar.gz "$commit" > "$WORK/new.tgz"
+echo "archive --format=tar.gz: $(( $(now_ms) - start )) ms ($(( $(stat -c %s "$WORK/new.tgz") / 1024 )) KB," \
+    "gzip -6 of the same tar: $(( $(gzip -6 -c "$WORK/new.tar" | wc -c) / 1024 )) KB)"
@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+# Compares the io_uring and blocking object-store I/O backends on `add .`
+# and `checkout` of many small files.
+#
+# Usage: bench/batch_io.sh [files] [file-size-bytes]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+FILES=${1:-10000}
+SIZE=${2:-512}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+mkdir "$WORK/template"
+(cd "$WORK/template" && seq 1 "$FILES" | awk '{print "d" int($1 / 100) "/f" $1}' |
+    while read -r f; do mkdir -p "${f%/*}"; head -c "$SIZE" /dev/urandom > "$f"; done)
+
+for backend in blocking io_uring; do
+    dir="$WORK/$backend"
+    cp -r "$WORK/template" "$dir"
+    cd "$dir"
+    "$MYGIT" init > /dev/null
+    export MYGIT_IO=$backend
+
+    start=$(now_ms)
+    "$MYGIT" add . > /dev/null
+    add_ms=$(( $(now_ms) - start ))
+    commit=$("$MYGIT" commit -m bench | awk '/^Committed:/{print $2}')
+
+    start=$(now_ms)
+    "$MYGIT" checkout "$commit" > /dev/null
+    checkout_ms=$(( $(now_ms) - start ))
+    echo "$backend: add . ${add_ms} ms, checkout ${checkout_ms} ms ($FILES files of $SIZE bytes)"
+done
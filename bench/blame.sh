@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Builds a history of N commits in which a config file changes only every
+# Kth commit while the rest touch other files, then times `blame` on it and
+# prints how many commits were passed over without a diff.
+#
+# Usage: bench/blame.sh [commits] [every-kth-changes-the-config] [config-lines]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+COMMITS=${1:-400}
+EVERY=${2:-20}
+LINES=${3:-200}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+mkdir -p deploy/config src
+seq 1 "$LINES" | sed 's/^/option_& = default/' > deploy/config/app.conf
+for d in $(seq 1 20); do
+    mkdir -p "src/module$d"
+    echo "module $d" > "src/module$d/main.c"
+done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+
+start=$(now_ms)
+for c in $(seq 1 "$COMMITS"); do
+    if [ $((c % EVERY)) -eq 0 ]; then
+        line=$(( (c * 7919) % LINES + 1 ))
+        sed -i "${line}s/= .*/= value$c/" deploy/config/app.conf
+        "$MYGIT" add deploy/config/app.conf > /dev/null
+    else
+        echo "change $c" >> "src/module$((c % 20 + 1))/main.c"
+        "$MYGIT" add "src/module$((c % 20 + 1))/main.c" > /dev/null
+    fi
+    "$MYGIT" commit -m "commit $c" > /dev/null
+done
+echo "$COMMITS commits built in $(( $(now_ms) - start )) ms"
+
+start=$(now_ms)
+"$MYGIT" blame --stats deploy/config/app.conf 2>&1 > /dev/null
+echo "blame took $(( $(now_ms) - start )) ms"
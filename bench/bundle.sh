@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+# Times `bundle create` and `bundle unbundle` on a synthetic history and
+# reports peak resident memory for each when GNU time is installed.
+#
+# Usage: bench/bundle.sh [commits] [files-per-commit] [file-size-bytes]
+set -e
+
+measure() {
+    label=$1
+    shift
+    if [ -x /usr/bin/time ]; then
+        /usr/bin/time -f "$label %es  max RSS %MKB" "$@" > /dev/null
+    else
+        TIMEFORMAT="$label %Rs"
+        time "$@" > /dev/null
+    fi
+}
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+COMMITS=${1:-200}
+FILES=${2:-20}
+SIZE=${3:-65536}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir "$WORK/src" "$WORK/dst"
+cd "$WORK/src"
+"$MYGIT" init > /dev/null
+mkdir data
+i=0
+while [ "$i" -lt "$COMMITS" ]; do
+    f=0
+    while [ "$f" -lt "$FILES" ]; do
+        head -c "$SIZE" /dev/urandom > "data/file_${i}_${f}"
+        f=$((f + 1))
+    done
+    "$MYGIT" add data > /dev/null
+    "$MYGIT" commit -m "commit $i" > /dev/null
+    i=$((i + 1))
+done
+
+echo "history: $COMMITS commits, $((COMMITS * FILES)) blobs of $SIZE bytes"
+measure "create:  " "$MYGIT" bundle create "$WORK/history.bundle"
+ls -l "$WORK/history.bundle" | awk '{print "bundle size: " $5 " bytes"}'
+
+cd "$WORK/dst"
+"$MYGIT" init > /dev/null
+measure "unbundle:" "$MYGIT" bundle unbundle "$WORK/history.bundle"
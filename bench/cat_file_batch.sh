@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+# Compares per-object latency of one `cat-file -p` process per object with a
+# single `cat-file --batch` process reading the same object names from stdin.
+#
+# Usage: bench/cat_file_batch.sh [objects] [file-size-bytes]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+OBJECTS=${1:-2000}
+SIZE=${2:-1024}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+mkdir data
+i=0
+while [ "$i" -lt "$OBJECTS" ]; do
+    head -c "$SIZE" /dev/urandom > "data/file_$i"
+    i=$((i + 1))
+done
+"$MYGIT" add data > /dev/null
+awk '{print $3}' .mygit/index > names
+
+now_ns() { date +%s%N; }
+
+start=$(now_ns)
+while read -r sha; do
+    "$MYGIT" cat-file -p "$sha" > /dev/null
+done < names
+per_process=$(( ($(now_ns) - start) / OBJECTS ))
+
+start=$(now_ns)
+"$MYGIT" cat-file --batch < names > /dev/null
+batch=$(( ($(now_ns) - start) / OBJECTS ))
+
+start=$(now_ns)
+"$MYGIT" cat-file --batch-check < names > /dev/null
+batch_check=$(( ($(now_ns) - start) / OBJECTS ))
+
+echo "$OBJECTS objects of $SIZE bytes, mean latency per object:"
+echo "  cat-file -p per process: $((per_process / 1000)) us"
+echo "  cat-file --batch:        $((batch / 1000)) us"
+echo "  cat-file --batch-check:  $((batch_check / 1000)) us"
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+# Append-and-edit workload for content-defined chunking: commits a large
+# random file, then a version with a few small in-place edits and an append,
+# with chunking on (default threshold) and off. Reports how much the second
+# version grew the object store, and add/checkout throughput.
+#
+# Usage: bench/chunking.sh [file-size-MB] [append-MB]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+SIZE_MB=${1:-64}
+APPEND_MB=${2:-2}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+store_bytes() { du -sb .mygit/objects | cut -f1; }
+mbps() { awk -v b="$1" -v ms="$2" 'BEGIN { printf "%.0f", (b / 1048576) / (ms > 0 ? ms / 1000 : 0.001) }'; }
+
+head -c $((SIZE_MB << 20)) /dev/urandom > "$WORK/v1"
+cp "$WORK/v1" "$WORK/v2"
+for offset_mb in $((SIZE_MB / 6)) $((SIZE_MB / 2)) $((SIZE_MB * 5 / 6)); do
+    head -c 4096 /dev/urandom | dd of="$WORK/v2" bs=1M seek="$offset_mb" conv=notrunc status=none
+done
+head -c $((APPEND_MB << 20)) /dev/urandom >> "$WORK/v2"
+v2_bytes=$(stat -c %s "$WORK/v2")
+
+for threshold in 8M 0; do
+    dir="$WORK/repo_$threshold"
+    mkdir "$dir"
+    cd "$dir"
+    "$MYGIT" init > /dev/null
+    echo "chunking.threshold = $threshold" > .mygit/config
+
+    cp "$WORK/v1" data.bin
+    "$MYGIT" add data.bin
+    "$MYGIT" commit -m v1 > /dev/null
+    before=$(store_bytes)
+
+    cp "$WORK/v2" data.bin
+    start=$(now_ms)
+    "$MYGIT" add data.bin
+    add_ms=$(( $(now_ms) - start ))
+    commit=$("$MYGIT" commit -m v2 | awk '/^Committed:/{print $2}')
+    grown=$(( $(store_bytes) - before ))
+
+    start=$(now_ms)
+    "$MYGIT" checkout "$commit" > /dev/null
+    checkout_ms=$(( $(now_ms) - start ))
+    cmp -s data.bin "$WORK/v2" || { echo "checkout of v2 differs" >&2; exit 1; }
+
+    label=$([ "$threshold" = 0 ] && echo "whole blob" || echo "chunked")
+    echo "$label: v2 is $((v2_bytes >> 20)) MB, store grew $((grown >> 10)) KB" \
+        "(dedup $(awk -v a="$v2_bytes" -v b="$grown" 'BEGIN { printf "%.1f", a / b }')x)," \
+        "add $(mbps "$v2_bytes" "$add_ms") MB/s, checkout $(mbps "$v2_bytes" "$checkout_ms") MB/s"
+done
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Times `fsck` over a store of many small objects plus a few large chunked
+# files, reporting objects and stored bytes checked per second.
+#
+# Usage: bench/fsck.sh [small-files] [large-files]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+SMALL=${1:-20000}
+LARGE=${2:-4}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+for f in $(seq 1 "$SMALL"); do mkdir -p "d$(( f / 200 ))"; echo "file $f" > "d$(( f / 200 ))/f$f"; done
+for f in $(seq 1 "$LARGE"); do head -c 32000000 /dev/urandom > "large$f"; done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+
+start=$(now_ms)
+"$MYGIT" fsck --no-progress
+elapsed=$(( $(now_ms) - start ))
+objects=$(find .mygit/objects -type f | wc -l)
+kb=$(du -sk .mygit/objects | cut -f1)
+echo "fsck took $elapsed ms on $(nproc) cores: $(( objects * 1000 / (elapsed + 1) )) objects/s, $(( kb * 1000 / 1024 / (elapsed + 1) )) MB/s"
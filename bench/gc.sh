@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Builds a history of commits that each rewrite a slice of many files, then
+# orphans it by committing on top of the first commit, and times the mark
+# phase and pruning of `gc --prune=now`.
+#
+# Usage: bench/gc.sh [commits] [files]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+COMMITS=${1:-50}
+FILES=${2:-5000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+for f in $(seq 1 "$FILES"); do mkdir -p "d$(( f / 100 ))"; echo "$f" > "d$(( f / 100 ))/f$f"; done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+first=$("$MYGIT" rev-parse HEAD)
+for c in $(seq 1 "$COMMITS"); do
+    for f in $(seq "$c" 50 "$FILES"); do echo "$c" >> "d$(( f / 100 ))/f$f"; done
+    "$MYGIT" add . > /dev/null
+    "$MYGIT" commit -m "c$c" > /dev/null
+done
+
+echo "reachable from the tip:"
+start=$(now_ms)
+"$MYGIT" gc
+echo "  total $(( $(now_ms) - start )) ms"
+
+"$MYGIT" checkout "$first" > /dev/null
+echo orphaned > orphaned
+"$MYGIT" add orphaned > /dev/null
+"$MYGIT" commit -m orphan > /dev/null
+echo "after orphaning the history:"
+start=$(now_ms)
+"$MYGIT" gc --prune=now
+echo "  total $(( $(now_ms) - start )) ms, $(du -sk .mygit/objects | cut -f1) KB of objects left"
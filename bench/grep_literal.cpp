@@ -0,0 +1,86 @@
+// Times literal search over a synthetic source-like text with the SSE2
+// prefilter grep uses (find_literal), with glibc's memmem, and with
+// std::search, counting every line that holds the needle.
+//
+// Usage: make bench && ./bench_grep_literal [megabytes] [needle]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include "../src/headers/grep.h"
+
+namespace
+{
+typedef std::function<size_t(const char *, size_t, const std::string &)> Finder;
+
+// Counts matching lines the way LineMatcher does: find, skip to the next line
+size_t count_lines(const std::string &text, const std::string &needle, const Finder &find)
+{
+    size_t count = 0;
+    const char *at = text.data();
+    const char *end = at + text.size();
+    while (at < end)
+    {
+        size_t hit = find(at, end - at, needle);
+        if (hit == static_cast<size_t>(end - at))
+        {
+            break;
+        }
+        ++count;
+        const char *newline = static_cast<const char *>(std::memchr(at + hit, '\n', end - at - hit));
+        if (!newline)
+        {
+            break;
+        }
+        at = newline + 1;
+    }
+    return count;
+}
+
+void run(const char *name, const std::string &text, const std::string &needle, const Finder &find)
+{
+    double best = 1e9;
+    size_t count = 0;
+    for (int round = 0; round < 5; ++round)
+    {
+        auto start = std::chrono::steady_clock::now();
+        count = count_lines(text, needle, find);
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::printf("%-12s %8.1f ms  %8.0f MB/s  %zu lines\n", name, best, text.size() / 1e6 / (best / 1e3), count);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    std::string needle = argc > 2 ? argv[2] : "deploy_config_override";
+
+    // Identifier-heavy lines, so first/last-byte candidates are common
+    std::string text;
+    text.reserve(megabytes << 20);
+    unsigned seed = 12345;
+    for (size_t line = 0; text.size() < (megabytes << 20); ++line)
+    {
+        seed = seed * 1103515245 + 12345;
+        text += "    deploy_value = config_lookup(options, \"d" + std::to_string(seed % 100000) + "\");\n";
+        if (line % 50000 == 0)
+        {
+            text += "    apply(" + needle + ");\n";
+        }
+    }
+
+    run("find_literal", text, needle, find_literal);
+    run("memmem", text, needle, [](const char *haystack, size_t size, const std::string &n) {
+        const void *hit = memmem(haystack, size, n.data(), n.size());
+        return hit ? static_cast<const char *>(hit) - haystack : size;
+    });
+    run("std::search", text, needle, [](const char *haystack, size_t size, const std::string &n) {
+        return static_cast<size_t>(std::search(haystack, haystack + size, n.begin(), n.end()) - haystack);
+    });
+    return 0;
+}
@@ -0,0 +1,49 @@
+#!/usr/bin/env bash
+# Merges two branches of a large tree that each changed a few files, one of
+# them on both sides, and prints how many trees the merge had to read
+# against how many it took whole by ID. The time includes checking out the
+# merged commit.
+#
+# Usage: bench/merge.sh [directories] [subdirectories-each] [files-each]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+DIRS=${1:-50}
+SUBDIRS=${2:-10}
+FILES=${3:-10}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+for d in $(seq 1 "$DIRS"); do
+    for s in $(seq 1 "$SUBDIRS"); do
+        mkdir -p "d$d/s$s"
+        for f in $(seq 1 "$FILES"); do
+            seq 1 40 | sed "s/^/d$d s$s f$f line /" > "d$d/s$s/f$f"
+        done
+    done
+done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+echo "$((DIRS * SUBDIRS * FILES)) files in $((1 + DIRS + DIRS * SUBDIRS)) trees"
+
+"$MYGIT" branch topic > /dev/null
+"$MYGIT" checkout topic > /dev/null
+sed -i 's/line 30$/line 30 (topic)/' d1/s1/f1
+echo topic >> "d$DIRS/s$SUBDIRS/f$FILES"
+"$MYGIT" add d1/s1/f1 "d$DIRS/s$SUBDIRS/f$FILES" > /dev/null
+"$MYGIT" commit -m topic > /dev/null
+
+"$MYGIT" checkout master > /dev/null
+sed -i 's/line 10$/line 10 (master)/' d1/s1/f1
+echo master >> d2/s1/f1
+"$MYGIT" add d1/s1/f1 d2/s1/f1 > /dev/null
+"$MYGIT" commit -m master > /dev/null
+
+start=$(now_ms)
+"$MYGIT" merge topic | sed -n 2p
+echo "merge took $(( $(now_ms) - start )) ms"
@@ -0,0 +1,166 @@
+// Stores N per-deployment branches as loose ref files and as one ref table,
+// then times random lookups (each opening the store afresh, as read_ref
+// does without caching, and against a table kept open), listing one
+// region's branches by prefix, and writing the whole set.
+// Also reports the bytes each takes on disk.
+//
+// Usage: make bench && ./bench_ref_table [refs...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "../src/headers/reftable.h"
+
+namespace
+{
+const int LOOKUPS = 20000;
+const char *REGIONS[] = {"us-east", "us-west", "eu-west", "eu-central", "ap-south", "ap-east", "sa-east", "af-south"};
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t disk_bytes(const fs::path &path)
+{
+    uint64_t total = 0;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(path, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec))
+    {
+        struct stat info;
+        if (stat(it->path().c_str(), &info) == 0)
+        {
+            total += info.st_blocks * 512;
+        }
+    }
+    return total;
+}
+
+void run(size_t count, const fs::path &work)
+{
+    std::map<std::string, std::string> refs;
+    std::vector<std::string> names;
+    std::mt19937 random(42);
+    for (size_t i = 0; refs.size() < count; ++i)
+    {
+        char sha[41];
+        std::snprintf(sha, sizeof(sha), "%08x%08x%08x%08x%08x", unsigned(random()), unsigned(random()),
+                      unsigned(random()), unsigned(random()), unsigned(random()));
+        std::string name = "refs/heads/deploy/" + std::string(REGIONS[i % 8]) + "/service-" + std::to_string(i / 8);
+        refs[name] = sha;
+        names.push_back(name);
+    }
+    std::vector<std::string> probes;
+    for (int i = 0; i < LOOKUPS; ++i)
+    {
+        probes.push_back(names[random() % names.size()]);
+    }
+    std::string prefix = "refs/heads/deploy/eu-west/";
+
+    fs::path loose = work / "loose";
+    fs::path table_dir = work / "table";
+    fs::create_directories(table_dir);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &[name, sha] : refs)
+    {
+        fs::create_directories((loose / name).parent_path());
+        std::ofstream(loose / name) << sha << "\n";
+    }
+    double loose_write_ms = ms_since(start);
+    start = std::chrono::steady_clock::now();
+    {
+        RefTableLock lock;
+        lock.acquire(table_dir / "reftable");
+        lock.commit(refs);
+    }
+    double table_write_ms = ms_since(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (const auto &name : probes)
+    {
+        std::ifstream file(loose / name);
+        std::string sha;
+        found += std::getline(file, sha) && sha.size() == 40;
+    }
+    double loose_lookup_ms = ms_since(start);
+    start = std::chrono::steady_clock::now();
+    for (const auto &name : probes)
+    {
+        RefTable table;
+        std::string sha;
+        RefTable::open(table_dir / "reftable", table);
+        table.lookup(name, sha);
+        found += sha.size() == 40;
+    }
+    double table_lookup_ms = ms_since(start);
+    // With caching enabled (the daemon), the mapped table is reused
+    start = std::chrono::steady_clock::now();
+    {
+        RefTable table;
+        RefTable::open(table_dir / "reftable", table);
+        for (const auto &name : probes)
+        {
+            std::string sha;
+            table.lookup(name, sha);
+            found += sha.size() == 40;
+        }
+    }
+    double cached_lookup_ms = ms_since(start);
+
+    start = std::chrono::steady_clock::now();
+    std::map<std::string, std::string> listed;
+    for (const auto &entry : fs::directory_iterator(loose / prefix))
+    {
+        std::ifstream file(entry.path());
+        std::getline(file, listed[prefix + entry.path().filename().string()]);
+    }
+    double loose_list_ms = ms_since(start);
+    size_t loose_listed = listed.size();
+    listed.clear();
+    start = std::chrono::steady_clock::now();
+    RefTable table;
+    RefTable::open(table_dir / "reftable", table);
+    table.list(prefix, listed);
+    double table_list_ms = ms_since(start);
+
+    std::printf("%zu refs (%zu of %d lookups found, %zu/%zu listed)\n", count, found, 3 * LOOKUPS, loose_listed,
+                listed.size());
+    std::printf("  loose files: write %8.1f ms  lookup %6.2f us                 list %7.2f ms  %8llu KB\n",
+                loose_write_ms, loose_lookup_ms * 1000 / LOOKUPS, loose_list_ms,
+                static_cast<unsigned long long>(disk_bytes(loose) / 1024));
+    std::printf("  ref table:   write %8.1f ms  lookup %6.2f us (%5.2f cached)  list %7.2f ms  %8llu KB\n",
+                table_write_ms, table_lookup_ms * 1000 / LOOKUPS, cached_lookup_ms * 1000 / LOOKUPS, table_list_ms,
+                static_cast<unsigned long long>(disk_bytes(table_dir) / 1024));
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (counts.empty())
+    {
+        counts = {1000, 10000, 100000};
+    }
+
+    char work_template[] = "/tmp/bench_ref_table.XXXXXX";
+    fs::path work = mkdtemp(work_template);
+    for (size_t count : counts)
+    {
+        run(count, work / std::to_string(count));
+    }
+    fs::remove_all(work);
+    return 0;
+}
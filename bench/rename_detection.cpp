@@ -0,0 +1,285 @@
+// Moves a directory of N source files (src/ -> lib/), editing some of them
+// on the way and rewriting a few beyond recognition. Then it times the tree
+// diff plus rename detection and checks the pairs found against a
+// brute-force pass that compares the full line sets of every deleted and
+// added file. The brute force is skipped above 2000 files.
+//
+// Usage: make bench && ./bench_rename_detection [files...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "../src/headers/diff.h"
+#include "../src/headers/tree_builder.h"
+
+namespace
+{
+const int THRESHOLD = 50;
+const size_t MAX_BRUTE_FORCE_FILES = 2000;
+
+double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string random_line(std::mt19937 &random)
+{
+    static const char *WORDS[] = {"value", "count", "name", "return", "if", "for", "config", "buffer", "size",
+                                  "index", "result", "path", "error", "status", "item", "node"};
+    int indent = random() % 3;
+    std::string line(indent * 4, ' ');
+    for (int i = 0, words = 2 + random() % 5; i < words; ++i)
+    {
+        line += std::string(WORDS[random() % 16]) + "_" + std::to_string(random() % 1000) + " ";
+    }
+    return line + ";\n";
+}
+
+std::string random_file(std::mt19937 &random)
+{
+    std::string file;
+    for (int i = 0, lines = 20 + random() % 80; i < lines; ++i)
+    {
+        // Lines every file has, which a sketch must see past
+        file += i % 10 == 9 ? "}\n\n" : random_line(random);
+    }
+    return file;
+}
+
+// Replaces about `percent` of the lines
+std::string edit_file(std::mt19937 &random, const std::string &file, int percent)
+{
+    std::string edited;
+    size_t start = 0;
+    while (start < file.size())
+    {
+        size_t end = file.find('\n', start) + 1;
+        edited += static_cast<int>(random() % 100) < percent ? random_line(random) : file.substr(start, end - start);
+        start = end;
+    }
+    return edited;
+}
+
+std::set<std::string> line_set(const std::string &file)
+{
+    std::set<std::string> lines;
+    for (size_t start = 0; start < file.size();)
+    {
+        size_t end = file.find('\n', start) + 1;
+        lines.insert(file.substr(start, end - start));
+        start = end;
+    }
+    return lines;
+}
+
+int jaccard(const std::set<std::string> &a, const std::set<std::string> &b)
+{
+    size_t shared = 0;
+    for (const auto &line : a)
+    {
+        shared += b.count(line);
+    }
+    return static_cast<int>(shared * 100 / (a.size() + b.size() - shared));
+}
+
+Status write_tree(Repository &repo, const std::map<std::string, std::string> &files, std::string &tree_sha)
+{
+    TreeBuilder builder;
+    std::vector<std::string> shas;
+    shas.reserve(files.size());
+    for (const auto &[path, content] : files)
+    {
+        shas.emplace_back();
+        Status status = repo.write_object("blob", content, shas.back());
+        if (!status.ok())
+        {
+            return status;
+        }
+        builder.add(path, "100644", shas.back());
+    }
+    builder.finish();
+    TreeEntry root;
+    Status status = builder.write(
+        [&repo](const std::string &type, std::string content, std::string &sha) {
+            return repo.write_object(type, std::move(content), sha);
+        },
+        root);
+    tree_sha = root.sha;
+    return status;
+}
+
+void run(size_t count, const fs::path &work)
+{
+    Repository repo;
+    fs::create_directories(work);
+    if (!Repository::init(work, repo).ok())
+    {
+        std::printf("Unable to create a repository in %s\n", work.c_str());
+        return;
+    }
+
+    std::mt19937 random(42);
+    std::map<std::string, std::string> before, after;
+    std::map<std::string, std::string> expected; // new path -> old path
+    size_t unchanged = 0, edited = 0, rewritten = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string name = "module" + std::to_string(i % 50) + "/file" + std::to_string(i) + ".c";
+        std::string content = random_file(random);
+        before["src/" + name] = content;
+        int kind = random() % 100;
+        if (kind < 60)
+        {
+            ++unchanged;
+        }
+        else if (kind < 95)
+        {
+            content = edit_file(random, content, 5 + random() % 20);
+            ++edited;
+        }
+        else
+        {
+            content = random_file(random);
+            ++rewritten;
+        }
+        after["lib/" + name] = content;
+    }
+    before["README"] = after["README"] = "Unchanged\n";
+
+    std::string old_tree, new_tree;
+    if (!write_tree(repo, before, old_tree).ok() || !write_tree(repo, after, new_tree).ok())
+    {
+        std::printf("Unable to write the trees\n");
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TreeChange> changes;
+    diff_trees(repo, old_tree, new_tree, changes);
+    double diff_ms = ms_since(start);
+    size_t deletes = 0;
+    for (const auto &change : changes)
+    {
+        deletes += change.status == 'D';
+    }
+    start = std::chrono::steady_clock::now();
+    RenameOptions options;
+    options.threshold = THRESHOLD;
+    RenameStats stats;
+    detect_renames(repo, options, changes, &stats);
+    double detect_ms = ms_since(start);
+
+    std::printf("%zu files moved (%zu unchanged, %zu edited, %zu rewritten): %zu deletes + %zu adds\n", count,
+                unchanged, edited, rewritten, deletes, deletes);
+    std::printf("  diff %.1f ms, rename detection %.1f ms: %zu exact + %zu inexact renames, "
+                "%zu pairs scored of %zu possible\n",
+                diff_ms, detect_ms, stats.exact, stats.inexact, stats.candidates,
+                stats.sources * stats.targets);
+
+    if (count > MAX_BRUTE_FORCE_FILES)
+    {
+        return;
+    }
+    // Brute force: every deleted file against every added one, best first
+    start = std::chrono::steady_clock::now();
+    std::vector<std::string> sources, targets;
+    std::set<std::string> exact_targets;
+    for (const auto &change : changes)
+    {
+        if (change.status == 'R' && change.similarity == 100 && before[change.old_path] == after[change.new_path])
+        {
+            exact_targets.insert(change.new_path);
+        }
+    }
+    for (const auto &[path, content] : before)
+    {
+        if (path.compare(0, 4, "src/") == 0 && !exact_targets.count("lib/" + path.substr(4)))
+        {
+            sources.push_back(path);
+        }
+    }
+    for (const auto &[path, content] : after)
+    {
+        if (path.compare(0, 4, "lib/") == 0 && !exact_targets.count(path))
+        {
+            targets.push_back(path);
+        }
+    }
+    std::vector<std::set<std::string>> source_lines, target_lines;
+    for (const auto &path : sources)
+    {
+        source_lines.push_back(line_set(before[path]));
+    }
+    for (const auto &path : targets)
+    {
+        target_lines.push_back(line_set(after[path]));
+    }
+    std::vector<std::tuple<int, size_t, size_t>> scored;
+    for (size_t t = 0; t < targets.size(); ++t)
+    {
+        for (size_t s = 0; s < sources.size(); ++s)
+        {
+            int score = jaccard(source_lines[s], target_lines[t]);
+            if (score >= THRESHOLD)
+            {
+                scored.emplace_back(-score, t, s);
+            }
+        }
+    }
+    std::sort(scored.begin(), scored.end());
+    std::vector<bool> source_used(sources.size()), target_used(targets.size());
+    for (const auto &[score, t, s] : scored)
+    {
+        if (!source_used[s] && !target_used[t])
+        {
+            source_used[s] = target_used[t] = true;
+            expected[targets[t]] = sources[s];
+        }
+    }
+    double brute_ms = ms_since(start);
+
+    size_t agreed = 0, missed = 0, extra = 0;
+    for (const auto &change : changes)
+    {
+        if (change.status != 'R' || exact_targets.count(change.new_path))
+        {
+            continue;
+        }
+        auto found = expected.find(change.new_path);
+        (found != expected.end() && found->second == change.old_path ? agreed : extra)++;
+    }
+    missed = expected.size() - agreed;
+    std::printf("  brute force %.1f ms: %zu inexact renames; sketches agreed on %zu, missed %zu, "
+                "added %zu\n",
+                brute_ms, expected.size(), agreed, missed, extra);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i)
+    {
+        counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (counts.empty())
+    {
+        counts = {1000, 2000, 20000};
+    }
+
+    char work_template[] = "/tmp/bench_rename_detection.XXXXXX";
+    fs::path work = mkdtemp(work_template);
+    for (size_t count : counts)
+    {
+        run(count, work / std::to_string(count));
+    }
+    fs::remove_all(work);
+    return 0;
+}
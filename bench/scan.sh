@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Times `add .` on a tree with a large ignored directory (node_modules-style)
+# next to the tracked sources, with and without a .mygitignore excluding it.
+#
+# Usage: bench/scan.sh [tracked-files] [ignored-files]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+TRACKED=${1:-2000}
+IGNORED=${2:-50000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+make_tree() {
+    mkdir -p "$1/src" "$1/node_modules"
+    (cd "$1/src" && seq 1 "$TRACKED" | awk '{print "d" int($1 / 100) "/f" $1}' |
+        while read -r f; do mkdir -p "${f%/*}"; echo "$f" > "$f"; done)
+    (cd "$1/node_modules" && seq 1 "$IGNORED" | awk '{print "p" int($1 / 50) "/m" $1 ".js"}' |
+        xargs -n 500 sh -c 'for f; do mkdir -p "${f%/*}"; : > "$f"; done' sh)
+}
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+for mode in ignored unignored; do
+    dir="$WORK/$mode"
+    make_tree "$dir"
+    cd "$dir"
+    "$MYGIT" init > /dev/null
+    [ "$mode" = ignored ] && printf 'node_modules/\n*.log\n' > .mygitignore
+    start=$(now_ms)
+    "$MYGIT" add . > /dev/null
+    echo "$mode: add . took $(( $(now_ms) - start )) ms, staged $(wc -l < .mygit/index) files"
+done
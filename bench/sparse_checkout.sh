@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+# Times checkout and commit of a repository with many top-level directories,
+# in full and as a sparse checkout of one of them.
+#
+# Usage: bench/sparse_checkout.sh [directories] [files-per-directory]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+DIRS=${1:-40}
+FILES=${2:-500}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+for d in $(seq 1 "$DIRS"); do
+    mkdir -p "site$d/sub"
+    for f in $(seq 1 "$FILES"); do echo "$d $f" > "site$d/sub/f$f"; done
+done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+base=$("$MYGIT" rev-parse HEAD)
+
+for mode in full sparse; do
+    if [ "$mode" = sparse ]; then
+        "$MYGIT" sparse-checkout set site1 > /dev/null
+    else
+        "$MYGIT" sparse-checkout disable > /dev/null
+    fi
+    start=$(now_ms)
+    "$MYGIT" checkout "$base" > /dev/null
+    checkout_ms=$(( $(now_ms) - start ))
+    echo changed >> site1/sub/f1
+    "$MYGIT" add site1 > /dev/null
+    start=$(now_ms)
+    "$MYGIT" commit -m "$mode" > /dev/null
+    commit_ms=$(( $(now_ms) - start ))
+    files=$(find . -path ./.mygit -prune -o -type f -print | wc -l)
+    echo "$mode: checkout took $checkout_ms ms ($files files), commit took $commit_ms ms"
+done
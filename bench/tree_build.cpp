@@ -0,0 +1,188 @@
+// Builds the trees for a synthetic index of N entries (three directory
+// levels, ~100 entries per directory), once with the string-keyed adjacency
+// map write_tree used before and once with TreeBuilder. Reports wall time and
+// heap allocations for building the structure and walking it to serialize
+// every tree (object hashing and writing excluded).
+//
+// Usage: make bench && ./bench_tree_build [entries...]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/headers/tree_builder.h"
+
+namespace
+{
+std::atomic<size_t> allocation_count{0};
+std::atomic<size_t> allocated_bytes{0};
+} // namespace
+
+void *operator new(size_t size)
+{
+    ++allocation_count;
+    allocated_bytes += size;
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+typedef std::map<std::string, std::vector<std::string>> AdjList;
+
+const std::string_view PLACEHOLDER_SHA = "0000000000000000000000000000000000000000";
+
+// The previous implementation, kept here for comparison
+void legacy_build(const std::map<std::string, TreeEntry> &index_entries, AdjList &adjList)
+{
+    adjList[""] = {};
+    for (const auto &[path, entry] : index_entries)
+    {
+        std::string current_path = "";
+        std::istringstream path_stream(path);
+        std::string component;
+        while (std::getline(path_stream, component, '/'))
+        {
+            std::string next_path = current_path.empty() ? component : current_path + "/" + component;
+            auto &children = adjList[current_path];
+            if (std::find(children.begin(), children.end(), next_path) == children.end())
+            {
+                children.push_back(next_path);
+            }
+            current_path = next_path;
+        }
+        if (adjList.find(current_path) == adjList.end())
+        {
+            adjList[current_path] = {};
+        }
+    }
+}
+
+size_t legacy_walk(const AdjList &adjList, const std::map<std::string, TreeEntry> &entries, const std::string &current)
+{
+    std::ostringstream serialized_tree;
+    size_t bytes = 0;
+    for (const auto &child : adjList.at(current))
+    {
+        if (adjList.at(child).empty())
+        {
+            serialized_tree << "100644 " << child << " " << entries.at(child).sha << '\n';
+        }
+        else
+        {
+            bytes += legacy_walk(adjList, entries, child);
+            serialized_tree << "040000 " << child << " " << PLACEHOLDER_SHA << '\n';
+        }
+    }
+    return bytes + serialized_tree.str().size();
+}
+
+size_t trie_walk(const TreeBuilder::Node &directory)
+{
+    std::string serialized_tree;
+    size_t bytes = 0;
+    for (size_t i = 0; i < directory.child_count; ++i)
+    {
+        const TreeBuilder::Node &child = directory.children[i];
+        if (child.is_directory)
+        {
+            bytes += trie_walk(child);
+        }
+        serialized_tree.append(child.mode).append(" ").append(child.path).append(" ");
+        serialized_tree.append(child.is_directory ? PLACEHOLDER_SHA : child.sha).append("\n");
+    }
+    return bytes + serialized_tree.size();
+}
+
+struct Sample
+{
+    double ms;
+    size_t allocations;
+    size_t bytes;
+    size_t output;
+};
+
+template <typename Fn>
+Sample measure(Fn fn)
+{
+    size_t count_before = allocation_count, bytes_before = allocated_bytes;
+    auto start = std::chrono::steady_clock::now();
+    size_t output = fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return {std::chrono::duration<double, std::milli>(elapsed).count(), allocation_count - count_before,
+            allocated_bytes - bytes_before, output};
+}
+
+void report(const char *name, size_t entries, const Sample &sample)
+{
+    std::printf("%-8s %9zu entries  %9.1f ms  %10zu allocations  %8.1f MB allocated\n", name, entries, sample.ms,
+                sample.allocations, sample.bytes / 1048576.0);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+    {
+        sizes.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    if (sizes.empty())
+    {
+        sizes = {10000, 100000, 1000000};
+    }
+
+    const std::string sha = "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391";
+    for (size_t n : sizes)
+    {
+        std::map<std::string, TreeEntry> entries;
+        char path[64];
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::snprintf(path, sizeof(path), "dir%03zu/sub%03zu/file%06zu.txt", i / 10000, i / 100 % 100, i);
+            entries[path] = {"100644", path, sha};
+        }
+
+        Sample legacy = measure([&] {
+            AdjList adjList;
+            legacy_build(entries, adjList);
+            return legacy_walk(adjList, entries, "");
+        });
+        Sample trie = measure([&] {
+            TreeBuilder builder;
+            for (const auto &[p, entry] : entries)
+            {
+                builder.add(p, entry.mode, entry.sha);
+            }
+            return trie_walk(builder.finish());
+        });
+
+        report("adjlist", n, legacy);
+        report("trie", n, trie);
+        if (legacy.output != trie.output)
+        {
+            std::fprintf(stderr, "serialized sizes differ: %zu vs %zu\n", legacy.output, trie.output);
+            return 1;
+        }
+    }
+    return 0;
+}
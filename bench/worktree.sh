@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+# Times adding worktrees of one commit with the file cache (files cloned
+# from .mygit/file-cache) and without it (files written from the object
+# store), and the disk space each set of worktrees takes. The cache is only
+# used where the filesystem supports reflinks; the output says which path
+# the "cache" run took.
+#
+# Usage: bench/worktree.sh [files] [kilobytes-per-file] [worktrees]
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+FILES=${1:-2000}
+KB=${2:-16}
+TREES=${3:-3}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+now_ms() { echo $(( $(date +%s%N) / 1000000 )); }
+
+mkdir "$WORK/main"
+cd "$WORK/main"
+"$MYGIT" init > /dev/null
+for f in $(seq 1 "$FILES"); do
+    mkdir -p "dir$((f % 20))"
+    head -c $((KB * 1024)) /dev/urandom > "dir$((f % 20))/f$f"
+done
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m base > /dev/null
+base=$("$MYGIT" rev-parse HEAD)
+
+for mode in copy cache; do
+    flag=$([ "$mode" = copy ] && echo --no-cache || true)
+    for i in $(seq 1 "$TREES"); do
+        start=$(now_ms)
+        output=$("$MYGIT" worktree add $flag "../$mode$i" "$base")
+        echo "$mode: worktree $i took $(( $(now_ms) - start )) ms"
+    done
+    if [ "$mode" = cache ]; then
+        if echo "$output" | grep -q "without the file cache"; then
+            echo "cache: no reflinks here, so these worktrees were written without the cache"
+        else
+            echo "cache: $(echo "$output" | tail -n 1)"
+        fi
+    fi
+    # du counts reflinked blocks once per file, so on a filesystem with
+    # reflinks this overstates what the cache worktrees really use
+    kb=$(du -sk "$WORK"/$mode* $([ "$mode" = cache ] && [ -d .mygit/file-cache ] && echo .mygit/file-cache) |
+        awk '{s += $1} END {print s}')
+    echo "$mode: $TREES worktrees use $kb KB"
+done
@@ -0,0 +1,508 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <zlib.h>
+#include "headers/archive.h"
+#include "headers/chunking.h"
+
+namespace
+{
+const size_t TAR_BLOCK = 512;
+const size_t TAR_RECORD = 20 * TAR_BLOCK;
+const uint64_t MAX_USTAR_SIZE = 077777777777ULL;
+const size_t GZIP_BLOCK = 128 * 1024;
+const size_t GZIP_DICTIONARY = 32 * 1024;
+const int GZIP_LEVEL = 6;
+
+// Where the tar stream goes: straight to the output, or through gzip
+class ArchiveOutput
+{
+public:
+    virtual ~ArchiveOutput() = default;
+    virtual Status write(const char *data, size_t size) = 0;
+    virtual Status finish() = 0;
+};
+
+class PlainOutput : public ArchiveOutput
+{
+public:
+    explicit PlainOutput(std::ostream &out) : out_(out) {}
+
+    Status write(const char *data, size_t size) override
+    {
+        out_.write(data, size);
+        return out_ ? Status() : Status::error(ErrorCode::IoError, "Error: Unable to write the archive.");
+    }
+    Status finish() override
+    {
+        out_.flush();
+        return out_ ? Status() : Status::error(ErrorCode::IoError, "Error: Unable to write the archive.");
+    }
+
+private:
+    std::ostream &out_;
+};
+
+class ParallelGzipOutput : public ArchiveOutput
+{
+public:
+    ParallelGzipOutput(std::ostream &out, uint32_t mtime) : out_(out)
+    {
+        const unsigned char header[10] = {0x1f, 0x8b, 8, 0, static_cast<unsigned char>(mtime),
+                                          static_cast<unsigned char>(mtime >> 8),
+                                          static_cast<unsigned char>(mtime >> 16),
+                                          static_cast<unsigned char>(mtime >> 24), 0, 3};
+        out_.write(reinterpret_cast<const char *>(header), sizeof(header));
+        written_ = sizeof(header);
+
+        size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        max_in_flight_ = 2 * thread_count;
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            threads_.emplace_back([this] { run_worker(); });
+        }
+        pending_.reserve(GZIP_BLOCK);
+    }
+
+    ~ParallelGzipOutput() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        work_ready_.notify_all();
+        for (auto &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    Status write(const char *data, size_t size) override
+    {
+        while (size > 0)
+        {
+            size_t take = std::min(size, GZIP_BLOCK - pending_.size());
+            pending_.append(data, take);
+            data += take;
+            size -= take;
+            if (pending_.size() == GZIP_BLOCK)
+            {
+                Status status = submit(false);
+                if (!status.ok())
+                {
+                    return status;
+                }
+            }
+        }
+        return {};
+    }
+
+    Status finish() override
+    {
+        Status status = submit(true);
+        while (status.ok() && !blocks_.empty())
+        {
+            status = write_oldest();
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+
+        unsigned char trailer[8];
+        for (int i = 0; i < 4; ++i)
+        {
+            trailer[i] = static_cast<unsigned char>(crc_ >> (8 * i));
+            trailer[4 + i] = static_cast<unsigned char>(input_size_ >> (8 * i));
+        }
+        out_.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+        out_.flush();
+        written_ += sizeof(trailer);
+        return out_ ? Status() : Status::error(ErrorCode::IoError, "Error: Unable to write the archive.");
+    }
+
+    uint64_t bytes_written() const { return written_; }
+
+private:
+    struct Block
+    {
+        std::string input;
+        std::string dictionary;
+        bool last = false;
+        bool done = false;
+        bool failed = false;
+        std::string output;
+        uLong crc = 0;
+    };
+
+    static void compress_block(Block &block)
+    {
+        z_stream stream{};
+        if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            block.failed = true;
+            return;
+        }
+        if (!block.dictionary.empty())
+        {
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(block.dictionary.data()),
+                                 block.dictionary.size());
+        }
+        // Room for the worst case plus the sync or final marker
+        block.output.resize(deflateBound(&stream, block.input.size()) + 64);
+        stream.next_in = reinterpret_cast<Bytef *>(&block.input[0]);
+        stream.avail_in = block.input.size();
+        stream.next_out = reinterpret_cast<Bytef *>(&block.output[0]);
+        stream.avail_out = block.output.size();
+        int result = deflate(&stream, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+        block.failed = stream.avail_in != 0 || (block.last ? result != Z_STREAM_END : result != Z_OK);
+        block.output.resize(stream.total_out);
+        deflateEnd(&stream);
+
+        block.crc = crc32(0, reinterpret_cast<const Bytef *>(block.input.data()), block.input.size());
+    }
+
+    void run_worker()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            work_ready_.wait(lock, [&] { return closed_ || !queued_.empty(); });
+            if (queued_.empty())
+            {
+                return;
+            }
+            Block *block = queued_.front();
+            queued_.pop_front();
+            lock.unlock();
+
+            compress_block(*block);
+
+            lock.lock();
+            block->done = true;
+            block_done_.notify_all();
+        }
+    }
+
+    Status submit(bool last)
+    {
+        if (blocks_.size() >= max_in_flight_)
+        {
+            Status status = write_oldest();
+            if (!status.ok())
+            {
+                return status;
+            }
+        }
+
+        auto block = std::make_unique<Block>();
+        block->dictionary = dictionary_;
+        block->last = last;
+        dictionary_.append(pending_, pending_.size() - std::min(pending_.size(), GZIP_DICTIONARY));
+        if (dictionary_.size() > GZIP_DICTIONARY)
+        {
+            dictionary_.erase(0, dictionary_.size() - GZIP_DICTIONARY);
+        }
+        input_size_ += pending_.size();
+        block->input.swap(pending_);
+        pending_.clear();
+        pending_.reserve(GZIP_BLOCK);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_.push_back(block.get());
+        }
+        work_ready_.notify_one();
+        blocks_.push_back(std::move(block));
+        return {};
+    }
+
+    // Blocks are written in order, each once it is compressed
+    Status write_oldest()
+    {
+        Block &block = *blocks_.front();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            block_done_.wait(lock, [&] { return block.done; });
+        }
+        if (block.failed)
+        {
+            return Status::error(ErrorCode::IoError, "Error: Compressing the archive failed.");
+        }
+        crc_ = crc32_combine(crc_, block.crc, block.input.size());
+        out_.write(block.output.data(), block.output.size());
+        written_ += block.output.size();
+        blocks_.pop_front();
+        return out_ ? Status() : Status::error(ErrorCode::IoError, "Error: Unable to write the archive.");
+    }
+
+    std::ostream &out_;
+    std::string pending_;
+    std::string dictionary_; // Last 32 KB of input before `pending_`
+    std::deque<std::unique_ptr<Block>> blocks_; // In flight, oldest first
+    size_t max_in_flight_ = 0;
+    uLong crc_ = crc32(0, nullptr, 0);
+    uint64_t input_size_ = 0;
+    uint64_t written_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable block_done_;
+    std::deque<Block *> queued_;
+    bool closed_ = false;
+    std::vector<std::thread> threads_;
+};
+
+// Fills a header field with width - 1 zero-padded octal digits and a NUL
+void put_octal(char *field, size_t width, uint64_t value)
+{
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i > 0; --i)
+    {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+class TarWriter
+{
+public:
+    TarWriter(ArchiveOutput &output, int64_t mtime) : output_(output), mtime_(mtime) {}
+
+    Status add_directory(const std::string &path) { return write_header(path + "/", '5', 0755, 0); }
+
+    Status begin_file(const std::string &path, uint64_t size) { return write_header(path, '0', 0644, size); }
+
+    Status write(const char *data, size_t size)
+    {
+        written_ += size;
+        return output_.write(data, size);
+    }
+
+    // Pads the file just written to a whole block
+    Status end_file(uint64_t size) { return pad(size); }
+
+    Status finish()
+    {
+        // Two zero blocks end the archive, then fill the last record
+        static const char zeros[TAR_RECORD] = {};
+        Status status = write(zeros, 2 * TAR_BLOCK);
+        if (status.ok() && written_ % TAR_RECORD)
+        {
+            status = write(zeros, TAR_RECORD - written_ % TAR_RECORD);
+        }
+        return status.ok() ? output_.finish() : status;
+    }
+
+    uint64_t bytes_written() const { return written_; }
+
+private:
+    Status pad(uint64_t size)
+    {
+        static const char zeros[TAR_BLOCK] = {};
+        size_t remainder = size % TAR_BLOCK;
+        return remainder ? write(zeros, TAR_BLOCK - remainder) : Status();
+    }
+
+    // A pax record is "<length> <key>=<value>\n", the length counting itself
+    static std::string pax_record(const std::string &key, const std::string &value)
+    {
+        size_t length = key.size() + value.size() + 3;
+        length += std::to_string(length).size();
+        if (std::to_string(length).size() + key.size() + value.size() + 3 != length)
+        {
+            ++length;
+        }
+        return std::to_string(length) + " " + key + "=" + value + "\n";
+    }
+
+    Status write_header(const std::string &path, char type, unsigned mode, uint64_t size)
+    {
+        // ustar splits a path over `prefix` (155) and `name` (100) at a '/'
+        std::string name = path, prefix;
+        if (name.size() > 100)
+        {
+            size_t split = path.find('/', path.size() > 101 ? path.size() - 101 : 0);
+            if (split != std::string::npos && split <= 155 && path.size() - split - 1 <= 100 && split > 0)
+            {
+                prefix = path.substr(0, split);
+                name = path.substr(split + 1);
+            }
+        }
+
+        std::string extended;
+        if (name.size() > 100)
+        {
+            extended += pax_record("path", path);
+            name = path.substr(0, 100);
+            prefix.clear();
+        }
+        if (size > MAX_USTAR_SIZE)
+        {
+            extended += pax_record("size", std::to_string(size));
+        }
+        if (!extended.empty())
+        {
+            Status status = write_block('x', "pax_header", "", 0644, extended.size());
+            if (status.ok())
+            {
+                status = write(extended.data(), extended.size());
+            }
+            if (status.ok())
+            {
+                status = pad(extended.size());
+            }
+            if (!status.ok())
+            {
+                return status;
+            }
+        }
+        return write_block(type, name, prefix, mode, std::min(size, MAX_USTAR_SIZE));
+    }
+
+    Status write_block(char type, const std::string &name, const std::string &prefix, unsigned mode, uint64_t size)
+    {
+        char header[TAR_BLOCK] = {};
+        std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+        put_octal(header + 100, 8, mode);
+        put_octal(header + 108, 8, 0); // uid
+        put_octal(header + 116, 8, 0); // gid
+        put_octal(header + 124, 12, size);
+        put_octal(header + 136, 12, mtime_);
+        std::memset(header + 148, ' ', 8); // Checksum, counted as spaces
+        header[156] = type;
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+        std::memcpy(header + 265, "root", 4);
+        std::memcpy(header + 297, "root", 4);
+        std::memcpy(header + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+
+        unsigned checksum = 0;
+        for (unsigned char byte : header)
+        {
+            checksum += byte;
+        }
+        put_octal(header + 148, 7, checksum); // Six digits, a NUL and a space
+        header[155] = ' ';
+        return write(header, sizeof(header));
+    }
+
+    ArchiveOutput &output_;
+    int64_t mtime_;
+    uint64_t written_ = 0;
+};
+
+// A file's size without inflating it: the header for a blob, the listed
+// chunk sizes for a chunk list.
+Status file_size(const Repository &repo, const std::string &sha, uint64_t &size)
+{
+    std::string type;
+    size_t stored_size = 0;
+    Status status = repo.read_object_header(sha, type, stored_size);
+    if (!status.ok() || type != "chunks")
+    {
+        size = stored_size;
+        return status;
+    }
+
+    Object list;
+    std::vector<ChunkRef> chunks;
+    status = repo.read_object(sha, list);
+    if (status.ok() && !parse_chunk_list(list.content, chunks))
+    {
+        status = Status::error(ErrorCode::Corrupt, "Error: Object " + sha + " is not a valid chunk list.");
+    }
+    size = 0;
+    for (const auto &chunk : chunks)
+    {
+        size += chunk.size;
+    }
+    return status;
+}
+} // namespace
+
+Status write_archive(const Repository &repo, const std::string &commit_sha, ArchiveFormat format, std::ostream &out,
+                     ArchiveStats *stats)
+{
+    Commit commit;
+    Status status = repo.read_commit(commit_sha, commit);
+    std::map<std::string, TreeEntry> tree_entries;
+    if (status.ok())
+    {
+        status = repo.read_tree_recursive(commit.tree_sha, tree_entries);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    int64_t mtime = commit.time();
+    std::unique_ptr<ArchiveOutput> output;
+    ParallelGzipOutput *gzip = nullptr;
+    if (format == ArchiveFormat::TarGz)
+    {
+        auto parallel = std::make_unique<ParallelGzipOutput>(out, static_cast<uint32_t>(mtime));
+        gzip = parallel.get();
+        output = std::move(parallel);
+    }
+    else
+    {
+        output = std::make_unique<PlainOutput>(out);
+    }
+
+    TarWriter tar(*output, mtime);
+    ArchiveStats counts;
+    // Entries come in path order, so a directory precedes its contents
+    for (const auto &[path, entry] : tree_entries)
+    {
+        if (entry.mode == "040000")
+        {
+            status = tar.add_directory(path);
+            ++counts.directories;
+        }
+        else
+        {
+            uint64_t size = 0;
+            uint64_t streamed = 0;
+            status = file_size(repo, entry.sha, size);
+            if (status.ok())
+            {
+                status = tar.begin_file(path, size);
+            }
+            if (status.ok())
+            {
+                status = repo.stream_blob(entry.sha, [&](const std::string &data) {
+                    streamed += data.size();
+                    return tar.write(data.data(), data.size());
+                });
+            }
+            if (status.ok() && streamed != size)
+            {
+                status = Status::error(ErrorCode::Corrupt, "Error: Object " + entry.sha + " has the wrong size.");
+            }
+            if (status.ok())
+            {
+                status = tar.end_file(size);
+            }
+            ++counts.files;
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+    }
+
+    status = tar.finish();
+    counts.tar_bytes = tar.bytes_written();
+    counts.output_bytes = gzip ? gzip->bytes_written() : counts.tar_bytes;
+    if (stats)
+    {
+        *stats = counts;
+    }
+    return status;
+}
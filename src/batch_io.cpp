@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headers/batch_io.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define MYGIT_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+// One open/read/write/close per step, retrying short transfers.
+class BlockingIO : public BatchIO
+{
+public:
+    const char *name() const override { return "blocking"; }
+
+    void read_files(std::vector<FileRead> &requests) override
+    {
+        for (auto &request : requests)
+        {
+            int fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info;
+            if (fd < 0 || fstat(fd, &info) != 0)
+            {
+                request.error = errno;
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+                continue;
+            }
+
+            request.data.resize(info.st_size);
+            size_t done = 0;
+            while (done < request.data.size())
+            {
+                ssize_t n = read(fd, &request.data[done], request.data.size() - done);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    request.error = n < 0 ? errno : 0;
+                    break;
+                }
+                done += n;
+            }
+            request.data.resize(done);
+            close(fd);
+        }
+    }
+
+    void write_files(std::vector<FileWrite> &requests) override
+    {
+        for (auto &request : requests)
+        {
+            int fd = open(request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                request.error = errno;
+                continue;
+            }
+
+            size_t done = 0;
+            while (done < request.data.size())
+            {
+                ssize_t n = write(fd, request.data.data() + done, request.data.size() - done);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0)
+                {
+                    request.error = errno;
+                    break;
+                }
+                done += n;
+            }
+            if (close(fd) != 0 && !request.error)
+            {
+                request.error = errno;
+            }
+        }
+    }
+};
+
+#ifdef MYGIT_HAVE_IO_URING
+// io_uring through the raw syscalls (no liburing). A batch goes through in
+// phases - open (and statx for reads), then read or write, then close - with
+// one io_uring_enter per phase per ring-full instead of one syscall per file
+// per step. Short transfers are resubmitted for the remainder.
+class UringIO : public BatchIO
+{
+public:
+    static std::unique_ptr<UringIO> create()
+    {
+        std::unique_ptr<UringIO> io(new UringIO());
+        if (!io->setup())
+        {
+            return nullptr;
+        }
+        return io;
+    }
+
+    ~UringIO() override
+    {
+        if (sqes_ != MAP_FAILED)
+        {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+        {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED)
+        {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ >= 0)
+        {
+            close(ring_fd_);
+        }
+    }
+
+    const char *name() const override { return "io_uring"; }
+
+    void read_files(std::vector<FileRead> &requests) override
+    {
+        size_t count = requests.size();
+        std::vector<struct statx> info(count);
+        // Opens in slots 0..count-1, statx (by path, for the size) after them
+        std::vector<int> results(2 * count);
+        run(2 * count, [&](io_uring_sqe &sqe, size_t i) {
+            if (i < count)
+            {
+                prepare_open(sqe, requests[i].path, O_RDONLY | O_CLOEXEC, 0);
+                return;
+            }
+            sqe.opcode = IORING_OP_STATX;
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<unsigned long>(requests[i - count].path.c_str());
+            sqe.len = STATX_SIZE;
+            sqe.off = reinterpret_cast<unsigned long>(&info[i - count]);
+        }, results);
+        std::vector<int> fds(results.begin(), results.begin() + count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            int error = fds[i] < 0 ? -fds[i] : (results[count + i] < 0 ? -results[count + i] : 0);
+            requests[i].error = error;
+            if (!error)
+            {
+                requests[i].data.resize(info[i].stx_size);
+            }
+        }
+        std::vector<size_t> done(count, 0);
+        transfer(count, fds, done, [&](size_t i) -> std::string & { return requests[i].data; },
+                 [&](size_t i, int error) { requests[i].error = error; }, IORING_OP_READ);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                requests[i].data.resize(done[i]);
+            }
+        }
+        close_all(fds);
+    }
+
+    void write_files(std::vector<FileWrite> &requests) override
+    {
+        size_t count = requests.size();
+        std::vector<int> fds(count);
+        run(count, [&](io_uring_sqe &sqe, size_t i) {
+            prepare_open(sqe, requests[i].path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }, fds);
+        for (size_t i = 0; i < count; ++i)
+        {
+            requests[i].error = fds[i] < 0 ? -fds[i] : 0;
+        }
+
+        std::vector<size_t> done(count, 0);
+        transfer(count, fds, done, [&](size_t i) -> std::string & { return requests[i].data; },
+                 [&](size_t i, int error) { requests[i].error = error; }, IORING_OP_WRITE);
+        std::vector<int> closed = close_all(fds);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (closed[i] < 0 && !requests[i].error)
+            {
+                requests[i].error = -closed[i];
+            }
+        }
+    }
+
+private:
+    static const unsigned RING_ENTRIES = 256;
+
+    UringIO() = default;
+
+    bool setup()
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd_ = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+        if (ring_fd_ < 0 || !supports_needed_ops())
+        {
+            return false;
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                        IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED)
+        {
+            return false;
+        }
+        cq_ring_ = single_mmap ? sq_ring_
+                               : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                      ring_fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                     IORING_OFF_SQES);
+        if (cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED)
+        {
+            return false;
+        }
+
+        char *sq = static_cast<char *>(sq_ring_);
+        char *cq = static_cast<char *>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        sq_entries_ = params.sq_entries;
+        return true;
+    }
+
+    bool supports_needed_ops()
+    {
+        const size_t op_slots = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + op_slots * sizeof(io_uring_probe_op), 0);
+        auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, op_slots) < 0)
+        {
+            return false;
+        }
+        for (int op : {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE})
+        {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void prepare_open(io_uring_sqe &sqe, const fs::path &path, int flags, unsigned mode)
+    {
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = AT_FDCWD;
+        sqe.addr = reinterpret_cast<unsigned long>(path.c_str());
+        sqe.len = mode;
+        sqe.open_flags = flags;
+    }
+
+    // Submits `count` operations, filled in by prepare(sqe, i), and stores
+    // each one's result (a count, an fd or -errno) in results[i].
+    template <typename Prepare>
+    void run(size_t count, Prepare prepare, std::vector<int> &results)
+    {
+        run_some(count, [](size_t i) { return i; }, prepare, results);
+    }
+
+    // Same, for operations 0..count-1 mapped to request indexes by which(i).
+    template <typename Which, typename Prepare>
+    void run_some(size_t count, Which which, Prepare prepare, std::vector<int> &results)
+    {
+        for (size_t start = 0; start < count; start += sq_entries_)
+        {
+            unsigned batch = std::min<size_t>(sq_entries_, count - start);
+            unsigned tail = *sq_tail_;
+            for (unsigned k = 0; k < batch; ++k)
+            {
+                unsigned slot = (tail + k) & sq_mask_;
+                io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqes_)[slot];
+                std::memset(&sqe, 0, sizeof(sqe));
+                size_t index = which(start + k);
+                prepare(sqe, index);
+                sqe.user_data = index;
+                results[index] = -ECANCELED; // Until its completion arrives
+                sq_array_[slot] = slot;
+            }
+            __atomic_store_n(sq_tail_, tail + batch, __ATOMIC_RELEASE);
+
+            unsigned to_submit = batch;
+            unsigned reaped = 0;
+            while (reaped < batch)
+            {
+                int entered = syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (entered < 0)
+                {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    {
+                        continue;
+                    }
+                    return; // The ring is unusable; the rest stay cancelled
+                }
+                to_submit -= std::min<unsigned>(to_submit, entered);
+
+                unsigned head = *cq_head_;
+                unsigned cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+                for (; head != cq_tail; ++head, ++reaped)
+                {
+                    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                    results[cqe.user_data] = cqe.res;
+                }
+                __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    // Reads into or writes from buffer(i) for every open fd until each one
+    // is complete, failed, or (for reads) hit end of file.
+    template <typename Buffer, typename Fail>
+    void transfer(size_t count, const std::vector<int> &fds, std::vector<size_t> &done, Buffer buffer, Fail fail,
+                  unsigned char opcode)
+    {
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fds[i] >= 0 && !buffer(i).empty())
+            {
+                pending.push_back(i);
+            }
+        }
+
+        std::vector<int> results(count);
+        while (!pending.empty())
+        {
+            run_some(pending.size(), [&](size_t k) { return pending[k]; },
+                     [&](io_uring_sqe &sqe, size_t i) {
+                         std::string &data = buffer(i);
+                         sqe.opcode = opcode;
+                         sqe.fd = fds[i];
+                         sqe.addr = reinterpret_cast<unsigned long>(&data[done[i]]);
+                         sqe.len = std::min<size_t>(data.size() - done[i], 1u << 30);
+                         sqe.off = done[i];
+                     },
+                     results);
+
+            std::vector<size_t> again;
+            for (size_t i : pending)
+            {
+                if (results[i] == -EINTR || results[i] == -EAGAIN)
+                {
+                    again.push_back(i);
+                }
+                else if (results[i] < 0)
+                {
+                    fail(i, -results[i]);
+                }
+                else if (results[i] > 0 && (done[i] += results[i]) < buffer(i).size())
+                {
+                    again.push_back(i); // Short transfer
+                }
+            }
+            pending.swap(again);
+        }
+    }
+
+    std::vector<int> close_all(const std::vector<int> &fds)
+    {
+        std::vector<size_t> open;
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                open.push_back(i);
+            }
+        }
+        std::vector<int> results(fds.size(), 0);
+        run_some(open.size(), [&](size_t k) { return open[k]; },
+                 [&](io_uring_sqe &sqe, size_t i) {
+                     sqe.opcode = IORING_OP_CLOSE;
+                     sqe.fd = fds[i];
+                 },
+                 results);
+        return results;
+    }
+
+    int ring_fd_ = -1;
+    void *sq_ring_ = MAP_FAILED;
+    void *cq_ring_ = MAP_FAILED;
+    void *sqes_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned *sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe *cqes_ = nullptr;
+};
+#endif // MYGIT_HAVE_IO_URING
+} // namespace
+
+std::unique_ptr<BatchIO> BatchIO::create()
+{
+#ifdef MYGIT_HAVE_IO_URING
+    const char *choice = std::getenv("MYGIT_IO");
+    if (!choice || std::strcmp(choice, "blocking") != 0)
+    {
+        if (auto io = UringIO::create())
+        {
+            return io;
+        }
+    }
+#endif
+    return std::make_unique<BlockingIO>();
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <map>
+#include "headers/blame.h"
+#include "headers/commit_order.h"
+#include "headers/diff.h"
+
+namespace
+{
+// The trees from the root down to the file's directory, and the file's blob
+struct PathLookup
+{
+    std::vector<std::string> trees;
+    std::string blob_sha; // Empty if the path is not a file in this tree
+};
+
+// Follows `components` down from `root_tree`. Once a tree on the way has
+// the ID `known` recorded at the same depth, the rest of `known` applies.
+Status lookup_path(const Repository &repo, const std::string &root_tree, const std::vector<std::string> &components,
+                   const PathLookup *known, PathLookup &found, BlameStats &stats)
+{
+    found = PathLookup();
+    std::string tree = root_tree;
+    std::string prefix;
+    for (size_t depth = 0; depth < components.size(); ++depth)
+    {
+        if (known && depth < known->trees.size() && known->trees[depth] == tree)
+        {
+            found.trees.insert(found.trees.end(), known->trees.begin() + depth, known->trees.end());
+            found.blob_sha = known->blob_sha;
+            return {};
+        }
+        found.trees.push_back(tree);
+
+        std::vector<TreeEntry> entries;
+        Status status = repo.read_tree(tree, entries);
+        ++stats.trees_read;
+        if (!status.ok())
+        {
+            return status;
+        }
+        prefix += (depth ? "/" : "") + components[depth];
+        auto entry = std::find_if(entries.begin(), entries.end(),
+                                  [&prefix](const TreeEntry &candidate) { return candidate.name == prefix; });
+        bool is_directory = entry != entries.end() && entry->mode == "040000";
+        if (entry == entries.end() || is_directory != (depth + 1 < components.size()))
+        {
+            return {};
+        }
+        tree = entry->sha;
+    }
+    found.blob_sha = tree;
+    return {};
+}
+
+// A commit still holding lines: pairs of (line in the final file, line in
+// this commit's version)
+struct Suspect
+{
+    Commit commit;
+    PathLookup lookup;
+    std::vector<std::pair<size_t, size_t>> lines;
+};
+
+class Blamer
+{
+public:
+    Blamer(const Repository &repo, BlameStats &stats) : repo_(repo), stats_(stats) {}
+
+    Status blob_lines(const std::string &sha, const std::vector<std::string_view> *&lines)
+    {
+        auto cached = blobs_.find(sha);
+        if (cached == blobs_.end())
+        {
+            std::string data;
+            Status status = repo_.stream_blob(sha, [&data](const std::string &part) {
+                data += part;
+                return Status();
+            });
+            if (!status.ok())
+            {
+                return status;
+            }
+            cached = blobs_.emplace(sha, Blob{std::move(data), {}}).first;
+            cached->second.lines = split_lines(cached->second.data);
+        }
+        lines = &cached->second.lines;
+        return {};
+    }
+
+    // Where each of the child's lines sits in the parent's version, or
+    // SIZE_MAX for lines the child changed
+    Status map_to_parent(const std::string &parent_blob, const std::string &child_blob, std::vector<size_t> &mapping)
+    {
+        const std::vector<std::string_view> *parent_lines = nullptr;
+        const std::vector<std::string_view> *child_lines = nullptr;
+        Status status = blob_lines(parent_blob, parent_lines);
+        if (status.ok())
+        {
+            status = blob_lines(child_blob, child_lines);
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+        ++stats_.diffs;
+        mapping.assign(child_lines->size(), SIZE_MAX);
+        size_t parent_at = 0;
+        size_t child_at = 0;
+        for (const auto &hunk : diff_lines(*parent_lines, *child_lines))
+        {
+            while (child_at < hunk.new_start)
+            {
+                mapping[child_at++] = parent_at++;
+            }
+            child_at = hunk.new_end;
+            parent_at = hunk.old_end;
+        }
+        while (child_at < mapping.size())
+        {
+            mapping[child_at++] = parent_at++;
+        }
+        return {};
+    }
+
+private:
+    struct Blob
+    {
+        std::string data;
+        std::vector<std::string_view> lines; // Into data
+    };
+
+    const Repository &repo_;
+    BlameStats &stats_;
+    std::map<std::string, Blob> blobs_;
+};
+} // namespace
+
+Status blame_file(const Repository &repo, const std::string &commit_sha, const std::string &path,
+                  std::vector<BlameLine> &lines, BlameStats *stats)
+{
+    BlameStats ignored;
+    BlameStats &counts = stats ? *stats : ignored;
+    lines.clear();
+
+    std::vector<std::string> components;
+    for (const auto &component : fs::path(path).lexically_normal())
+    {
+        if (!component.empty() && component != ".")
+        {
+            components.push_back(component.string());
+        }
+    }
+    std::map<std::string, Suspect> pending; // By commit sha
+    Suspect &head = pending[commit_sha];
+    Status status = repo.read_commit(commit_sha, head.commit);
+    if (status.ok() && !components.empty())
+    {
+        status = lookup_path(repo, head.commit.tree_sha, components, nullptr, head.lookup, counts);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (head.lookup.blob_sha.empty())
+    {
+        return Status::error(ErrorCode::NotFound, "Error: " + path + " is not a file in " + commit_sha + ".");
+    }
+
+    Blamer blamer(repo, counts);
+    const std::vector<std::string_view> *head_lines = nullptr;
+    status = blamer.blob_lines(head.lookup.blob_sha, head_lines);
+    if (!status.ok())
+    {
+        return status;
+    }
+    lines.resize(head_lines->size());
+    for (size_t i = 0; i < head_lines->size(); ++i)
+    {
+        std::string_view text = (*head_lines)[i];
+        lines[i].text = std::string(text.substr(0, text.size() - (text.back() == '\n')));
+        head.lines.emplace_back(i, i);
+    }
+
+    while (!pending.empty())
+    {
+        auto newest =
+            newest_pending(repo, pending, [](const Suspect &suspect) -> const Commit & { return suspect.commit; });
+        std::string sha = newest->first;
+        Suspect suspect = std::move(newest->second);
+        pending.erase(newest);
+        ++counts.commits_visited;
+
+        for (size_t p = 0; p < suspect.commit.parents.size() && !suspect.lines.empty(); ++p)
+        {
+            const std::string &parent_sha = suspect.commit.parents[p];
+            auto known = pending.find(parent_sha);
+            Suspect parent;
+            if (known != pending.end())
+            {
+                parent.commit = known->second.commit;
+                parent.lookup = known->second.lookup;
+            }
+            else
+            {
+                status = repo.read_commit(parent_sha, parent.commit);
+                if (status.ok())
+                {
+                    status = lookup_path(repo, parent.commit.tree_sha, components, &suspect.lookup, parent.lookup,
+                                         counts);
+                }
+                if (!status.ok())
+                {
+                    return status;
+                }
+            }
+            if (parent.lookup.blob_sha.empty())
+            {
+                continue;
+            }
+
+            std::vector<std::pair<size_t, size_t>> kept;
+            if (parent.lookup.blob_sha == suspect.lookup.blob_sha)
+            {
+                ++counts.commits_skipped;
+                parent.lines = std::move(suspect.lines);
+            }
+            else
+            {
+                std::vector<size_t> mapping;
+                status = blamer.map_to_parent(parent.lookup.blob_sha, suspect.lookup.blob_sha, mapping);
+                if (!status.ok())
+                {
+                    return status;
+                }
+                for (const auto &[final_line, line] : suspect.lines)
+                {
+                    if (mapping[line] == SIZE_MAX)
+                    {
+                        kept.emplace_back(final_line, line);
+                    }
+                    else
+                    {
+                        parent.lines.emplace_back(final_line, mapping[line]);
+                    }
+                }
+            }
+            suspect.lines = std::move(kept);
+            if (parent.lines.empty())
+            {
+                continue;
+            }
+            if (known != pending.end())
+            {
+                auto &held = known->second.lines;
+                held.insert(held.end(), parent.lines.begin(), parent.lines.end());
+            }
+            else
+            {
+                pending.emplace(parent_sha, std::move(parent));
+            }
+        }
+
+        // What no parent has is this commit's own
+        for (const auto &[final_line, line] : suspect.lines)
+        {
+            lines[final_line].commit_sha = sha;
+            lines[final_line].line_number = line + 1;
+        }
+    }
+    return {};
+}
@@ -0,0 +1,478 @@
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <unordered_set>
+#include <vector>
+#include <zlib.h>
+#include "headers/bundle.h"
+#include "headers/utils.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+const std::string BUNDLE_SIGNATURE = "# mygit bundle v1";
+const std::string HEAD_REF = "refs/heads/master";
+const size_t CHUNK_SIZE = 64 * 1024;
+
+Status bundle_error(const std::string &message)
+{
+    return Status::error(ErrorCode::Corrupt, "Error: " + message);
+}
+
+// Depth-first walk of the object graph starting at `tip`. Objects already in
+// `seen` are not visited again, which also lets a caller pre-seed `seen` with
+// everything the other side has. Blobs are reported without being inflated.
+Status walk_objects(const Repository &repo, const std::string &tip, std::unordered_set<std::string> &seen,
+                    const std::function<Status(const std::string &sha)> &visit)
+{
+    std::vector<ObjectRef> stack = {{tip, "commit"}};
+
+    while (!stack.empty())
+    {
+        ObjectRef current = stack.back();
+        stack.pop_back();
+        if (!seen.insert(current.sha).second)
+        {
+            continue;
+        }
+
+        Status status;
+        if (current.type == "blob")
+        {
+            // Only the header is needed to tell a blob from a chunk list
+            std::string type;
+            size_t size = 0;
+            if (!repo.read_object_header(current.sha, type, size).ok())
+            {
+                return Status::error(ErrorCode::NotFound, "Error: Object " + current.sha + " is missing.");
+            }
+            if (type != "chunks")
+            {
+                status = visit(current.sha);
+                if (!status.ok())
+                {
+                    return status;
+                }
+                continue;
+            }
+        }
+
+        Object object;
+        status = repo.read_object(current.sha, object);
+        if (status.ok())
+        {
+            status = visit(current.sha);
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+        for (auto &ref : referenced_objects(object.type, object.content))
+        {
+            if (!seen.count(ref.sha))
+            {
+                stack.push_back(std::move(ref));
+            }
+        }
+    }
+    return {};
+}
+
+// Everything written to or read from a bundle goes through one of these so
+// the trailing checksum covers every byte.
+class BundleWriter
+{
+public:
+    explicit BundleWriter(std::ostream &out) : out_(out) {}
+
+    void write(const char *data, size_t len)
+    {
+        out_.write(data, len);
+        checksum_.update(data, len);
+    }
+    void write(const std::string &data) { write(data.data(), data.size()); }
+
+    // Streams a stored object file into the bundle in fixed-size chunks.
+    Status copy_object(const Repository &repo, const std::string &sha)
+    {
+        fs::path path = repo.object_path(sha);
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs)
+        {
+            return Status::error(ErrorCode::NotFound, "Error: Object " + sha + " is missing.");
+        }
+
+        write(sha + " " + std::to_string(fs::file_size(path)) + "\n");
+        std::vector<char> buffer(CHUNK_SIZE);
+        while (ifs)
+        {
+            ifs.read(buffer.data(), buffer.size());
+            write(buffer.data(), ifs.gcount());
+        }
+        return {};
+    }
+
+    void finish(size_t object_count)
+    {
+        write("end " + std::to_string(object_count) + "\n");
+        out_ << checksum_.hex_digest() << "\n";
+    }
+
+private:
+    std::ostream &out_;
+    Sha1Stream checksum_;
+};
+
+class BundleReader
+{
+public:
+    explicit BundleReader(std::istream &in) : in_(in) {}
+
+    bool read_line(std::string &line)
+    {
+        if (!std::getline(in_, line))
+        {
+            return false;
+        }
+        checksum_.update(line);
+        checksum_.update("\n", 1);
+        return true;
+    }
+
+    size_t read(char *data, size_t len)
+    {
+        in_.read(data, len);
+        size_t got = in_.gcount();
+        checksum_.update(data, got);
+        return got;
+    }
+
+    std::string digest() { return checksum_.hex_digest(); }
+
+    // Reads the trailing checksum line, which is not itself checksummed.
+    bool read_trailer(std::string &line) { return static_cast<bool>(std::getline(in_, line)); }
+
+private:
+    std::istream &in_;
+    Sha1Stream checksum_;
+};
+
+// Verifies one object record and stores it. The zlib stream is inflated and
+// hashed chunk by chunk as it is copied into place, so a blob never has to
+// be held in memory; only trees and commits are kept to collect their edges.
+Status ingest_object(Repository &repo, BundleReader &reader, const std::string &sha, size_t raw_length,
+                     std::vector<ObjectRef> &references)
+{
+    std::string header;
+    char byte = 0;
+    while (header.size() < raw_length && reader.read(&byte, 1) == 1 && byte != '\0')
+    {
+        header += byte;
+    }
+
+    std::string type;
+    size_t size = 0;
+    if (byte != '\0' || !parse_object_header(header, type, size))
+    {
+        return bundle_error("Malformed header for object " + sha + " in bundle.");
+    }
+
+    bool already_present = repo.freshen_object(sha);
+    fs::path temp_path = repo.temp_object_path();
+    std::ofstream temp_file;
+    if (!already_present)
+    {
+        temp_file.open(temp_path, std::ios::binary | std::ios::trunc);
+        temp_file << header << '\0';
+    }
+
+    Sha1Stream hasher;
+    hasher.update(header);
+    hasher.update("\0", 1);
+
+    z_stream stream{};
+    inflateInit(&stream);
+    std::vector<char> in_buffer(CHUNK_SIZE);
+    std::vector<char> out_buffer(CHUNK_SIZE);
+    std::string content;
+    size_t inflated = 0;
+    size_t remaining = raw_length - header.size() - 1;
+    int status = Z_OK;
+
+    while (remaining > 0)
+    {
+        size_t got = reader.read(in_buffer.data(), std::min(remaining, in_buffer.size()));
+        if (got == 0)
+        {
+            break;
+        }
+        remaining -= got;
+        if (!already_present)
+        {
+            temp_file.write(in_buffer.data(), got);
+        }
+
+        stream.next_in = reinterpret_cast<Bytef *>(in_buffer.data());
+        stream.avail_in = got;
+        while (stream.avail_in > 0 && status == Z_OK)
+        {
+            stream.next_out = reinterpret_cast<Bytef *>(out_buffer.data());
+            stream.avail_out = out_buffer.size();
+            status = inflate(&stream, Z_NO_FLUSH);
+            size_t produced = out_buffer.size() - stream.avail_out;
+            inflated += produced;
+            hasher.update(out_buffer.data(), produced);
+            if (type != "blob")
+            {
+                content.append(out_buffer.data(), produced);
+            }
+        }
+    }
+    inflateEnd(&stream);
+
+    bool valid = remaining == 0 && (status == Z_STREAM_END || (size == 0 && status == Z_OK)) &&
+                 inflated == size && hasher.hex_digest() == sha;
+    if (!valid)
+    {
+        if (!already_present)
+        {
+            temp_file.close();
+            fs::remove(temp_path);
+        }
+        return bundle_error("Object " + sha + " in bundle failed verification.");
+    }
+
+    references = referenced_objects(type, content);
+    if (!already_present)
+    {
+        temp_file.close();
+        return repo.store_raw_object(sha, temp_path);
+    }
+    return {};
+}
+
+bool is_ancestor(const Repository &repo, const std::string &ancestor, const std::string &descendant)
+{
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> stack = {descendant};
+    while (!stack.empty())
+    {
+        std::string sha = stack.back();
+        stack.pop_back();
+        if (sha == ancestor)
+        {
+            return true;
+        }
+        Commit commit;
+        if (!seen.insert(sha).second || !repo.read_commit(sha, commit).ok())
+        {
+            continue;
+        }
+        stack.insert(stack.end(), commit.parents.begin(), commit.parents.end());
+    }
+    return false;
+}
+} // namespace
+
+Status create_bundle(const Repository &repo, const fs::path &bundle_file, const std::string &since_commit,
+                     size_t &object_count)
+{
+    std::string head_sha;
+    Status status = repo.read_head(head_sha);
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (head_sha.empty())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Nothing to bundle, HEAD has no commits.");
+    }
+
+    std::unordered_set<std::string> seen;
+    if (!since_commit.empty())
+    {
+        std::string type;
+        size_t size = 0;
+        if (!repo.read_object_header(since_commit, type, size).ok() || type != "commit")
+        {
+            return Status::error(ErrorCode::InvalidArgument, "Error: " + since_commit + " is not a commit.");
+        }
+        // Everything the receiver already has is marked seen up front so the
+        // main walk stops at the boundary.
+        status = walk_objects(repo, since_commit, seen, [](const std::string &) { return Status(); });
+        if (!status.ok())
+        {
+            return status;
+        }
+    }
+
+    // Every branch and tag whose commit the bundle carries, plus HEAD's own
+    // branch (or master, if HEAD has none)
+    std::map<std::string, std::string> refs;
+    status = repo.list_refs(refs, "refs/");
+    if (!status.ok())
+    {
+        return status;
+    }
+    std::string head_branch = repo.head_branch();
+    refs[head_branch.empty() ? HEAD_REF : head_branch] = head_sha;
+    for (auto it = refs.begin(); it != refs.end();)
+    {
+        it = seen.count(it->second) ? refs.erase(it) : std::next(it);
+    }
+
+    std::ofstream out(bundle_file, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Could not create bundle file " + bundle_file.string());
+    }
+
+    BundleWriter writer(out);
+    writer.write(BUNDLE_SIGNATURE + "\n");
+    if (!since_commit.empty())
+    {
+        writer.write("-" + since_commit + "\n");
+    }
+    for (const auto &[ref_name, sha] : refs)
+    {
+        writer.write(sha + " " + ref_name + "\n");
+    }
+    writer.write("\n");
+
+    object_count = 0;
+    for (auto it = refs.begin(); status.ok() && it != refs.end(); ++it)
+    {
+        status = walk_objects(repo, it->second, seen, [&](const std::string &sha) {
+            ++object_count;
+            return writer.copy_object(repo, sha);
+        });
+    }
+    if (!status.ok())
+    {
+        out.close();
+        fs::remove(bundle_file);
+        return status;
+    }
+
+    writer.finish(object_count);
+    return {};
+}
+
+Status unbundle(Repository &repo, const fs::path &bundle_file, UnbundleResult &result)
+{
+    std::ifstream in(bundle_file, std::ios::binary);
+    if (!in)
+    {
+        return Status::error(ErrorCode::NotFound, "Error: Could not open bundle file " + bundle_file.string());
+    }
+
+    BundleReader reader(in);
+    std::string line;
+    if (!reader.read_line(line) || line != BUNDLE_SIGNATURE)
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: " + bundle_file.string() + " is not a mygit bundle.");
+    }
+
+    std::vector<std::pair<std::string, std::string>> refs; // (refname, sha)
+    while (reader.read_line(line) && !line.empty())
+    {
+        if (line[0] == '-')
+        {
+            std::string prerequisite = line.substr(1);
+            if (!repo.has_object(prerequisite))
+            {
+                return Status::error(ErrorCode::NotFound, "Error: Repository lacks prerequisite commit " + prerequisite);
+            }
+        }
+        else if (line.size() > 41 && line[40] == ' ')
+        {
+            refs.emplace_back(line.substr(41), line.substr(0, 40));
+        }
+        else
+        {
+            return bundle_error("Malformed bundle header line: " + line);
+        }
+    }
+
+    // Edges from ingested objects that the bundle did not (yet) provide; at
+    // the end each must already exist locally.
+    std::unordered_set<std::string> ingested;
+    std::unordered_set<std::string> unresolved;
+    bool saw_end = false;
+
+    while (reader.read_line(line))
+    {
+        if (line.rfind("end ", 0) == 0)
+        {
+            saw_end = line.substr(4) == std::to_string(result.object_count);
+            break;
+        }
+
+        std::istringstream record(line);
+        std::string sha;
+        size_t raw_length = 0;
+        if (!(record >> sha >> raw_length) || sha.size() != 40)
+        {
+            return bundle_error("Malformed object record in bundle.");
+        }
+
+        std::vector<ObjectRef> references;
+        Status status = ingest_object(repo, reader, sha, raw_length, references);
+        if (!status.ok())
+        {
+            return status;
+        }
+        ++result.object_count;
+        ingested.insert(sha);
+        unresolved.erase(sha);
+        for (const auto &ref : references)
+        {
+            if (!ingested.count(ref.sha))
+            {
+                unresolved.insert(ref.sha);
+            }
+        }
+    }
+
+    std::string expected_checksum = reader.digest();
+    std::string trailer;
+    if (!saw_end || !reader.read_trailer(trailer) || trailer != expected_checksum)
+    {
+        return bundle_error("Bundle is truncated or its checksum does not match.");
+    }
+
+    for (const auto &sha : unresolved)
+    {
+        if (!repo.has_object(sha))
+        {
+            return bundle_error("Bundle is incomplete, object " + sha + " is missing.");
+        }
+    }
+
+    // Accepted refs move together, and only if nothing moved them meanwhile
+    std::vector<RefUpdate> updates;
+    for (const auto &[ref_name, sha] : refs)
+    {
+        std::string current;
+        repo.read_ref(ref_name, current);
+        if (!current.empty() && current != sha && !is_ancestor(repo, current, sha))
+        {
+            result.rejected_refs.emplace_back(ref_name, sha);
+            continue;
+        }
+        updates.push_back({ref_name, sha, true, current});
+    }
+    Status status = updates.empty() ? Status() : repo.update_refs(updates);
+    if (!status.ok())
+    {
+        return status;
+    }
+    for (const auto &update : updates)
+    {
+        result.updated_refs.emplace_back(update.name, update.new_sha);
+    }
+    return {};
+}
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "headers/chunking.h"
+#include "headers/utils.h"
+
+namespace
+{
+const size_t READ_SIZE = 1 << 20;
+
+// Random but fixed: chunk boundaries, and so dedup across versions, depend
+// on this table never changing.
+std::array<uint64_t, 256> make_gear_table()
+{
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x6d79676974636463ULL; // "mygitcdc"
+    for (auto &value : table)
+    {
+        // splitmix64
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+const std::array<uint64_t, 256> GEAR = make_gear_table();
+
+// A mask of `bits` ones in the high end of the hash, where each bit depends
+// on the most recent bytes.
+uint64_t high_mask(unsigned bits)
+{
+    return bits == 0 ? 0 : ~uint64_t(0) << (64 - bits);
+}
+
+unsigned log2_floor(size_t value)
+{
+    unsigned bits = 0;
+    while (value >>= 1)
+    {
+        ++bits;
+    }
+    return bits;
+}
+} // namespace
+
+// Normalized chunking: a stricter mask before the average size and a looser
+// one after it pull chunk sizes towards the average.
+size_t next_chunk_boundary(const unsigned char *data, size_t size, const ChunkingParams &params)
+{
+    if (size <= params.min_size)
+    {
+        return size;
+    }
+    size = std::min(size, params.max_size);
+
+    unsigned bits = log2_floor(params.average_size);
+    uint64_t strict_mask = high_mask(bits + 2);
+    uint64_t loose_mask = high_mask(bits - 2);
+    size_t normal = std::min(size, params.average_size);
+
+    uint64_t hash = 0;
+    size_t i = params.min_size;
+    for (; i < normal; ++i)
+    {
+        hash = (hash << 1) + GEAR[data[i]];
+        if (!(hash & strict_mask))
+        {
+            return i + 1;
+        }
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash << 1) + GEAR[data[i]];
+        if (!(hash & loose_mask))
+        {
+            return i + 1;
+        }
+    }
+    return size;
+}
+
+Status split_file_into_chunks(const fs::path &path, const ChunkingParams &params,
+                              const std::function<Status(std::string chunk)> &emit)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to read " + path.string());
+    }
+
+    std::string buffer;
+    size_t start = 0;
+    bool at_end = false;
+    Status status;
+    while (status.ok())
+    {
+        // Keep at least one maximal chunk buffered so every cut sees enough
+        if (!at_end && buffer.size() - start < params.max_size)
+        {
+            buffer.erase(0, start);
+            start = 0;
+            size_t filled = buffer.size();
+            buffer.resize(filled + READ_SIZE);
+            ssize_t n = read(fd, &buffer[filled], READ_SIZE);
+            if (n < 0 && errno == EINTR)
+            {
+                buffer.resize(filled);
+                continue;
+            }
+            if (n < 0)
+            {
+                status = Status::error(ErrorCode::IoError, "Error: Unable to read " + path.string());
+                break;
+            }
+            buffer.resize(filled + n);
+            at_end = n == 0;
+            continue;
+        }
+
+        size_t available = buffer.size() - start;
+        if (available == 0)
+        {
+            break;
+        }
+        size_t length =
+            next_chunk_boundary(reinterpret_cast<const unsigned char *>(buffer.data()) + start, available, params);
+        status = emit(buffer.substr(start, length));
+        start += length;
+    }
+    close(fd);
+    return status;
+}
+
+bool parse_chunk_list(const std::string &content, std::vector<ChunkRef> &chunks)
+{
+    std::istringstream stream(content);
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        std::size_t space = line.find(' ');
+        if (space != 40 || !is_hex_string(line.substr(0, 40)))
+        {
+            return false;
+        }
+        ChunkRef chunk;
+        chunk.sha = line.substr(0, 40);
+        try
+        {
+            chunk.size = std::stoul(line.substr(space + 1));
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    return true;
+}
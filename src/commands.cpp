@@ -0,0 +1,1357 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include "headers/commands.h"
+#include "headers/repository.h"
+#include "headers/archive.h"
+#include "headers/blame.h"
+#include "headers/bundle.h"
+#include "headers/commit_order.h"
+#include "headers/daemon.h"
+#include "headers/diff.h"
+#include "headers/fsck.h"
+#include "headers/gc.h"
+#include "headers/grep.h"
+#include "headers/merge.h"
+#include "headers/object_pipeline.h"
+#include "headers/reftable.h"
+#include "headers/sparse.h"
+#include "headers/utils.h"
+#include "headers/worktree.h"
+
+namespace
+{
+int fail(std::ostream &err, const Status &status)
+{
+    err << status.message << std::endl;
+    return 1;
+}
+
+// Hashing alone needs no repository; `repo` is only opened (if not given)
+// when the object is to be written.
+int cmd_hash_object(Repository *repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    bool write = false;
+    std::string filename;
+
+    if (args.size() == 2)
+    {
+        filename = args[1];
+    }
+    else if (args.size() == 3 && args[1] == "-w")
+    {
+        write = true;
+        filename = args[2];
+    }
+    else
+    {
+        err << "Usage: ./mygit hash-object [-w] <file>" << std::endl;
+        return 1;
+    }
+
+    if (filename.empty())
+    {
+        err << "Error: Filename not provided for 'hash-object'." << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        err << "Error: Could not open file " << filename << std::endl;
+        return 1;
+    }
+    std::string content = read_file_content(filename);
+
+    if (!write)
+    {
+        out << calculate_sha1(object_header("blob", content.size()) + content) << std::endl;
+        return 0;
+    }
+
+    Repository opened;
+    Status status;
+    if (!repo)
+    {
+        status = Repository::open(fs::current_path(), opened);
+        repo = &opened;
+    }
+    std::string sha;
+    if (status.ok())
+    {
+        status = repo->write_object("blob", std::move(content), sha);
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    out << sha << std::endl;
+    return 0;
+}
+
+// Serves object lookups for names read from `in`, one per line, until EOF.
+// Each answer is "<sha> <type> <size>", followed by the content and a newline
+// when print_content is set, or "<name> missing" / "<name> ambiguous"; output
+// is flushed after every answer so callers can use it as a pipe.
+int cat_file_batch(Repository &repo, bool print_content, std::istream &in, std::ostream &out)
+{
+    if (!repo.caching_enabled())
+    {
+        repo.enable_caching(64 * 1024 * 1024);
+    }
+
+    std::string name;
+    std::string type;
+    Object object;
+
+    while (std::getline(in, name))
+    {
+        std::string sha;
+        Status status = repo.resolve_object_name(name, sha);
+        if (status.code == ErrorCode::Ambiguous)
+        {
+            out << name << " ambiguous\n";
+            out.flush();
+            continue;
+        }
+
+        size_t size = 0;
+        bool found = false;
+        if (status.ok() && !print_content)
+        {
+            // Headers are stored uncompressed, so --batch-check never inflates.
+            found = repo.read_object_header(sha, type, size).ok();
+            if (found)
+            {
+                out << sha << " " << type << " " << size << "\n";
+            }
+        }
+        else if (status.ok() && repo.read_object(sha, object).ok())
+        {
+            found = true;
+            out << sha << " " << object.type << " " << object.content.size() << "\n";
+            out.write(object.content.data(), object.content.size());
+            out << "\n";
+        }
+
+        if (!found)
+        {
+            out << name << " missing\n";
+        }
+        out.flush();
+    }
+    return 0;
+}
+
+int cmd_cat_file(Repository &repo, const std::vector<std::string> &args, std::istream &in,
+                 std::ostream &out, std::ostream &err)
+{
+    if (args.size() == 2 && (args[1] == "--batch" || args[1] == "--batch-check"))
+    {
+        return cat_file_batch(repo, args[1] == "--batch", in, out);
+    }
+
+    // Ensure exactly 3 arguments: cat-file <flag> <file_sha>
+    if (args.size() != 3)
+    {
+        err << "Usage: ./mygit cat-file <flag> <file_sha> or ./mygit cat-file --batch|--batch-check" << std::endl;
+        return 1;
+    }
+
+    const std::string &flag = args[1];
+    if (flag != "-p" && flag != "-s" && flag != "-t")
+    {
+        err << "Error: Invalid flag for 'cat-file'. Use -p, -s, or -t." << std::endl;
+        return 1;
+    }
+
+    std::string sha;
+    Status status = repo.resolve_object_name(args[2], sha);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+
+    if (flag == "-p")
+    {
+        Object object;
+        status = repo.read_object(sha, object);
+        if (status.ok() && object.type == "chunks")
+        {
+            // A large file: print the file, not its chunk list
+            status = repo.stream_blob(sha, [&out](const std::string &data) {
+                out << data;
+                return Status();
+            });
+        }
+        else if (status.ok())
+        {
+            out << object.content;
+        }
+        return status.ok() ? 0 : fail(err, status);
+    }
+
+    std::string type;
+    size_t size = 0;
+    status = repo.read_object_header(sha, type, size);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    if (flag == "-s")
+    {
+        out << size << " bytes" << std::endl;
+    }
+    else
+    {
+        out << type << std::endl;
+    }
+    return 0;
+}
+
+int cmd_ls_tree(const Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    bool name_only = false;
+    std::string tree_sha;
+
+    if (args.size() == 2)
+    {
+        tree_sha = args[1];
+    }
+    else if (args.size() == 3 && args[1] == "--name-only")
+    {
+        name_only = true;
+        tree_sha = args[2];
+    }
+    else
+    {
+        err << "Usage: ./mygit ls-tree [--name-only] <tree_sha>" << std::endl;
+        return 1;
+    }
+
+    if (tree_sha.size() != 40)
+    {
+        err << "Error: Invalid SHA-1 hash provided for 'ls-tree'." << std::endl;
+        return 1;
+    }
+
+    std::vector<TreeEntry> entries;
+    Status status = repo.read_tree(tree_sha, entries);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+
+    for (const auto &entry : entries)
+    {
+        if (name_only)
+        {
+            out << entry.name << std::endl;
+        }
+        else
+        {
+            out << entry.mode << "\t" << entry.sha << "\t" << entry.name << std::endl;
+        }
+    }
+    return 0;
+}
+
+// `--stats` output for add and commit: where the object pipeline spent its
+// time and how full each queue got.
+void print_pipeline_report(std::ostream &err, const PipelineReport &report)
+{
+    err << std::fixed << std::setprecision(1);
+    err << "pipeline: " << report.wall_ms << " ms wall, " << report.already_stored << " objects already stored\n";
+    err << "  stage       items        MB    busy ms  starved ms  blocked ms\n";
+    for (const auto &stage : report.stages)
+    {
+        err << "  " << std::left << std::setw(9) << stage.name << std::right << std::setw(8) << stage.items
+            << std::setw(10) << stage.bytes / 1048576.0 << std::setw(11) << stage.busy_ms << std::setw(12)
+            << stage.starved_ms << std::setw(12) << stage.blocked_ms << "\n";
+    }
+    err << "  queue     capacity  max depth  mean depth\n";
+    for (const auto &queue : report.queues)
+    {
+        err << "  " << std::left << std::setw(9) << queue.name << std::right << std::setw(9) << queue.capacity
+            << std::setw(11) << queue.max_depth << std::setw(12) << queue.mean_depth << "\n";
+    }
+    err << std::defaultfloat;
+}
+
+int cmd_commit(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    std::string message = "Default commit message";
+    bool stats = false;
+
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-m" && i + 1 < args.size())
+        {
+            message = args[++i];
+        }
+        else if (args[i] == "--stats")
+        {
+            stats = true;
+        }
+        else
+        {
+            err << "Usage: ./mygit commit [-m <message>] [--stats]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string commit_sha;
+    PipelineReport report;
+    Status status = repo.commit(message, commit_sha, stats ? &report : nullptr);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    if (stats)
+    {
+        print_pipeline_report(err, report);
+    }
+
+    Object commit_object;
+    repo.read_object(commit_sha, commit_object);
+    out << "Committed: " << commit_sha << std::endl;
+    out << commit_object.content;
+    return 0;
+}
+
+// -M[<percent>], -C and --no-renames, over the diff.renames and
+// diff.renameThreshold settings
+bool parse_rename_flag(const std::string &arg, RenameOptions &options)
+{
+    if (arg == "--no-renames")
+    {
+        options.detect_renames = false;
+        options.detect_copies = false;
+        return true;
+    }
+    if (arg == "-C")
+    {
+        options.detect_renames = true;
+        options.detect_copies = true;
+        return true;
+    }
+    if (arg.compare(0, 2, "-M") != 0)
+    {
+        return false;
+    }
+    std::string percent = arg.substr(2);
+    if (!percent.empty() && percent.back() == '%')
+    {
+        percent.pop_back();
+    }
+    if (!percent.empty() && (percent.size() > 3 || percent.find_first_not_of("0123456789") != std::string::npos ||
+                             std::stoi(percent) > 100))
+    {
+        return false;
+    }
+    options.detect_renames = true;
+    options.threshold = percent.empty() ? options.threshold : std::stoi(percent);
+    return true;
+}
+
+// What a commit changed relative to its first parent (or to nothing, for a
+// root commit)
+Status commit_changes(const Repository &repo, const Commit &commit, const RenameOptions &options,
+                      std::vector<TreeChange> &changes, RenameStats *stats = nullptr)
+{
+    Commit parent;
+    Status status = commit.parents.empty() ? Status() : repo.read_commit(commit.parents.front(), parent);
+    if (status.ok())
+    {
+        status = diff_trees(repo, parent.tree_sha, commit.tree_sha, changes);
+    }
+    return status.ok() ? detect_renames(repo, options, changes, stats) : status;
+}
+
+void print_changes(std::ostream &out, const std::vector<TreeChange> &changes)
+{
+    for (const auto &change : changes)
+    {
+        out << change.status;
+        if (change.status == 'R' || change.status == 'C')
+        {
+            out << std::setw(3) << std::setfill('0') << change.similarity << std::setfill(' ') << "\t"
+                << change.old_path << "\t" << change.new_path << "\n";
+        }
+        else
+        {
+            out << "\t" << (change.new_path.empty() ? change.old_path : change.new_path) << "\n";
+        }
+    }
+}
+
+int cmd_diff_tree(const Repository &repo, const std::vector<std::string> &args, std::ostream &out,
+                  std::ostream &err)
+{
+    RenameOptions options;
+    Status status = rename_options_from_config(repo, options);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    bool stats = false;
+    std::vector<std::string> names;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--stats")
+        {
+            stats = true;
+        }
+        else if (!parse_rename_flag(args[i], options) && (args[i][0] == '-' || names.size() == 2))
+        {
+            names.clear();
+            break;
+        }
+        else if (args[i][0] != '-')
+        {
+            names.push_back(args[i]);
+        }
+    }
+    if (names.empty())
+    {
+        err << "Usage: ./mygit diff-tree [-M[<percent>]] [-C] [--no-renames] [--stats] [<old-commit>] <commit>"
+            << std::endl;
+        return 1;
+    }
+
+    // One commit is compared with its first parent
+    std::vector<Commit> commits(names.size());
+    for (size_t i = 0; status.ok() && i < names.size(); ++i)
+    {
+        std::string sha;
+        status = repo.resolve_object_name(names[i], sha);
+        if (status.ok())
+        {
+            status = repo.read_commit(sha, commits[i]);
+        }
+    }
+    std::vector<TreeChange> changes;
+    RenameStats rename_stats;
+    if (status.ok() && commits.size() == 1)
+    {
+        status = commit_changes(repo, commits[0], options, changes, &rename_stats);
+    }
+    else if (status.ok())
+    {
+        status = diff_trees(repo, commits[0].tree_sha, commits[1].tree_sha, changes);
+        if (status.ok())
+        {
+            status = detect_renames(repo, options, changes, &rename_stats);
+        }
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    print_changes(out, changes);
+    if (stats)
+    {
+        err << "Renames: " << rename_stats.exact << " exact, " << rename_stats.inexact << " inexact; "
+            << rename_stats.copies << " copies; " << rename_stats.candidates << " candidate pairs scored among "
+            << rename_stats.sources << " sources and " << rename_stats.targets << " targets" << std::endl;
+    }
+    return 0;
+}
+
+// Newest first across every parent, so commits merged in from another
+// branch are listed too. --name-status adds each commit's changes against
+// its first parent, with renames detected as in diff-tree.
+int cmd_log(const Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    RenameOptions options;
+    bool name_status = false;
+    Status status = rename_options_from_config(repo, options);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--name-status")
+        {
+            name_status = true;
+        }
+        else if (!parse_rename_flag(args[i], options))
+        {
+            err << "Usage: ./mygit log [--name-status [-M[<percent>]] [-C] [--no-renames]]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string commit_sha;
+    status = repo.read_head(commit_sha);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+
+    std::map<std::string, Commit> pending; // By sha, until printed
+    std::set<std::string> seen;
+    auto queue = [&](const std::string &sha) {
+        Commit commit;
+        Status read = seen.count(sha) ? Status() : repo.read_commit(sha, commit);
+        if (read.ok() && seen.insert(sha).second)
+        {
+            pending.emplace(sha, std::move(commit));
+        }
+        return read;
+    };
+    status = commit_sha.empty() ? Status() : queue(commit_sha);
+
+    while (status.ok() && !pending.empty())
+    {
+        auto newest = newest_pending(repo, pending, [](const Commit &commit) -> const Commit & { return commit; });
+        commit_sha = newest->first;
+        Commit commit = std::move(newest->second);
+        pending.erase(newest);
+
+        out << "commit " << commit_sha << "\n";
+        out << "tree " << commit.tree_sha << "\n";
+        for (const auto &parent : commit.parents)
+        {
+            out << "parent " << parent << "\n";
+        }
+        out << "author " << commit.author << " " << commit.timestamp << "\n";
+        out << "committer " << commit.committer << " " << commit.timestamp << "\n";
+        out << "\n"
+            << commit.message << "\n\n";
+        if (name_status)
+        {
+            std::vector<TreeChange> changes;
+            status = commit_changes(repo, commit, options, changes);
+            print_changes(out, changes);
+            if (!changes.empty())
+            {
+                out << "\n";
+            }
+        }
+        out << "------------------------------------\n";
+
+        for (const auto &parent : commit.parents)
+        {
+            status = status.ok() ? queue(parent) : status;
+        }
+    }
+    return status.ok() ? 0 : fail(err, status);
+}
+
+int cmd_add(Repository &repo, const std::vector<std::string> &args, std::ostream &err)
+{
+    std::vector<std::string> files(args.begin() + 1, args.end());
+    bool stats = !files.empty() && files.front() == "--stats";
+    if (stats)
+    {
+        files.erase(files.begin());
+    }
+    if (files.empty())
+    {
+        err << "Usage: ./mygit add [--stats] <file> [<file> ...] or ./mygit add ." << std::endl;
+        return 1;
+    }
+
+    for (const auto &file : files)
+    {
+        if (file.empty())
+        {
+            err << "Error: Empty filename provided in 'add' command." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> missing;
+    PipelineReport report;
+    Status status = repo.add(files, missing, stats ? &report : nullptr);
+    for (const auto &file : missing)
+    {
+        err << "Warning: " << file << " not found.\n";
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    if (stats)
+    {
+        print_pipeline_report(err, report);
+    }
+    return 0;
+}
+
+int cmd_rm(Repository &repo, const std::vector<std::string> &args, std::ostream &err)
+{
+    if (args.size() < 2)
+    {
+        err << "Usage: ./mygit rm <file> [<file> ...]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files(args.begin() + 1, args.end());
+    std::vector<std::string> missing;
+    Status status = repo.remove(files, missing);
+    for (const auto &file : missing)
+    {
+        err << "Warning: " << file << " is not tracked.\n";
+    }
+    return status.ok() ? 0 : fail(err, status);
+}
+
+// A branch name switches HEAD to that branch; anything else names a commit
+// that the current branch is moved to.
+int cmd_checkout(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    if (args.size() != 2)
+    {
+        err << "Usage: ./mygit checkout <branch> | <commit>" << std::endl;
+        return 1;
+    }
+
+    std::string branch_sha;
+    std::string branch = "refs/heads/" + args[1];
+    if (is_valid_ref_name(args[1]) && repo.read_ref(branch, branch_sha).ok())
+    {
+        Status status = repo.switch_branch(branch);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Switched to branch " << args[1] << std::endl;
+        return 0;
+    }
+
+    std::string commit_sha;
+    Status status = repo.resolve_object_name(args[1], commit_sha);
+    if (status.ok())
+    {
+        out << "Checking out commit " << commit_sha << std::endl;
+        status = repo.checkout(commit_sha);
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    out << "Successfully checked out to commit: " << commit_sha << std::endl;
+    return 0;
+}
+
+// One line per line of the file: the commit that introduced it, its author
+// and date, and the line number in the current version
+int cmd_blame(const Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    bool stats = args.size() == 3 && args[1] == "--stats";
+    if (args.size() != 2 && !stats)
+    {
+        err << "Usage: ./mygit blame [--stats] <path>" << std::endl;
+        return 1;
+    }
+
+    std::string head_sha;
+    std::vector<BlameLine> lines;
+    BlameStats blame_stats;
+    Status status = repo.read_head(head_sha);
+    if (status.ok() && head_sha.empty())
+    {
+        status = Status::error(ErrorCode::NotFound, "Error: HEAD has no commits.");
+    }
+    if (status.ok())
+    {
+        status = blame_file(repo, head_sha, args.back(), lines, &blame_stats);
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+
+    std::map<std::string, Commit> commits;
+    size_t width = std::to_string(lines.size()).size();
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        Commit &commit = commits[lines[i].commit_sha];
+        if (commit.tree_sha.empty())
+        {
+            repo.read_commit(lines[i].commit_sha, commit);
+        }
+        std::string author = commit.author.substr(0, commit.author.find(" <"));
+        out << lines[i].commit_sha.substr(0, 8) << " (" << author << " " << commit.timestamp << " "
+            << std::setw(width) << i + 1 << ") " << lines[i].text << "\n";
+    }
+    if (stats)
+    {
+        err << "Visited " << blame_stats.commits_visited << " commits (" << blame_stats.commits_skipped
+            << " passed on without a diff), ran " << blame_stats.diffs << " diffs and read "
+            << blame_stats.trees_read << " trees" << std::endl;
+    }
+    return 0;
+}
+
+// A conflicted merge exits 1 and is finished with `add` and `commit`, or
+// dropped with `merge --abort`.
+int cmd_merge(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    if (args.size() == 2 && args[1] == "--abort")
+    {
+        Status status = abort_merge(repo);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Merge aborted." << std::endl;
+        return 0;
+    }
+
+    MergeOptions options;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-m" && i + 1 < args.size())
+        {
+            options.message = args[++i];
+        }
+        else if (options.their_name.empty() && args[i][0] != '-')
+        {
+            options.their_name = args[i];
+        }
+        else
+        {
+            options.their_name.clear();
+            break;
+        }
+    }
+    if (options.their_name.empty())
+    {
+        err << "Usage: ./mygit merge [-m <message>] <commit> | --abort" << std::endl;
+        return 1;
+    }
+
+    std::string their_sha;
+    MergeResult result;
+    Status status = repo.resolve_object_name(options.their_name, their_sha);
+    if (status.ok())
+    {
+        status = merge_commit(repo, their_sha, options, result);
+    }
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    if (result.up_to_date)
+    {
+        out << "Already up to date." << std::endl;
+        return 0;
+    }
+    if (result.fast_forward)
+    {
+        out << "Fast-forward to " << result.commit_sha << std::endl;
+        return 0;
+    }
+    out << (result.base_sha.empty() ? "No common ancestor" : "Merge base " + result.base_sha) << std::endl;
+    out << result.trees_taken << " subtrees taken whole, " << result.trees_read << " trees read, "
+        << result.files_merged << " files merged line by line" << std::endl;
+    if (!result.conflicts.empty())
+    {
+        for (const auto &conflict : result.conflicts)
+        {
+            out << "CONFLICT (" << conflict.kind << "): Merge conflict in " << conflict.path << std::endl;
+        }
+        out << "Automatic merge failed; fix the conflicts, add the files and commit." << std::endl;
+        return 1;
+    }
+    out << "Merge made: " << result.commit_sha << std::endl;
+    return 0;
+}
+
+// Shared by `branch` and `tag`, which differ only in where their refs live
+// and in `branch` marking the current one.
+int cmd_branch_or_tag(Repository &repo, const std::vector<std::string> &args, const std::string &prefix, bool is_branch,
+                 std::ostream &out, std::ostream &err)
+{
+    const char *usage = is_branch ? "Usage: ./mygit branch [<name> [<commit>] | -d <name>]"
+                                  : "Usage: ./mygit tag [<name> [<commit>] | -d <name>]";
+    if (args.size() == 1)
+    {
+        std::map<std::string, std::string> refs;
+        Status status = repo.list_refs(refs, prefix);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        std::string current = repo.head_branch();
+        for (const auto &[name, sha] : refs)
+        {
+            out << (is_branch ? (name == current ? "* " : "  ") : "") << name.substr(prefix.size()) << " "
+                << sha.substr(0, 7) << std::endl;
+        }
+        return 0;
+    }
+    if (args.size() == 3 && args[1] == "-d")
+    {
+        std::string ref_name = prefix + args[2];
+        std::string sha;
+        if (!is_valid_ref_name(args[2]) || !repo.read_ref(ref_name, sha).ok())
+        {
+            err << "Error: " << (is_branch ? "Branch" : "Tag") << " " << args[2] << " not found." << std::endl;
+            return 1;
+        }
+        if (is_branch && ref_name == repo.head_branch())
+        {
+            err << "Error: Cannot delete the current branch " << args[2] << "." << std::endl;
+            return 1;
+        }
+        Status status = repo.update_refs({{ref_name, "", true, sha}});
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Deleted " << (is_branch ? "branch " : "tag ") << args[2] << " (was " << sha.substr(0, 7) << ")"
+            << std::endl;
+        return 0;
+    }
+    if ((args.size() == 2 || args.size() == 3) && args[1][0] != '-')
+    {
+        if (!is_valid_ref_name(args[1]))
+        {
+            err << "Error: '" << args[1] << "' is not a valid name." << std::endl;
+            return 1;
+        }
+        std::string commit_sha;
+        Status status = args.size() == 3 ? repo.resolve_object_name(args[2], commit_sha)
+                                         : repo.resolve_object_name("HEAD", commit_sha);
+        Commit commit;
+        if (status.ok())
+        {
+            status = repo.read_commit(commit_sha, commit);
+        }
+        if (status.ok())
+        {
+            // Fails rather than moving a ref that already exists
+            status = repo.update_refs({{prefix + args[1], commit_sha, true, ""}});
+        }
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Created " << (is_branch ? "branch " : "tag ") << args[1] << " at " << commit_sha.substr(0, 7)
+            << std::endl;
+        return 0;
+    }
+
+    err << usage << std::endl;
+    return 1;
+}
+
+int cmd_rev_parse(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    if (args.size() != 2)
+    {
+        err << "Usage: ./mygit rev-parse <name>" << std::endl;
+        return 1;
+    }
+    std::string sha;
+    Status status = repo.resolve_object_name(args[1], sha);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    out << sha << std::endl;
+    return 0;
+}
+
+// Only edits the path list; the next checkout applies it.
+int cmd_sparse_checkout(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    std::string subcommand = args.size() > 1 ? args[1] : "";
+
+    if (subcommand == "set" && args.size() > 2)
+    {
+        Status status = SparseCheckout::save(repo, std::vector<std::string>(args.begin() + 2, args.end()));
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Sparse checkout paths updated; check out a commit to apply them." << std::endl;
+        return 0;
+    }
+    else if (subcommand == "list" && args.size() == 2)
+    {
+        SparseCheckout sparse;
+        Status status = SparseCheckout::load(repo, sparse);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        for (const auto &line : sparse.lines())
+        {
+            out << line << std::endl;
+        }
+        return 0;
+    }
+    else if (subcommand == "disable" && args.size() == 2)
+    {
+        std::error_code ec;
+        fs::remove(SparseCheckout::config_path(repo), ec);
+        if (ec)
+        {
+            err << "Error: Unable to remove " << SparseCheckout::config_path(repo).string() << std::endl;
+            return 1;
+        }
+        out << "Sparse checkout disabled; check out a commit to restore every path." << std::endl;
+        return 0;
+    }
+
+    err << "Usage: ./mygit sparse-checkout set <path> [<path> ...] | list | disable" << std::endl;
+    return 1;
+}
+
+int cmd_worktree(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    std::string subcommand = args.size() > 1 ? args[1] : "";
+
+    if (subcommand == "add" && (args.size() == 4 || (args.size() == 5 && args[2] == "--no-cache")))
+    {
+        bool use_file_cache = args.size() == 4;
+        const std::string &dir = args[args.size() - 2];
+        std::string commit_sha;
+        MaterializeStats stats;
+        Status status = repo.resolve_object_name(args.back(), commit_sha);
+        if (status.ok())
+        {
+            status = add_worktree(repo, dir, commit_sha, use_file_cache, stats);
+        }
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Prepared worktree " << dir << " at " << commit_sha << std::endl;
+        if (use_file_cache)
+        {
+            out << stats.files << " files: " << stats.cloned << " cloned, " << stats.copied
+                << " copied from the file cache (" << stats.cache_entries_added << " added to it)" << std::endl;
+        }
+        else if (args.size() == 4)
+        {
+            out << "No reflinks on this filesystem; checked out without the file cache" << std::endl;
+        }
+        return 0;
+    }
+    else if (subcommand == "list" && args.size() == 2)
+    {
+        std::vector<WorktreeInfo> worktrees;
+        Status status = list_worktrees(repo, worktrees);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        for (const auto &worktree : worktrees)
+        {
+            out << worktree.root.string() << "  " << (worktree.head.empty() ? "(no commit)" : worktree.head)
+                << (worktree.name.empty() ? "  [main]" : "") << std::endl;
+        }
+        return 0;
+    }
+
+    err << "Usage: ./mygit worktree add [--no-cache] <dir> <commit> | list" << std::endl;
+    return 1;
+}
+
+// "now", or a count of seconds, minutes, hours or days such as "30m" or "2d"
+bool parse_age(const std::string &text, std::chrono::seconds &age)
+{
+    if (text == "now")
+    {
+        age = std::chrono::seconds(0);
+        return true;
+    }
+    size_t digits = text.find_first_not_of("0123456789");
+    if (digits == 0 || text.empty() || text.size() > 10 || (digits != std::string::npos && digits + 1 != text.size()))
+    {
+        return false;
+    }
+    long long count = std::stoll(text.substr(0, digits));
+    char unit = digits == std::string::npos ? 's' : text[digits];
+    long long scale = unit == 's' ? 1 : unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0;
+    age = std::chrono::seconds(count * scale);
+    return scale != 0;
+}
+
+int cmd_gc(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    GcOptions options;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--prune")
+        {
+            options.prune = true;
+        }
+        else if (args[i].rfind("--prune=", 0) == 0 && parse_age(args[i].substr(8), options.grace))
+        {
+            options.prune = true;
+        }
+        else
+        {
+            err << "Usage: ./mygit gc [--prune[=now|<age>]]  (age: 90s, 30m, 12h, 14d)" << std::endl;
+            return 1;
+        }
+    }
+
+    GcReport report;
+    Status status = collect_garbage(repo, options, report);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    out << "Marked " << report.reachable << " of " << report.loose_objects << " loose objects reachable in "
+        << std::fixed << std::setprecision(1) << report.mark_ms << " ms" << std::endl;
+    out << report.unreachable << " unreachable (" << report.unreachable_bytes << " bytes), " << report.kept_recent
+        << " of them within the grace period" << std::endl;
+    if (options.prune)
+    {
+        out << "Pruned " << report.pruned << " objects, " << report.cache_files_pruned << " cached files and "
+            << report.temp_files_removed << " stale temp files, reclaiming " << report.bytes_reclaimed << " bytes"
+            << std::endl;
+    }
+    return 0;
+}
+
+int cmd_fsck(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    bool show_progress = true;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--no-progress")
+        {
+            show_progress = false;
+        }
+        else
+        {
+            err << "Usage: ./mygit fsck [--no-progress]" << std::endl;
+            return 1;
+        }
+    }
+
+    FsckProgress progress;
+    if (show_progress)
+    {
+        progress = [&err](size_t checked, size_t total) {
+            err << "\rChecking objects: " << (total ? checked * 100 / total : 100) << "% (" << checked << "/"
+                << total << ")" << (checked == total ? "\n" : "") << std::flush;
+        };
+    }
+    FsckReport report;
+    Status status = check_repository(repo, report, progress);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    for (const auto &problem : report.problems)
+    {
+        out << problem.sha << ": " << problem.message << std::endl;
+    }
+    out << "Checked " << report.objects << " objects (" << report.commits << " commits, " << report.trees
+        << " trees, " << report.blobs << " blobs, " << report.chunk_lists << " chunk lists; " << report.bytes
+        << " bytes stored): " << report.problems.size() << " problems" << std::endl;
+    return report.problems.empty() ? 0 : 1;
+}
+
+int cmd_grep(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    GrepOptions options;
+    std::vector<std::string> operands;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-F")
+        {
+            options.fixed_string = true;
+        }
+        else if (args[i] == "-i")
+        {
+            options.ignore_case = true;
+        }
+        else
+        {
+            operands.push_back(args[i]);
+        }
+    }
+    if (operands.empty() || operands.size() > 2)
+    {
+        err << "Usage: ./mygit grep [-F] [-i] <pattern> [<commit>]" << std::endl;
+        return 1;
+    }
+    options.pattern = operands[0];
+
+    std::string commit_sha;
+    Status status = operands.size() == 2 ? repo.resolve_object_name(operands[1], commit_sha)
+                                         : repo.read_head(commit_sha);
+    if (status.ok() && commit_sha.empty())
+    {
+        status = Status::error(ErrorCode::NotFound, "Error: No commits yet.");
+    }
+    size_t match_count = 0;
+    if (status.ok())
+    {
+        status = grep_commit(repo, commit_sha, options, [&](const GrepMatch &match) {
+            out << match.path << ":" << match.line_number << ":" << match.line << "\n";
+            ++match_count;
+        });
+    }
+    out << std::flush;
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    return match_count > 0 ? 0 : 1;
+}
+
+int cmd_archive(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    ArchiveFormat format = ArchiveFormat::Tar;
+    std::string commit_name;
+    bool usage_error = false;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--format=tar")
+        {
+            format = ArchiveFormat::Tar;
+        }
+        else if (args[i] == "--format=tar.gz" || args[i] == "--format=tgz")
+        {
+            format = ArchiveFormat::TarGz;
+        }
+        else if (commit_name.empty() && args[i].rfind("--", 0) != 0)
+        {
+            commit_name = args[i];
+        }
+        else
+        {
+            usage_error = true;
+        }
+    }
+    if (usage_error || commit_name.empty())
+    {
+        err << "Usage: ./mygit archive [--format=tar|tar.gz] <commit> > <file>" << std::endl;
+        return 1;
+    }
+
+    std::string commit_sha;
+    Status status = repo.resolve_object_name(commit_name, commit_sha);
+    if (status.ok())
+    {
+        status = write_archive(repo, commit_sha, format, out);
+    }
+    return status.ok() ? 0 : fail(err, status);
+}
+
+int cmd_bundle(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    std::string subcommand = args.size() > 1 ? args[1] : "";
+
+    if (subcommand == "create" && (args.size() == 3 || args.size() == 4))
+    {
+        std::string since_commit;
+        size_t object_count = 0;
+        Status status = args.size() == 4 ? repo.resolve_object_name(args[3], since_commit) : Status();
+        if (status.ok())
+        {
+            status = create_bundle(repo, args[2], since_commit, object_count);
+        }
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Bundled " << object_count << " objects into " << args[2] << std::endl;
+        return 0;
+    }
+    else if (subcommand == "unbundle" && args.size() == 3)
+    {
+        UnbundleResult result;
+        Status status = unbundle(repo, args[2], result);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        for (const auto &[ref_name, sha] : result.rejected_refs)
+        {
+            err << "Warning: Not updating " << ref_name << ", " << sha << " is not a fast-forward." << std::endl;
+        }
+        for (const auto &[ref_name, sha] : result.updated_refs)
+        {
+            out << "Updated " << ref_name << " to " << sha << std::endl;
+        }
+        out << "Unbundled " << result.object_count << " objects from " << args[2] << std::endl;
+        return 0;
+    }
+
+    err << "Usage: ./mygit bundle create <file> [<since-commit>] or ./mygit bundle unbundle <file>" << std::endl;
+    return 1;
+}
+int cmd_daemon(Repository &repo, const std::vector<std::string> &args, std::ostream &out, std::ostream &err)
+{
+    std::string subcommand = args.size() == 2 ? args[1] : "";
+
+    if (subcommand == "start")
+    {
+        if (repo.is_linked_worktree())
+        {
+            // Clients look for the socket in <root>/.mygit, a file here
+            err << "Error: The daemon only runs in the main worktree." << std::endl;
+            return 1;
+        }
+        int pid = 0;
+        Status status = start_daemon(repo, pid);
+        if (!status.ok())
+        {
+            return fail(err, status);
+        }
+        out << "Daemon started (pid " << pid << ")" << std::endl;
+        return 0;
+    }
+    else if (subcommand == "stop" || subcommand == "status")
+    {
+        int exit_code = 0;
+        if (run_via_daemon(repo.root(), args, out, err, exit_code))
+        {
+            return exit_code;
+        }
+        err << "No daemon is running for this repository." << std::endl;
+        return 1;
+    }
+
+    err << "Usage: ./mygit daemon start|stop|status" << std::endl;
+    return 1;
+}
+} // namespace
+
+int run_command(const std::vector<std::string> &args, std::istream &in, std::ostream &out, std::ostream &err)
+{
+    if (args.empty())
+    {
+        err << "Usage: ./mygit <command> [options]" << std::endl;
+        return 1;
+    }
+
+    const std::string &command = args[0];
+    Repository repo;
+
+    if (command == "init")
+    {
+        if (args.size() > 1)
+        {
+            err << "Error: 'init' takes no additional arguments." << std::endl;
+            return 1;
+        }
+        Status status = Repository::init(fs::current_path(), repo);
+        return status.ok() ? 0 : fail(err, status);
+    }
+    else if (command == "hash-object")
+    {
+        return cmd_hash_object(nullptr, args, out, err);
+    }
+
+    Status status = Repository::open(fs::current_path(), repo);
+    if (!status.ok())
+    {
+        return fail(err, status);
+    }
+    return run_command(repo, args, in, out, err);
+}
+
+int run_command(Repository &repo, const std::vector<std::string> &args, std::istream &in, std::ostream &out,
+                std::ostream &err)
+{
+    const std::string command = args.empty() ? "" : args[0];
+
+    if (command == "cat-file")
+    {
+        return cmd_cat_file(repo, args, in, out, err);
+    }
+    else if (command == "hash-object")
+    {
+        return cmd_hash_object(&repo, args, out, err);
+    }
+    else if (command == "ls-tree")
+    {
+        return cmd_ls_tree(repo, args, out, err);
+    }
+    else if (command == "commit")
+    {
+        return cmd_commit(repo, args, out, err);
+    }
+    else if (command == "log")
+    {
+        return cmd_log(repo, args, out, err);
+    }
+    else if (command == "add")
+    {
+        return cmd_add(repo, args, err);
+    }
+    else if (command == "rm")
+    {
+        return cmd_rm(repo, args, err);
+    }
+    else if (command == "checkout")
+    {
+        return cmd_checkout(repo, args, out, err);
+    }
+    else if (command == "blame")
+    {
+        return cmd_blame(repo, args, out, err);
+    }
+    else if (command == "diff-tree")
+    {
+        return cmd_diff_tree(repo, args, out, err);
+    }
+    else if (command == "merge")
+    {
+        return cmd_merge(repo, args, out, err);
+    }
+    else if (command == "branch")
+    {
+        return cmd_branch_or_tag(repo, args, "refs/heads/", true, out, err);
+    }
+    else if (command == "tag")
+    {
+        return cmd_branch_or_tag(repo, args, "refs/tags/", false, out, err);
+    }
+    else if (command == "rev-parse")
+    {
+        return cmd_rev_parse(repo, args, out, err);
+    }
+    else if (command == "worktree")
+    {
+        return cmd_worktree(repo, args, out, err);
+    }
+    else if (command == "sparse-checkout")
+    {
+        return cmd_sparse_checkout(repo, args, out, err);
+    }
+    else if (command == "fsck")
+    {
+        return cmd_fsck(repo, args, out, err);
+    }
+    else if (command == "grep")
+    {
+        return cmd_grep(repo, args, out, err);
+    }
+    else if (command == "archive")
+    {
+        return cmd_archive(repo, args, out, err);
+    }
+    else if (command == "gc")
+    {
+        return cmd_gc(repo, args, out, err);
+    }
+    else if (command == "bundle")
+    {
+        return cmd_bundle(repo, args, out, err);
+    }
+    else if (command == "daemon")
+    {
+        return cmd_daemon(repo, args, out, err);
+    }
+
+    err << "Error: Unknown command '" << command << "'." << std::endl;
+    return 1;
+}
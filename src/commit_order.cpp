@@ -0,0 +1,25 @@
+#include <unordered_set>
+#include "headers/commit_order.h"
+
+bool reaches_since(const Repository &repo, const Commit &descendant, const std::string &ancestor_sha,
+                   int64_t since)
+{
+    std::vector<std::string> stack = descendant.parents;
+    std::unordered_set<std::string> seen;
+    while (!stack.empty())
+    {
+        std::string sha = std::move(stack.back());
+        stack.pop_back();
+        if (sha == ancestor_sha)
+        {
+            return true;
+        }
+        Commit commit;
+        if (!seen.insert(sha).second || !repo.read_commit(sha, commit).ok() || commit.time() < since)
+        {
+            continue;
+        }
+        stack.insert(stack.end(), commit.parents.begin(), commit.parents.end());
+    }
+    return false;
+}
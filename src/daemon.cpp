@@ -0,0 +1,669 @@
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <csignal>
+#include <cstring>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "headers/daemon.h"
+#include "headers/commands.h"
+
+namespace fs = std::filesystem;
+
+// Every message on the socket is a frame: a one byte type, a four byte
+// big-endian payload length, then the payload.
+//
+//   client -> daemon   'A' arguments, each followed by '\0'
+//                      'I' a chunk of stdin, 'E' end of stdin
+//   daemon -> client   'O' stdout chunk, 'R' stderr chunk,
+//                      'X' exit code in decimal, always last
+namespace
+{
+const size_t OBJECT_CACHE_BYTES = 256 * 1024 * 1024;
+const size_t FRAME_CHUNK = 64 * 1024;
+
+volatile sig_atomic_t stop_requested = 0;
+int wake_fd = -1; // Write end of the pipe that wakes the accept loop
+
+void request_stop()
+{
+    stop_requested = 1;
+    char byte = 0;
+    ssize_t ignored = write(wake_fd, &byte, 1);
+    (void)ignored;
+}
+
+// Only batch mode reads stdin, for as long as its caller keeps it open
+bool is_batch_session(const std::vector<std::string> &args)
+{
+    return args.size() == 2 && args[0] == "cat-file" && (args[1] == "--batch" || args[1] == "--batch-check");
+}
+
+fs::path socket_path(const fs::path &git_dir)
+{
+    return git_dir / "daemon.sock";
+}
+
+bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+bool read_all(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t got = read(fd, data, len);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        data += got;
+        len -= got;
+    }
+    return true;
+}
+
+bool send_frame(int fd, char type, const char *data, size_t len)
+{
+    unsigned char header[5] = {static_cast<unsigned char>(type),
+                               static_cast<unsigned char>(len >> 24), static_cast<unsigned char>(len >> 16),
+                               static_cast<unsigned char>(len >> 8), static_cast<unsigned char>(len)};
+    return write_all(fd, reinterpret_cast<char *>(header), sizeof(header)) && write_all(fd, data, len);
+}
+
+bool recv_frame(int fd, char &type, std::string &payload)
+{
+    unsigned char header[5];
+    if (!read_all(fd, reinterpret_cast<char *>(header), sizeof(header)))
+    {
+        return false;
+    }
+    type = static_cast<char>(header[0]);
+    size_t len = (size_t(header[1]) << 24) | (size_t(header[2]) << 16) | (size_t(header[3]) << 8) | header[4];
+    payload.resize(len);
+    return read_all(fd, &payload[0], len);
+}
+
+int connect_to_daemon(const fs::path &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Output stream buffer that ships its contents to the client as frames of
+// one type. Once the client goes away further output is dropped.
+class FrameOutBuf : public std::streambuf
+{
+public:
+    FrameOutBuf(int fd, char type) : fd_(fd), type_(type), buffer_(FRAME_CHUNK)
+    {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        flush_buffer();
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+        flush_buffer();
+        return 0;
+    }
+
+private:
+    void flush_buffer()
+    {
+        size_t len = pptr() - pbase();
+        if (len > 0 && connected_)
+        {
+            connected_ = send_frame(fd_, type_, pbase(), len);
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    int fd_;
+    char type_;
+    bool connected_ = true;
+    std::vector<char> buffer_;
+};
+
+// Input stream buffer fed by the client's 'I' frames until 'E'.
+class FrameInBuf : public std::streambuf
+{
+public:
+    explicit FrameInBuf(int fd) : fd_(fd) {}
+
+protected:
+    int_type underflow() override
+    {
+        char type = 0;
+        while (!finished_ && recv_frame(fd_, type, chunk_))
+        {
+            if (type == 'I' && !chunk_.empty())
+            {
+                setg(&chunk_[0], &chunk_[0], &chunk_[0] + chunk_.size());
+                return traits_type::to_int_type(chunk_[0]);
+            }
+            finished_ = type == 'E';
+        }
+        finished_ = true;
+        return traits_type::eof();
+    }
+
+private:
+    int fd_;
+    bool finished_ = false;
+    std::string chunk_;
+};
+
+// Keeps one inotify watch per working tree directory (never .mygit) and
+// turns change events into cache invalidations on the repository.
+class WorkingTreeWatcher
+{
+public:
+    explicit WorkingTreeWatcher(const fs::path &root) : root_(root)
+    {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        complete_ = fd_ >= 0 && watch_tree("");
+    }
+
+    ~WorkingTreeWatcher()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    int fd() const { return fd_; }
+    bool complete() const { return complete_; }
+
+    // Applies every queued event. Returns false if changes may have been
+    // missed (queue overflow or watch limit), in which case the caller must
+    // stop trusting what it knows about the working tree.
+    bool drain(Repository &repo)
+    {
+        alignas(inotify_event) char buffer[64 * 1024];
+        ssize_t len;
+        while ((len = read(fd_, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *p = buffer; p < buffer + len;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+                handle_event(*event, repo);
+            }
+        }
+        return complete_;
+    }
+
+private:
+    bool watch_tree(const std::string &relative_dir)
+    {
+        const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+        fs::path dir = relative_dir.empty() ? root_ : root_ / relative_dir;
+        int wd = inotify_add_watch(fd_, dir.c_str(), mask);
+        if (wd < 0)
+        {
+            return errno == ENOENT; // Removed before we got to it
+        }
+        watched_dirs_[wd] = relative_dir;
+
+        std::error_code ec;
+        for (const auto &entry : fs::directory_iterator(dir, ec))
+        {
+            std::string name = entry.path().filename().string();
+            if (entry.is_directory(ec) && !entry.is_symlink(ec) && !(relative_dir.empty() && name == ".mygit"))
+            {
+                if (!watch_tree(relative_dir.empty() ? name : relative_dir + "/" + name))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void handle_event(const inotify_event &event, Repository &repo)
+    {
+        if (event.mask & IN_Q_OVERFLOW)
+        {
+            repo.forget_working_tree();
+            complete_ = watch_tree("") && complete_;
+            return;
+        }
+
+        auto dir = watched_dirs_.find(event.wd);
+        if (dir == watched_dirs_.end())
+        {
+            return;
+        }
+        if (event.mask & IN_IGNORED)
+        {
+            watched_dirs_.erase(dir);
+            return;
+        }
+
+        std::string name = event.len > 0 ? std::string(event.name) : "";
+        if (name.empty())
+        {
+            repo.forget_working_tree_path(dir->second);
+            return;
+        }
+        if (dir->second.empty() && name == ".mygit")
+        {
+            return;
+        }
+
+        std::string relative_path = dir->second.empty() ? name : dir->second + "/" + name;
+        repo.forget_working_tree_path(relative_path);
+        if ((event.mask & IN_ISDIR) && (event.mask & IN_MOVED_FROM))
+        {
+            // Watches follow the inode, so a renamed directory would keep
+            // reporting under its old path; drop them and rewatch on arrival.
+            unwatch_tree(relative_path);
+        }
+        else if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO)))
+        {
+            complete_ = watch_tree(relative_path) && complete_;
+        }
+    }
+
+    void unwatch_tree(const std::string &relative_dir)
+    {
+        std::string prefix = relative_dir + "/";
+        for (auto it = watched_dirs_.begin(); it != watched_dirs_.end();)
+        {
+            if (it->second == relative_dir || it->second.compare(0, prefix.size(), prefix) == 0)
+            {
+                inotify_rm_watch(fd_, it->first);
+                it = watched_dirs_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    fs::path root_;
+    int fd_ = -1;
+    bool complete_ = false;
+    std::unordered_map<int, std::string> watched_dirs_;
+};
+
+// The daemon's one cached Repository. Commands run on it one at a time,
+// each after the working tree changes seen so far are applied.
+struct DaemonState
+{
+    explicit DaemonState(const fs::path &root) : watcher(root) {}
+
+    // Callers hold `mutex`
+    void refresh()
+    {
+        if (watching && !watcher.drain(repo))
+        {
+            // Some change may have gone unseen; keep serving without the
+            // working tree cache rather than risk staging stale content.
+            watching = false;
+            repo.enable_caching(OBJECT_CACHE_BYTES, false);
+        }
+    }
+
+    std::mutex mutex;
+    Repository repo;
+    WorkingTreeWatcher watcher;
+    bool watching = false;
+};
+
+// Handles one client connection on its own thread. Batch sessions last as
+// long as the client's stdin, so they get a Repository of their own and
+// never hold up other clients; every other command runs on the shared one.
+void serve_client(int client_fd, std::shared_ptr<DaemonState> state)
+{
+    char type = 0;
+    std::string payload;
+    if (!recv_frame(client_fd, type, payload) || type != 'A')
+    {
+        close(client_fd);
+        return;
+    }
+
+    std::vector<std::string> args;
+    std::istringstream arg_stream(payload);
+    std::string arg;
+    while (std::getline(arg_stream, arg, '\0'))
+    {
+        args.push_back(arg);
+    }
+
+    FrameOutBuf out_buf(client_fd, 'O');
+    FrameOutBuf err_buf(client_fd, 'R');
+    FrameInBuf in_buf(client_fd);
+    std::ostream out(&out_buf);
+    std::ostream err(&err_buf);
+    std::istream in(&in_buf);
+
+    int exit_code = 0;
+    bool stop = false;
+    if (args.size() == 2 && args[0] == "daemon" && (args[1] == "status" || args[1] == "stop"))
+    {
+        stop = args[1] == "stop";
+        out << "Daemon " << (stop ? "stopping" : "running") << " (pid " << getpid() << ") for "
+            << state->repo.root().string() << std::endl;
+    }
+    else
+    {
+        try
+        {
+            if (is_batch_session(args))
+            {
+                Repository session;
+                Status status = Repository::open(state->repo.root(), session);
+                session.enable_caching(OBJECT_CACHE_BYTES, false);
+                exit_code = status.ok() ? run_command(session, args, in, out, err) : 1;
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                // Events for writes the client made before connecting are
+                // already queued; apply them before running its command.
+                state->refresh();
+                exit_code = run_command(state->repo, args, in, out, err);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            err << "Error: " << e.what() << std::endl;
+            exit_code = 1;
+        }
+    }
+
+    if (stop)
+    {
+        // Unlink first so later commands fall back to running in-process
+        // instead of connecting to a daemon that is about to exit.
+        std::error_code ec;
+        fs::remove(socket_path(state->repo.git_dir()), ec);
+    }
+
+    out.flush();
+    err.flush();
+    std::string code = std::to_string(exit_code);
+    send_frame(client_fd, 'X', code.data(), code.size());
+    close(client_fd);
+    if (stop)
+    {
+        request_stop();
+    }
+}
+
+void serve(int listen_fd, const fs::path &root)
+{
+    auto state = std::make_shared<DaemonState>(root);
+    if (!Repository::open(root, state->repo).ok())
+    {
+        return;
+    }
+    state->watching = state->watcher.complete();
+    state->repo.enable_caching(OBJECT_CACHE_BYTES, state->watching);
+
+    if (state->watching)
+    {
+        // Applies changes as they happen, so the inotify queue does not
+        // overflow while no command is running
+        std::thread([state]() {
+            pollfd watch_fd = {state->watcher.fd(), POLLIN, 0};
+            while (true)
+            {
+                if (poll(&watch_fd, 1, -1) < 0)
+                {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->refresh();
+                if (!state->watching)
+                {
+                    return;
+                }
+            }
+        }).detach();
+    }
+
+    int wake[2];
+    if (pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        return;
+    }
+    wake_fd = wake[1];
+    pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+    while (!stop_requested)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            continue; // EINTR, possibly from SIGTERM
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0)
+            {
+                std::thread(serve_client, client_fd, state).detach();
+            }
+        }
+    }
+
+    // Let a command already running on the shared repository finish, and
+    // start no other; the process exits with the lock still held. Batch
+    // sessions only read, and are cut off.
+    state->mutex.lock();
+}
+} // namespace
+
+Status start_daemon(const Repository &repo, int &pid)
+{
+    fs::path path = socket_path(repo.git_dir());
+    int existing = connect_to_daemon(path);
+    if (existing >= 0)
+    {
+        close(existing);
+        return Status::error(ErrorCode::InvalidArgument, "Error: A daemon is already running for this repository.");
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(address.sun_path))
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Socket path too long: " + path.string());
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    // Listen before forking so a command run right after `daemon start`
+    // already finds the socket.
+    std::error_code ec;
+    fs::remove(path, ec);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, 16) != 0)
+    {
+        if (listen_fd >= 0)
+        {
+            close(listen_fd);
+        }
+        return Status::error(ErrorCode::IoError, "Error: Unable to listen on " + path.string() + ": " + std::strerror(errno));
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid = fork();
+    if (pid < 0)
+    {
+        close(listen_fd);
+        fs::remove(path, ec);
+        return Status::error(ErrorCode::IoError, std::string("Error: Unable to fork daemon: ") + std::strerror(errno));
+    }
+    if (pid == 0)
+    {
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO)
+        {
+            close(null_fd);
+        }
+        std::signal(SIGTERM, [](int) { request_stop(); });
+        std::signal(SIGINT, [](int) { request_stop(); });
+        std::signal(SIGPIPE, SIG_IGN);
+
+        fs::current_path(repo.root(), ec);
+        serve(listen_fd, repo.root());
+        close(listen_fd);
+        fs::remove(path, ec);
+        _exit(0);
+    }
+
+    close(listen_fd);
+    return {};
+}
+
+bool run_via_daemon(const fs::path &root, const std::vector<std::string> &args, std::ostream &out,
+                    std::ostream &err, int &exit_code)
+{
+    int fd = connect_to_daemon(socket_path(root / ".mygit"));
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    std::string packed_args;
+    for (const auto &arg : args)
+    {
+        packed_args += arg;
+        packed_args += '\0';
+    }
+
+    // Only batch mode reads stdin; leave it untouched for everything else so
+    // a calling script's own input is not swallowed.
+    bool forward_stdin = is_batch_session(args);
+    if (!send_frame(fd, 'A', packed_args.data(), packed_args.size()))
+    {
+        close(fd);
+        return false;
+    }
+    // From here on the command may have run, so nothing may fall back to
+    // running it a second time in-process. The daemon can also finish and
+    // hang up before reading end-of-stdin, so that send is allowed to fail.
+    if (!forward_stdin)
+    {
+        send_frame(fd, 'E', nullptr, 0);
+    }
+
+    exit_code = 1;
+    std::vector<char> buffer(FRAME_CHUNK);
+    pollfd fds[2] = {{fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+    char type = 0;
+    std::string payload;
+
+    while (true)
+    {
+        if (poll(fds, forward_stdin ? 2 : 1, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (forward_stdin && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            ssize_t got = read(STDIN_FILENO, buffer.data(), buffer.size());
+            if (got > 0)
+            {
+                send_frame(fd, 'I', buffer.data(), got);
+            }
+            else if (got == 0 || errno != EINTR)
+            {
+                send_frame(fd, 'E', nullptr, 0);
+                forward_stdin = false;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            if (!recv_frame(fd, type, payload))
+            {
+                err << "Error: Lost connection to the daemon." << std::endl;
+                break;
+            }
+            if (type == 'O')
+            {
+                out.write(payload.data(), payload.size());
+                out.flush();
+            }
+            else if (type == 'R')
+            {
+                err.write(payload.data(), payload.size());
+                err.flush();
+            }
+            else if (type == 'X')
+            {
+                exit_code = std::atoi(payload.c_str());
+                break;
+            }
+        }
+    }
+
+    close(fd);
+    return true;
+}
@@ -0,0 +1,600 @@
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include "headers/diff.h"
+
+namespace
+{
+const char *DIRECTORY_MODE = "040000";
+const size_t MAX_CHUNK_BYTES = 64;
+// Band width for pairing candidates: two sketches sharing any 2 adjacent
+// slots are scored. At 50% similarity a pair is missed about once in 10^4.
+const size_t BAND_SLOTS = 2;
+// Past this many differing lines a line diff gives up and treats the whole
+// changed region as one hunk
+const int MAX_EDIT_DISTANCE = 2048;
+// A band value shared by more sources than this is a chunk common to most
+// files (a blank line, a lone brace); real matches also share other bands
+const size_t MAX_BUCKET_SOURCES = 256;
+
+uint64_t mix(uint64_t x)
+{
+    // splitmix64's finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t hash_bytes(const char *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+    }
+    return mix(hash);
+}
+
+bool is_directory(const TreeEntry *entry)
+{
+    return entry && entry->mode == DIRECTORY_MODE;
+}
+
+Status read_children(const Repository &repo, const std::string &tree_sha, std::map<std::string, TreeEntry> &children)
+{
+    if (tree_sha.empty())
+    {
+        return {};
+    }
+    std::vector<TreeEntry> entries;
+    Status status = repo.read_tree(tree_sha, entries);
+    for (auto &entry : entries)
+    {
+        std::string path = entry.name;
+        children.emplace(std::move(path), std::move(entry));
+    }
+    return status;
+}
+
+// Every file in a directory that only one side has
+Status add_whole_tree(const Repository &repo, const TreeEntry &directory, bool added,
+                      std::vector<TreeChange> &changes)
+{
+    std::map<std::string, TreeEntry> entries;
+    Status status = repo.read_tree_recursive(directory.sha, entries);
+    for (const auto &[path, entry] : entries)
+    {
+        if (entry.mode == DIRECTORY_MODE)
+        {
+            continue;
+        }
+        TreeChange change;
+        change.status = added ? 'A' : 'D';
+        (added ? change.new_path : change.old_path) = path;
+        (added ? change.new_mode : change.old_mode) = entry.mode;
+        (added ? change.new_sha : change.old_sha) = entry.sha;
+        changes.push_back(std::move(change));
+    }
+    return status;
+}
+
+Status diff_directories(const Repository &repo, const std::string &old_sha, const std::string &new_sha,
+                        std::vector<TreeChange> &changes)
+{
+    std::map<std::string, TreeEntry> old_children, new_children;
+    Status status = read_children(repo, old_sha, old_children);
+    if (status.ok())
+    {
+        status = read_children(repo, new_sha, new_children);
+    }
+    std::set<std::string> paths;
+    for (const auto *side : {&old_children, &new_children})
+    {
+        for (const auto &child : *side)
+        {
+            paths.insert(child.first);
+        }
+    }
+
+    for (auto it = paths.begin(); status.ok() && it != paths.end(); ++it)
+    {
+        auto old_found = old_children.find(*it);
+        auto new_found = new_children.find(*it);
+        const TreeEntry *old_entry = old_found == old_children.end() ? nullptr : &old_found->second;
+        const TreeEntry *new_entry = new_found == new_children.end() ? nullptr : &new_found->second;
+        if (old_entry && new_entry && old_entry->mode == new_entry->mode && old_entry->sha == new_entry->sha)
+        {
+            continue;
+        }
+        if (is_directory(old_entry) && is_directory(new_entry))
+        {
+            status = diff_directories(repo, old_entry->sha, new_entry->sha, changes);
+        }
+        else if (old_entry && new_entry && !is_directory(old_entry) && !is_directory(new_entry))
+        {
+            changes.push_back({'M', *it, *it, old_entry->mode, new_entry->mode, old_entry->sha, new_entry->sha, 0});
+        }
+        else
+        {
+            // Added, deleted, or a file replaced by a directory (or back)
+            if (is_directory(old_entry))
+            {
+                status = add_whole_tree(repo, *old_entry, false, changes);
+            }
+            else if (old_entry)
+            {
+                changes.push_back({'D', *it, "", old_entry->mode, "", old_entry->sha, "", 0});
+            }
+            if (status.ok() && is_directory(new_entry))
+            {
+                status = add_whole_tree(repo, *new_entry, true, changes);
+            }
+            else if (status.ok() && new_entry)
+            {
+                changes.push_back({'A', "", *it, "", new_entry->mode, "", new_entry->sha, 0});
+            }
+        }
+    }
+    return status;
+}
+
+const std::string &change_path(const TreeChange &change)
+{
+    return change.new_path.empty() ? change.old_path : change.new_path;
+}
+
+Status sketch_blob(const Repository &repo, const std::string &sha, SimilaritySketch &sketch)
+{
+    std::string data;
+    Status status = repo.stream_blob(sha, [&data](const std::string &part) {
+        data += part;
+        return Status();
+    });
+    sketch = SimilaritySketch::of(data);
+    return status;
+}
+
+struct Candidate
+{
+    int score;
+    size_t source; // Index into sources
+    size_t target; // Index into targets
+};
+} // namespace
+
+std::vector<std::string_view> split_lines(const std::string &text)
+{
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t newline = text.find('\n', start);
+        size_t end = newline == std::string::npos ? text.size() : newline + 1;
+        lines.emplace_back(text.data() + start, end - start);
+        start = end;
+    }
+    return lines;
+}
+
+// Myers' O(ND) diff, after trimming the common prefix and suffix. Each
+// round's frontier is kept so the edit path can be walked back.
+std::vector<LineHunk> diff_line_ids(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+{
+    size_t prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix])
+    {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+           a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix])
+    {
+        ++suffix;
+    }
+    int n = static_cast<int>(a.size() - prefix - suffix);
+    int m = static_cast<int>(b.size() - prefix - suffix);
+    if (n == 0 && m == 0)
+    {
+        return {};
+    }
+    const uint32_t *x = a.data() + prefix;
+    const uint32_t *y = b.data() + prefix;
+
+    int limit = std::min(n + m, MAX_EDIT_DISTANCE);
+    int offset = limit + 1;
+    std::vector<int> frontier(2 * limit + 3, 0);
+    std::vector<std::vector<int>> trace; // trace[d][k + d]: furthest x on diagonal k after d edits
+    int distance = -1;
+    for (int d = 0; d <= limit && distance < 0; ++d)
+    {
+        for (int k = -d; k <= d; k += 2)
+        {
+            int xk = (k == -d || (k != d && frontier[offset + k - 1] < frontier[offset + k + 1]))
+                         ? frontier[offset + k + 1]
+                         : frontier[offset + k - 1] + 1;
+            int yk = xk - k;
+            while (xk < n && yk < m && x[xk] == y[yk])
+            {
+                ++xk;
+                ++yk;
+            }
+            frontier[offset + k] = xk;
+            if (xk >= n && yk >= m)
+            {
+                distance = d;
+            }
+        }
+        trace.emplace_back(frontier.begin() + offset - d, frontier.begin() + offset + d + 1);
+    }
+    if (distance < 0)
+    {
+        return {{prefix, prefix + n, prefix, prefix + m}};
+    }
+
+    std::vector<bool> deleted(n, false);
+    std::vector<bool> inserted(m, false);
+    int xi = n;
+    int yi = m;
+    for (int d = distance; d > 0; --d)
+    {
+        const std::vector<int> &previous = trace[d - 1];
+        auto furthest = [&](int k) { return previous[k + d - 1]; };
+        int k = xi - yi;
+        bool down = k == -d || (k != d && furthest(k - 1) < furthest(k + 1));
+        int previous_k = down ? k + 1 : k - 1;
+        int previous_x = furthest(previous_k);
+        int previous_y = previous_x - previous_k;
+        if (down)
+        {
+            inserted[previous_y] = true;
+        }
+        else
+        {
+            deleted[previous_x] = true;
+        }
+        xi = previous_x;
+        yi = previous_y;
+    }
+
+    // Adjacent deletions and insertions make one hunk
+    std::vector<LineHunk> hunks;
+    int i = 0;
+    int j = 0;
+    while (i < n || j < m)
+    {
+        if ((i < n && deleted[i]) || (j < m && inserted[j]))
+        {
+            LineHunk hunk = {prefix + i, 0, prefix + j, 0};
+            while ((i < n && deleted[i]) || (j < m && inserted[j]))
+            {
+                i += i < n && deleted[i];
+                j += j < m && inserted[j];
+            }
+            hunk.old_end = prefix + i;
+            hunk.new_end = prefix + j;
+            hunks.push_back(hunk);
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+    return hunks;
+}
+
+std::vector<LineHunk> diff_lines(const std::vector<std::string_view> &a, const std::vector<std::string_view> &b)
+{
+    std::unordered_map<std::string_view, uint32_t> line_ids;
+    auto to_ids = [&line_ids](const std::vector<std::string_view> &lines) {
+        std::vector<uint32_t> ids;
+        ids.reserve(lines.size());
+        for (const auto &line : lines)
+        {
+            ids.push_back(line_ids.emplace(line, static_cast<uint32_t>(line_ids.size())).first->second);
+        }
+        return ids;
+    };
+    std::vector<uint32_t> a_ids = to_ids(a);
+    return diff_line_ids(a_ids, to_ids(b));
+}
+SimilaritySketch SimilaritySketch::of(const std::string &data)
+{
+    SimilaritySketch sketch;
+    sketch.size_ = data.size();
+    std::unordered_set<uint64_t> seen;
+    std::array<bool, SLOTS> filled{};
+    sketch.slots_.fill(UINT64_MAX);
+    for (size_t start = 0; start < data.size();)
+    {
+        size_t newline = data.find('\n', start);
+        size_t end = std::min(newline == std::string::npos ? data.size() : newline + 1, start + MAX_CHUNK_BYTES);
+        uint64_t hash = hash_bytes(data.data() + start, end - start);
+        start = end;
+        if (!seen.insert(hash).second)
+        {
+            continue;
+        }
+        // The top bits pick the slot, so the rest still orders hashes within it
+        uint64_t &slot = sketch.slots_[hash >> 58];
+        slot = std::min(slot, hash & (UINT64_MAX >> 6));
+        filled[hash >> 58] = true;
+    }
+    sketch.chunks_ = seen.size();
+    if (sketch.chunks_ == 0)
+    {
+        return sketch;
+    }
+
+    // Rotation densification: an empty slot takes the next filled slot's
+    // value, salted by the distance, so files with few chunks still compare
+    // on every slot
+    for (size_t i = 0; i < SLOTS; ++i)
+    {
+        size_t distance = 0;
+        while (!filled[(i + distance) % SLOTS])
+        {
+            ++distance;
+        }
+        if (distance > 0)
+        {
+            sketch.slots_[i] = mix(sketch.slots_[(i + distance) % SLOTS] + distance);
+        }
+    }
+    return sketch;
+}
+
+int SimilaritySketch::similarity(const SimilaritySketch &other) const
+{
+    if (empty() || other.empty())
+    {
+        return empty() && other.empty() ? 100 : 0;
+    }
+    size_t matching = 0;
+    for (size_t i = 0; i < SLOTS; ++i)
+    {
+        matching += slots_[i] == other.slots_[i];
+    }
+    return static_cast<int>(matching * 100 / SLOTS);
+}
+
+Status diff_trees(const Repository &repo, const std::string &old_tree_sha, const std::string &new_tree_sha,
+                  std::vector<TreeChange> &changes)
+{
+    changes.clear();
+    if (old_tree_sha == new_tree_sha)
+    {
+        return {};
+    }
+    Status status = diff_directories(repo, old_tree_sha, new_tree_sha, changes);
+    std::stable_sort(changes.begin(), changes.end(), [](const TreeChange &a, const TreeChange &b) {
+        return change_path(a) < change_path(b);
+    });
+    return status;
+}
+
+Status detect_renames(const Repository &repo, const RenameOptions &options, std::vector<TreeChange> &changes,
+                      RenameStats *stats)
+{
+    RenameStats ignored;
+    RenameStats &counts = stats ? *stats : ignored;
+    if (!options.detect_renames && !options.detect_copies)
+    {
+        return {};
+    }
+
+    std::vector<size_t> deleted, added, modified;
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        (changes[i].status == 'D' ? deleted : changes[i].status == 'A' ? added : modified).push_back(i);
+    }
+    if (added.empty() || (deleted.empty() && !options.detect_copies))
+    {
+        return {};
+    }
+
+    // Exact matches by blob ID
+    std::unordered_map<std::string, std::vector<size_t>> deleted_by_sha;
+    std::unordered_map<std::string, size_t> copy_source_by_sha;
+    for (auto it = deleted.rbegin(); it != deleted.rend(); ++it)
+    {
+        deleted_by_sha[changes[*it].old_sha].push_back(*it);
+        copy_source_by_sha[changes[*it].old_sha] = *it;
+    }
+    if (options.detect_copies)
+    {
+        for (size_t i : modified)
+        {
+            copy_source_by_sha.emplace(changes[i].old_sha, i);
+        }
+    }
+    std::vector<bool> renamed(changes.size(), false); // Deleted files used by a rename
+    std::vector<size_t> unmatched;
+    auto pair_up = [&](size_t target, size_t source, int score) {
+        TreeChange &change = changes[target];
+        bool rename = changes[source].status == 'D' && !renamed[source];
+        change.status = rename ? 'R' : 'C';
+        change.old_path = changes[source].old_path;
+        change.old_mode = changes[source].old_mode;
+        change.old_sha = changes[source].old_sha;
+        change.similarity = score;
+        if (rename)
+        {
+            renamed[source] = true;
+        }
+        else
+        {
+            ++counts.copies;
+        }
+    };
+    for (size_t target : added)
+    {
+        auto same = deleted_by_sha.find(changes[target].new_sha);
+        if (same != deleted_by_sha.end() && !same->second.empty())
+        {
+            pair_up(target, same->second.back(), 100);
+            same->second.pop_back();
+            ++counts.exact;
+            continue;
+        }
+        auto copied = copy_source_by_sha.find(changes[target].new_sha);
+        if (options.detect_copies && copied != copy_source_by_sha.end())
+        {
+            pair_up(target, copied->second, 100);
+            continue;
+        }
+        unmatched.push_back(target);
+    }
+
+    // Inexact matches: sketch what is left, pair through shared bands, and
+    // score only those pairs
+    std::vector<size_t> sources;
+    for (size_t i : deleted)
+    {
+        if (!renamed[i])
+        {
+            sources.push_back(i);
+        }
+    }
+    if (options.detect_copies)
+    {
+        sources.insert(sources.end(), modified.begin(), modified.end());
+    }
+    Status status;
+    std::vector<SimilaritySketch> source_sketches(sources.size());
+    std::vector<SimilaritySketch> target_sketches(unmatched.size());
+    for (size_t i = 0; status.ok() && !unmatched.empty() && i < sources.size(); ++i)
+    {
+        status = sketch_blob(repo, changes[sources[i]].old_sha, source_sketches[i]);
+    }
+    for (size_t i = 0; status.ok() && !sources.empty() && i < unmatched.size(); ++i)
+    {
+        status = sketch_blob(repo, changes[unmatched[i]].new_sha, target_sketches[i]);
+    }
+    if (!status.ok() || sources.empty() || unmatched.empty())
+    {
+        return status;
+    }
+    counts.sources = sources.size();
+    counts.targets = unmatched.size();
+
+    auto band_key = [](const SimilaritySketch &sketch, size_t band) {
+        uint64_t key = band;
+        for (size_t slot = band * BAND_SLOTS; slot < (band + 1) * BAND_SLOTS; ++slot)
+        {
+            key = mix(key ^ sketch.slots()[slot]);
+        }
+        return key;
+    };
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        for (size_t band = 0; !source_sketches[i].empty() && band < SimilaritySketch::SLOTS / BAND_SLOTS; ++band)
+        {
+            buckets[band_key(source_sketches[i], band)].push_back(i);
+        }
+    }
+
+    std::vector<Candidate> candidates;
+    std::vector<size_t> last_seen(sources.size(), SIZE_MAX);
+    for (size_t t = 0; t < unmatched.size(); ++t)
+    {
+        const SimilaritySketch &target = target_sketches[t];
+        for (size_t band = 0; !target.empty() && band < SimilaritySketch::SLOTS / BAND_SLOTS; ++band)
+        {
+            auto bucket = buckets.find(band_key(target, band));
+            if (bucket == buckets.end() || bucket->second.size() > MAX_BUCKET_SOURCES)
+            {
+                continue;
+            }
+            for (size_t s : bucket->second)
+            {
+                if (last_seen[s] == t)
+                {
+                    continue;
+                }
+                last_seen[s] = t;
+                // Files this different in size cannot reach the threshold
+                size_t smaller = std::min(source_sketches[s].size(), target.size());
+                size_t larger = std::max(source_sketches[s].size(), target.size());
+                if (smaller * 100 < larger * static_cast<size_t>(options.threshold))
+                {
+                    continue;
+                }
+                ++counts.candidates;
+                // Identical files were paired above, so an estimate of 100
+                // is rounding
+                int score = std::min(source_sketches[s].similarity(target), 99);
+                if (score >= options.threshold)
+                {
+                    candidates.push_back({score, s, t});
+                }
+            }
+        }
+    }
+
+    // Best first; ties go to the source and target that come first
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.score != b.score ? a.score > b.score
+                                  : (a.target != b.target ? a.target < b.target : a.source < b.source);
+    });
+    std::vector<bool> target_done(unmatched.size(), false);
+    for (const auto &candidate : candidates)
+    {
+        size_t source = sources[candidate.source];
+        bool usable = (changes[source].status == 'D' && !renamed[source]) || options.detect_copies;
+        if (target_done[candidate.target] || !usable)
+        {
+            continue;
+        }
+        target_done[candidate.target] = true;
+        if (changes[source].status == 'D' && !renamed[source])
+        {
+            ++counts.inexact;
+        }
+        pair_up(unmatched[candidate.target], source, candidate.score);
+    }
+
+    // Renamed files are no longer deletions
+    std::vector<TreeChange> kept;
+    kept.reserve(changes.size());
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        if (!renamed[i])
+        {
+            kept.push_back(std::move(changes[i]));
+        }
+    }
+    changes = std::move(kept);
+    return {};
+}
+
+Status rename_options_from_config(const Repository &repo, RenameOptions &options)
+{
+    options = RenameOptions();
+    std::string renames = repo.config_value("diff.renames", "true");
+    if (renames == "false" || renames == "copies" || renames == "true")
+    {
+        options.detect_renames = renames != "false";
+        options.detect_copies = renames == "copies";
+    }
+    else
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid diff.renames in .mygit/config.");
+    }
+    std::string threshold = repo.config_value("diff.renameThreshold", "50");
+    if (!threshold.empty() && threshold.back() == '%')
+    {
+        threshold.pop_back();
+    }
+    if (threshold.empty() || threshold.size() > 3 ||
+        threshold.find_first_not_of("0123456789") != std::string::npos || std::stoi(threshold) > 100)
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid diff.renameThreshold in .mygit/config.");
+    }
+    options.threshold = std::stoi(threshold);
+    return {};
+}
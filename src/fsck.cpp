@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "headers/chunking.h"
+#include "headers/fsck.h"
+#include "headers/reftable.h"
+#include "headers/utils.h"
+
+namespace
+{
+// Small enough to balance the threads, large enough to keep the shared
+// counter off the hot path
+const size_t CLAIM_BATCH = 16;
+const auto PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+struct CheckedObject
+{
+    std::string type; // Empty if the object could not be read
+    size_t size = 0;
+    uint64_t stored_bytes = 0;
+    std::vector<ObjectRef> references;
+    std::vector<size_t> chunk_sizes; // Listed sizes, for chunk lists
+    std::string problem;
+};
+
+bool is_object_id(const std::string &text)
+{
+    return text.size() == 40 && is_hex_string(text);
+}
+
+// Syntax only: whether what it names exists is checked once every object is
+// known.
+std::string check_tree(const std::string &content)
+{
+    std::istringstream stream(content);
+    std::string line;
+    std::string previous;
+    while (std::getline(stream, line))
+    {
+        std::size_t first_space = line.find(' ');
+        std::size_t last_space = line.rfind(' ');
+        if (first_space == std::string::npos || first_space == last_space)
+        {
+            return "malformed tree entry \"" + line + "\"";
+        }
+        std::string mode = line.substr(0, first_space);
+        std::string path = line.substr(first_space + 1, last_space - first_space - 1);
+        if (mode != "100644" && mode != "040000")
+        {
+            return "tree entry " + path + " has unknown mode " + mode;
+        }
+        if (!is_object_id(line.substr(last_space + 1)))
+        {
+            return "tree entry " + path + " has an invalid object ID";
+        }
+        if (!previous.empty() && path <= previous)
+        {
+            return "tree entries are not sorted at " + path;
+        }
+        previous = path;
+    }
+    return previous.empty() ? "empty tree" : "";
+}
+
+std::string check_commit(const std::string &content)
+{
+    Commit commit;
+    if (content.find("\n\n") == std::string::npos || !Commit::parse(content, commit))
+    {
+        return "malformed commit";
+    }
+    if (!is_object_id(commit.tree_sha))
+    {
+        return "commit has an invalid tree ID";
+    }
+    for (const auto &parent : commit.parents)
+    {
+        if (!is_object_id(parent))
+        {
+            return "commit has an invalid parent ID";
+        }
+    }
+    if (commit.author.empty() || commit.committer.empty())
+    {
+        return "commit has no author or committer";
+    }
+    return "";
+}
+
+void check_object(const Repository &repo, const std::string &sha, CheckedObject &checked)
+{
+    struct stat info;
+    if (stat(repo.object_path(sha).c_str(), &info) == 0)
+    {
+        checked.stored_bytes = info.st_size;
+    }
+
+    Object object;
+    Status status = repo.read_object(sha, object);
+    if (!status.ok())
+    {
+        // "Error: Object <sha> could not be decompressed." and the like
+        std::string message = status.message;
+        std::size_t named = message.find(sha);
+        if (named != std::string::npos && named + sha.size() < message.size())
+        {
+            message = message.substr(named + sha.size() + 1);
+        }
+        checked.problem = !message.empty() && message.back() == '.' ? message.substr(0, message.size() - 1) : message;
+        return;
+    }
+
+    Sha1Stream hasher;
+    hasher.update(object_header(object.type, object.content.size()));
+    hasher.update(object.content);
+    if (hasher.hex_digest() != sha)
+    {
+        checked.problem = "content hashes to a different ID";
+        return;
+    }
+
+    checked.type = object.type;
+    checked.size = object.content.size();
+    std::vector<ChunkRef> chunks;
+    if (object.type == "tree")
+    {
+        checked.problem = check_tree(object.content);
+    }
+    else if (object.type == "commit")
+    {
+        checked.problem = check_commit(object.content);
+    }
+    else if (object.type == "chunks" && (!parse_chunk_list(object.content, chunks) || chunks.empty()))
+    {
+        checked.problem = "malformed chunk list";
+    }
+    if (checked.problem.empty() && object.type != "blob")
+    {
+        checked.references = referenced_objects(object.type, object.content);
+    }
+    for (const auto &chunk : chunks)
+    {
+        checked.chunk_sizes.push_back(chunk.size);
+    }
+}
+
+bool type_matches(const std::string &expected, const std::string &actual)
+{
+    // A file's entry may name either a blob or a chunk list
+    return expected == actual || (expected == "blob" && actual == "chunks");
+}
+} // namespace
+
+Status check_repository(const Repository &repo, FsckReport &report, const FsckProgress &progress)
+{
+    report = FsckReport();
+    std::vector<std::string> shas;
+    Status status = repo.list_objects(shas);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    // Workers read through a repository of their own, since the caller's
+    // caches are not thread-safe
+    Repository reader;
+    status = Repository::open(repo.root(), reader);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    std::vector<CheckedObject> checked(shas.size());
+    std::atomic<size_t> next_object{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t running = std::max(1u, std::thread::hardware_concurrency());
+
+    auto worker = [&] {
+        for (size_t start; (start = next_object.fetch_add(CLAIM_BATCH)) < shas.size();)
+        {
+            size_t end = std::min(shas.size(), start + CLAIM_BATCH);
+            for (size_t i = start; i < end; ++i)
+            {
+                check_object(reader, shas[i], checked[i]);
+            }
+            done += end - start;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        finished.notify_all();
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0, count = running; i < count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!finished.wait_for(lock, PROGRESS_INTERVAL, [&] { return running == 0; }))
+        {
+            if (progress)
+            {
+                progress(done, shas.size());
+            }
+        }
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    if (progress)
+    {
+        progress(shas.size(), shas.size());
+    }
+
+    // Connectivity, now that every object's type is known
+    std::unordered_map<std::string, const CheckedObject *> by_sha;
+    for (size_t i = 0; i < shas.size(); ++i)
+    {
+        by_sha.emplace(shas[i], &checked[i]);
+    }
+    auto expect = [&](const std::string &owner, const ObjectRef &ref, const std::string &what) {
+        auto it = by_sha.find(ref.sha);
+        if (it == by_sha.end())
+        {
+            report.problems.push_back({owner, what + " " + ref.sha + " is missing"});
+        }
+        else if (!it->second->type.empty() && !type_matches(ref.type, it->second->type))
+        {
+            report.problems.push_back({owner, what + " " + ref.sha + " is a " + it->second->type + ", not a " +
+                                                  ref.type});
+        }
+    };
+
+    report.objects = shas.size();
+    for (size_t i = 0; i < shas.size(); ++i)
+    {
+        const CheckedObject &object = checked[i];
+        report.bytes += object.stored_bytes;
+        report.blobs += object.type == "blob";
+        report.trees += object.type == "tree";
+        report.commits += object.type == "commit";
+        report.chunk_lists += object.type == "chunks";
+        if (!object.problem.empty())
+        {
+            report.problems.push_back({shas[i], object.problem});
+        }
+        for (size_t j = 0; j < object.references.size(); ++j)
+        {
+            const ObjectRef &ref = object.references[j];
+            expect(shas[i], ref, "referenced " + ref.type);
+            auto chunk = by_sha.find(ref.sha);
+            if (j < object.chunk_sizes.size() && chunk != by_sha.end() && chunk->second->type == "blob" &&
+                chunk->second->size != object.chunk_sizes[j])
+            {
+                report.problems.push_back({shas[i], "chunk " + ref.sha + " is not the listed size"});
+            }
+        }
+    }
+
+    // The checksum catches damage that still decodes
+    RefTable table;
+    if (RefTable::open(repo.ref_table_path(), table).ok() && !table.verify())
+    {
+        report.problems.push_back({"reftable", "checksum does not match"});
+    }
+
+    std::map<std::string, std::string> refs;
+    std::vector<TreeEntry> index_entries;
+    status = repo.list_refs(refs);
+    if (status.ok())
+    {
+        status = repo.read_all_indexes(index_entries);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    for (const auto &[name, sha] : refs)
+    {
+        expect(name, {sha, "commit"}, "commit");
+    }
+    for (const auto &entry : index_entries)
+    {
+        expect("index " + entry.name, {entry.sha, "blob"}, "blob");
+    }
+
+    std::stable_sort(report.problems.begin(), report.problems.end(),
+                     [](const FsckProblem &a, const FsckProblem &b) { return a.sha < b.sha; });
+    return {};
+}
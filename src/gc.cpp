@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headers/gc.h"
+#include "headers/merge.h"
+#include "headers/utils.h"
+#include "headers/worktree.h"
+
+namespace
+{
+const size_t MAX_MARK_THREADS = 8;
+const size_t VISITED_SHARDS = 64;
+// Temp files belong to a writer that may still be running, whatever the
+// grace period.
+const std::chrono::seconds TEMP_FILE_GRACE = std::chrono::hours(1);
+
+typedef std::chrono::system_clock Clock;
+
+struct LooseObject
+{
+    uint64_t size = 0;
+    Clock::time_point mtime;
+};
+
+bool stat_file(const fs::path &path, uint64_t &size, Clock::time_point &mtime)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return false;
+    }
+    size = info.st_size;
+    mtime = Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::seconds(info.st_mtim.tv_sec) + std::chrono::nanoseconds(info.st_mtim.tv_nsec)));
+    return true;
+}
+
+Status list_loose_objects(const Repository &repo, std::unordered_map<std::string, LooseObject> &objects,
+                          std::vector<fs::path> &temp_files)
+{
+    std::vector<std::string> shas;
+    Status status = repo.list_objects(shas);
+    for (const auto &sha : shas)
+    {
+        LooseObject loose;
+        if (stat_file(repo.object_path(sha), loose.size, loose.mtime))
+        {
+            objects.emplace(sha, loose);
+        }
+    }
+
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(repo.common_dir() / "objects", ec))
+    {
+        if (entry.path().filename().string().rfind("tmp_obj_", 0) == 0)
+        {
+            temp_files.push_back(entry.path());
+        }
+    }
+    return status;
+}
+
+// Entries of the worktree file cache, named like loose objects
+void list_file_cache(const Repository &repo, std::unordered_map<std::string, LooseObject> &entries,
+                     std::vector<fs::path> &temp_files)
+{
+    std::error_code ec;
+    for (const auto &directory : fs::directory_iterator(file_cache_dir(repo), ec))
+    {
+        std::string prefix = directory.path().filename().string();
+        std::error_code entry_ec;
+        for (const auto &entry : fs::directory_iterator(directory.path(), entry_ec))
+        {
+            std::string name = entry.path().filename().string();
+            LooseObject loose;
+            if (name.rfind("tmp_", 0) == 0)
+            {
+                temp_files.push_back(entry.path());
+            }
+            else if (stat_file(entry.path(), loose.size, loose.mtime))
+            {
+                entries.emplace(prefix + name, loose);
+            }
+        }
+    }
+}
+
+// Objects waiting to be read, shared by the marking threads. An object is
+// added to `visited` when first queued, so no two threads read it. The walk
+// is over when the queue is empty and no thread is still reading.
+struct MarkState
+{
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<ObjectRef> pending;
+    size_t busy = 0;
+    Status error;
+
+    std::mutex shard_mutexes[VISITED_SHARDS];
+    std::unordered_set<std::string> visited[VISITED_SHARDS];
+
+    // True if `sha` was not visited before
+    bool visit(const std::string &sha)
+    {
+        size_t shard = std::hash<std::string>()(sha) % VISITED_SHARDS;
+        std::lock_guard<std::mutex> lock(shard_mutexes[shard]);
+        return visited[shard].insert(sha).second;
+    }
+};
+
+// Blobs only need their header read, to tell them from chunk lists
+Status mark_object(const Repository &repo, const ObjectRef &ref, std::vector<ObjectRef> &found)
+{
+    if (ref.type == "blob")
+    {
+        std::string type;
+        size_t size = 0;
+        Status status = repo.read_object_header(ref.sha, type, size);
+        if (!status.ok() || type != "chunks")
+        {
+            return status;
+        }
+    }
+
+    Object object;
+    Status status = repo.read_object(ref.sha, object);
+    if (status.ok())
+    {
+        found = referenced_objects(object.type, object.content);
+    }
+    return status;
+}
+
+void mark_worker(const Repository &repo, MarkState &state)
+{
+    std::vector<ObjectRef> found;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true)
+    {
+        state.wakeup.wait(lock, [&] { return !state.pending.empty() || state.busy == 0; });
+        if (state.pending.empty() || !state.error.ok())
+        {
+            state.wakeup.notify_all();
+            return;
+        }
+
+        ObjectRef current = std::move(state.pending.front());
+        state.pending.pop_front();
+        ++state.busy;
+        lock.unlock();
+
+        found.clear();
+        Status status = mark_object(repo, current, found);
+        if (status.code == ErrorCode::NotFound)
+        {
+            status = Status::error(ErrorCode::Corrupt, "Error: Reachable object " + current.sha +
+                                                           " is missing; not pruning anything.");
+        }
+        auto unseen = std::partition(found.begin(), found.end(), [&](const ObjectRef &ref) {
+            return state.visit(ref.sha);
+        });
+
+        lock.lock();
+        --state.busy;
+        std::move(found.begin(), unseen, std::back_inserter(state.pending));
+        if (!status.ok() && state.error.ok())
+        {
+            state.error = status;
+        }
+        state.wakeup.notify_all();
+    }
+}
+} // namespace
+
+Status collect_garbage(const Repository &repo, const GcOptions &options, GcReport &report)
+{
+    report = GcReport();
+    Clock::time_point start = Clock::now();
+
+    // List first: whatever is written from here on is not a candidate
+    std::unordered_map<std::string, LooseObject> objects;
+    std::vector<fs::path> temp_files;
+    std::unordered_map<std::string, LooseObject> cache_entries;
+    Status status = list_loose_objects(repo, objects, temp_files);
+    if (!status.ok())
+    {
+        return status;
+    }
+    list_file_cache(repo, cache_entries, temp_files);
+    report.loose_objects = objects.size();
+
+    std::map<std::string, std::string> refs;
+    std::vector<TreeEntry> index_entries;
+    status = repo.list_refs(refs);
+    if (status.ok())
+    {
+        status = repo.read_all_indexes(index_entries);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    std::vector<ObjectRef> roots;
+    for (const auto &[name, sha] : refs)
+    {
+        roots.push_back({sha, "commit"});
+    }
+    for (const auto &entry : index_entries)
+    {
+        roots.push_back({entry.sha, entry.mode == "040000" ? "tree" : "blob"});
+    }
+    std::vector<MergeState> merges;
+    read_all_merge_states(repo, merges);
+    for (const auto &merge : merges)
+    {
+        roots.push_back({merge.their_sha, "commit"});
+        roots.push_back({merge.tree_sha, "tree"});
+    }
+
+    // The marking threads read through a repository of their own, since the
+    // caller's caches are not thread-safe
+    Repository reader;
+    status = Repository::open(repo.root(), reader);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    MarkState state;
+    for (auto &root : roots)
+    {
+        if (state.visit(root.sha))
+        {
+            state.pending.push_back(std::move(root));
+        }
+    }
+    size_t thread_count = std::min<size_t>(MAX_MARK_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back(mark_worker, std::cref(reader), std::ref(state));
+    }
+    mark_worker(reader, state);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    report.mark_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (!state.error.ok())
+    {
+        return state.error;
+    }
+
+    Clock::time_point cutoff = start - options.grace;
+    for (const auto &[sha, object] : objects)
+    {
+        size_t shard = std::hash<std::string>()(sha) % VISITED_SHARDS;
+        if (state.visited[shard].count(sha))
+        {
+            ++report.reachable;
+            continue;
+        }
+        ++report.unreachable;
+        report.unreachable_bytes += object.size;
+
+        // Stat again: a writer may have freshened it since it was listed
+        LooseObject current;
+        fs::path path = repo.object_path(sha);
+        if (!stat_file(path, current.size, current.mtime) || current.mtime >= cutoff)
+        {
+            ++report.kept_recent;
+            continue;
+        }
+        if (options.prune && unlink(path.c_str()) == 0)
+        {
+            ++report.pruned;
+            report.bytes_reclaimed += current.size;
+        }
+    }
+
+    // Cached files go with their blob; worktrees that link them keep their
+    // own link
+    for (const auto &[sha, entry] : cache_entries)
+    {
+        size_t shard = std::hash<std::string>()(sha) % VISITED_SHARDS;
+        fs::path path = file_cache_dir(repo) / sha.substr(0, 2) / sha.substr(2);
+        if (!state.visited[shard].count(sha) && entry.mtime < cutoff && options.prune &&
+            unlink(path.c_str()) == 0)
+        {
+            ++report.cache_files_pruned;
+            report.bytes_reclaimed += entry.size;
+        }
+    }
+
+    Clock::time_point temp_cutoff = start - std::max(options.grace, TEMP_FILE_GRACE);
+    for (const auto &path : temp_files)
+    {
+        LooseObject temp;
+        if (options.prune && stat_file(path, temp.size, temp.mtime) && temp.mtime < temp_cutoff &&
+            unlink(path.c_str()) == 0)
+        {
+            ++report.temp_files_removed;
+            report.bytes_reclaimed += temp.size;
+        }
+    }
+    return {};
+}
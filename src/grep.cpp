@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <regex.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "headers/grep.h"
+
+namespace
+{
+// Like git, a NUL byte this close to the start marks a file as binary
+const size_t BINARY_CHECK_BYTES = 8000;
+const size_t MAX_GREP_THREADS = 16;
+
+const char *line_start(const char *data, const char *at)
+{
+    while (at > data && at[-1] != '\n')
+    {
+        --at;
+    }
+    return at;
+}
+
+const char *line_end(const char *at, const char *end)
+{
+    const char *newline = static_cast<const char *>(std::memchr(at, '\n', end - at));
+    return newline ? newline : end;
+}
+
+class LiteralMatcher : public LineMatcher
+{
+public:
+    explicit LiteralMatcher(std::string needle) : needle_(std::move(needle)) {}
+
+    void search(const char *data, size_t size,
+                const std::function<void(const char *line, size_t length)> &found) const override
+    {
+        const char *end = data + size;
+        for (const char *at = data; at < end;)
+        {
+            size_t hit = find_literal(at, end - at, needle_);
+            if (hit == static_cast<size_t>(end - at))
+            {
+                return;
+            }
+            const char *start = line_start(data, at + hit);
+            const char *stop = line_end(at + hit, end);
+            found(start, stop - start);
+            if (stop == end)
+            {
+                return;
+            }
+            at = stop + 1;
+        }
+    }
+
+private:
+    std::string needle_;
+};
+
+class RegexMatcher : public LineMatcher
+{
+public:
+    RegexMatcher(regex_t regex, std::string required) : regex_(regex), required_(std::move(required)) {}
+    ~RegexMatcher() override { regfree(&regex_); }
+
+    void search(const char *data, size_t size,
+                const std::function<void(const char *line, size_t length)> &found) const override
+    {
+        const char *end = data + size;
+        for (const char *at = data; at < end;)
+        {
+            const char *start = at;
+            if (!required_.empty())
+            {
+                // Only lines holding the required literal can match
+                size_t hit = find_literal(at, end - at, required_);
+                if (hit == static_cast<size_t>(end - at))
+                {
+                    return;
+                }
+                start = line_start(data, at + hit);
+            }
+            const char *stop = line_end(start, end);
+            if (matches(start, stop - start))
+            {
+                found(start, stop - start);
+            }
+            if (stop == end)
+            {
+                return;
+            }
+            at = stop + 1;
+        }
+    }
+
+private:
+    bool matches(const char *line, size_t length) const
+    {
+        // REG_STARTEND bounds the match without a NUL-terminated copy
+        regmatch_t bounds[1];
+        bounds[0].rm_so = 0;
+        bounds[0].rm_eo = length;
+        return regexec(&regex_, line, 1, bounds, REG_STARTEND) == 0;
+    }
+
+    regex_t regex_;
+    std::string required_;
+};
+
+// The longest run of plain characters every match must contain, or "" if
+// that is not obvious. Alternation and groups could make any run optional,
+// so patterns with them get no prefilter.
+std::string required_literal(const std::string &pattern)
+{
+    if (pattern.find_first_of("|()") != std::string::npos)
+    {
+        return "";
+    }
+    std::string best, run;
+    auto end_run = [&] {
+        if (run.size() > best.size())
+        {
+            best = run;
+        }
+        run.clear();
+    };
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size() && !std::strchr(".[]\\*+?{}^$", pattern[i + 1]))
+        {
+            // \w, \b, \< and friends are classes or anchors, not letters
+            end_run();
+            ++i;
+            continue;
+        }
+        if (c == '\\' && i + 1 < pattern.size())
+        {
+            c = pattern[++i];
+        }
+        else if (std::strchr(".[]\\*+?{}^$", c))
+        {
+            end_run();
+            if (c == '[')
+            {
+                // Skip the bracket expression, where a leading ']' is literal
+                size_t first = pattern.compare(i + 1, 1, "^") == 0 ? i + 2 : i + 1;
+                size_t close = pattern.find(']', first + 1);
+                i = close == std::string::npos ? pattern.size() : close;
+            }
+            continue;
+        }
+
+        // A character made optional by what follows it is not required
+        char next = i + 1 < pattern.size() ? pattern[i + 1] : '\0';
+        if (next == '*' || next == '?' || next == '{')
+        {
+            end_run();
+            continue;
+        }
+        run += c;
+        if (next == '+')
+        {
+            end_run();
+        }
+    }
+    end_run();
+    return best;
+}
+
+std::string escape_regex(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (std::strchr(".[]\\*+?{}()|^$", c))
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Feeds a file's content piece by piece (chunked files arrive a chunk at a
+// time) and searches whole lines, carrying a partial last line over to the
+// next piece.
+class FileSearcher
+{
+public:
+    FileSearcher(const LineMatcher &matcher, const std::string &path, std::vector<GrepMatch> &matches)
+        : matcher_(matcher), path_(path), matches_(matches)
+    {
+    }
+
+    bool binary() const { return binary_; }
+
+    // Returns false once the file turns out to be binary
+    bool feed(const std::string &piece)
+    {
+        if (checked_bytes_ < BINARY_CHECK_BYTES)
+        {
+            size_t check = std::min(piece.size(), BINARY_CHECK_BYTES - checked_bytes_);
+            if (std::memchr(piece.data(), '\0', check))
+            {
+                binary_ = true;
+                return false;
+            }
+            checked_bytes_ += check;
+        }
+
+        const std::string *data = &piece;
+        if (!carry_.empty())
+        {
+            carry_ += piece;
+            data = &carry_;
+        }
+        size_t last_newline = data->rfind('\n');
+        size_t complete = last_newline == std::string::npos ? 0 : last_newline + 1;
+        search(data->data(), complete);
+        std::string rest = data->substr(complete);
+        carry_ = std::move(rest);
+        return true;
+    }
+
+    void finish()
+    {
+        search(carry_.data(), carry_.size());
+        carry_.clear();
+    }
+
+private:
+    void search(const char *data, size_t size)
+    {
+        const char *counted = data;
+        matcher_.search(data, size, [&](const char *line, size_t length) {
+            line_number_ += std::count(counted, line, '\n');
+            counted = line;
+            matches_.push_back({path_, line_number_ + 1, std::string(line, length)});
+        });
+        line_number_ += std::count(counted, data + size, '\n');
+    }
+
+    const LineMatcher &matcher_;
+    const std::string &path_;
+    std::vector<GrepMatch> &matches_;
+    std::string carry_;
+    size_t line_number_ = 0; // Newlines before the current piece
+    size_t checked_bytes_ = 0;
+    bool binary_ = false;
+};
+} // namespace
+
+size_t find_literal(const char *haystack, size_t size, const std::string &needle)
+{
+    size_t length = needle.size();
+    if (length == 0)
+    {
+        return 0;
+    }
+    if (length > size)
+    {
+        return size;
+    }
+
+    size_t i = 0;
+#ifdef __SSE2__
+    // Candidates are positions where both the first and the last byte of the
+    // needle line up; only those are compared in full
+    const __m128i first = _mm_set1_epi8(needle.front());
+    const __m128i last = _mm_set1_epi8(needle.back());
+    for (; i + length - 1 + 16 <= size; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + length - 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask)
+        {
+            unsigned bit = __builtin_ctz(mask);
+            if (length <= 2 || std::memcmp(haystack + i + bit + 1, needle.data() + 1, length - 2) == 0)
+            {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i + length <= size; ++i)
+    {
+        if (haystack[i] == needle.front() && std::memcmp(haystack + i, needle.data(), length) == 0)
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+Status LineMatcher::create(const std::string &pattern, bool fixed_string, bool ignore_case,
+                           std::unique_ptr<LineMatcher> &matcher)
+{
+    if (pattern.empty())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Empty search pattern.");
+    }
+    if (fixed_string && !ignore_case)
+    {
+        matcher = std::make_unique<LiteralMatcher>(pattern);
+        return {};
+    }
+
+    std::string expression = fixed_string ? escape_regex(pattern) : pattern;
+    regex_t regex;
+    int flags = REG_EXTENDED | REG_NOSUB | REG_NEWLINE | (ignore_case ? REG_ICASE : 0);
+    int error = regcomp(&regex, expression.c_str(), flags);
+    if (error != 0)
+    {
+        char message[256];
+        regerror(error, &regex, message, sizeof(message));
+        regfree(&regex);
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid pattern: " + std::string(message));
+    }
+    matcher = std::make_unique<RegexMatcher>(regex, ignore_case ? "" : required_literal(expression));
+    return {};
+}
+
+Status grep_commit(const Repository &repo, const std::string &commit_sha, const GrepOptions &options,
+                   const std::function<void(const GrepMatch &match)> &found)
+{
+    std::unique_ptr<LineMatcher> matcher;
+    Status status = LineMatcher::create(options.pattern, options.fixed_string, options.ignore_case, matcher);
+    Commit commit;
+    if (status.ok())
+    {
+        status = repo.read_commit(commit_sha, commit);
+    }
+    std::map<std::string, TreeEntry> tree_entries;
+    if (status.ok())
+    {
+        status = repo.read_tree_recursive(commit.tree_sha, tree_entries);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    std::vector<const TreeEntry *> files;
+    for (const auto &[path, entry] : tree_entries)
+    {
+        if (entry.mode == "100644")
+        {
+            files.push_back(&entry);
+        }
+    }
+
+    // Workers read through a repository of their own, since the caller's
+    // caches are not thread-safe
+    Repository reader;
+    status = Repository::open(repo.root(), reader);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    // Files are searched in any order but reported in path order: file i is
+    // handed on once it and every file before it is done
+    struct FileResult
+    {
+        bool done = false;
+        Status status;
+        std::vector<GrepMatch> matches;
+    };
+    std::vector<FileResult> results(files.size());
+    std::atomic<size_t> next_file{0};
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    std::condition_variable file_done;
+
+    auto worker = [&] {
+        for (size_t i; !stop && (i = next_file++) < files.size();)
+        {
+            const TreeEntry &entry = *files[i];
+            std::vector<GrepMatch> matches;
+            FileSearcher searcher(*matcher, entry.name, matches);
+            Status searched = reader.stream_blob(entry.sha, [&searcher](const std::string &data) {
+                return searcher.feed(data) ? Status() : Status::error(ErrorCode::InvalidArgument, "binary");
+            });
+            if (searcher.binary())
+            {
+                searched = Status();
+                matches.clear();
+            }
+            else if (searched.ok())
+            {
+                searcher.finish();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i].done = true;
+            results[i].status = std::move(searched);
+            results[i].matches = std::move(matches);
+            file_done.notify_all();
+        }
+    };
+
+    size_t thread_count = std::min<size_t>(MAX_GREP_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    for (size_t i = 0; i < files.size() && status.ok(); ++i)
+    {
+        std::vector<GrepMatch> matches;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            file_done.wait(lock, [&] { return results[i].done; });
+            status = results[i].status;
+            matches = std::move(results[i].matches);
+        }
+        for (const auto &match : matches)
+        {
+            found(match);
+        }
+    }
+    stop = true;
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    return status;
+}
@@ -0,0 +1,37 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include "repository.h"
+
+// Streams a commit's tree as a POSIX (ustar) tar archive, reading each file
+// straight from the object store; nothing is written to the working tree.
+// Every entry carries the commit's time, so the same commit always gives
+// the same archive. Paths that do not fit ustar's name fields get a pax
+// extended header.
+//
+// tar.gz output is one gzip member compressed on one thread per core,
+// pigz-style: the tar stream is cut into blocks, each block is deflated
+// with the previous block's last 32 KB as its dictionary and ends on a
+// sync flush, so the pieces concatenate into a single deflate stream. A
+// bounded number of blocks is in flight at once.
+enum class ArchiveFormat
+{
+    Tar,
+    TarGz,
+};
+
+struct ArchiveStats
+{
+    size_t files = 0;
+    size_t directories = 0;
+    uint64_t tar_bytes = 0;
+    uint64_t output_bytes = 0;
+};
+
+Status write_archive(const Repository &repo, const std::string &commit_sha, ArchiveFormat format, std::ostream &out,
+                     ArchiveStats *stats = nullptr);
+
+#endif // ARCHIVE_H
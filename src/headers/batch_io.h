@@ -0,0 +1,41 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Reads a whole file into `data`. `error` is an errno value, 0 on success.
+struct FileRead
+{
+    fs::path path;
+    std::string data;
+    int error = 0;
+};
+
+// Creates or truncates `path` and writes `data` to it.
+struct FileWrite
+{
+    fs::path path;
+    std::string data;
+    int error = 0;
+};
+
+// Whole-file I/O on many files at once. Each request succeeds or fails on
+// its own; a batch never stops at the first error.
+class BatchIO
+{
+public:
+    virtual ~BatchIO() = default;
+
+    virtual const char *name() const = 0;
+    virtual void read_files(std::vector<FileRead> &requests) = 0;
+    virtual void write_files(std::vector<FileWrite> &requests) = 0;
+
+    // io_uring when the kernel offers it, otherwise one blocking syscall per
+    // step. MYGIT_IO=blocking forces the fallback.
+    static std::unique_ptr<BatchIO> create();
+};
+
+#endif // BATCH_IO_H
@@ -0,0 +1,33 @@
+#ifndef BLAME_H
+#define BLAME_H
+
+#include <string>
+#include <vector>
+#include "repository.h"
+
+struct BlameLine
+{
+    std::string commit_sha; // The commit that introduced the line
+    size_t line_number = 0; // 1-based, in that commit's version of the file
+    std::string text;       // Without its newline
+};
+
+struct BlameStats
+{
+    size_t commits_visited = 0;
+    size_t commits_skipped = 0; // Same blob as the child: lines passed on without a diff
+    size_t diffs = 0;
+    size_t trees_read = 0;
+};
+
+// Finds the commit that introduced each line of `path` as of `commit_sha`.
+// History is walked newest first, each commit holding the lines not yet
+// attributed. A commit hands lines to a parent whose version of the file
+// has them unchanged and keeps the rest. The parent's blob is found by
+// following only the trees on the path, stopping at the first tree whose ID
+// matches the child's. If the blob ID is also the same, all the lines pass
+// on without a diff. The walk stops once every line is attributed.
+Status blame_file(const Repository &repo, const std::string &commit_sha, const std::string &path,
+                  std::vector<BlameLine> &lines, BlameStats *stats = nullptr);
+
+#endif // BLAME_H
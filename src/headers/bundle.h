@@ -0,0 +1,33 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "repository.h"
+
+// A bundle is a single streamable file carrying refs plus every object
+// reachable from them that the receiving side is not already assumed to have:
+//
+//   # mygit bundle v1
+//   -<sha>                  prerequisite commit (zero or more)
+//   <sha> <refname>         every branch and tag whose commit is bundled
+//   <blank line>
+//   <sha> <length>\n<raw object bytes>     repeated per object
+//   end <object count>
+//   <sha1 of everything above>
+//
+// Raw object bytes are copied exactly as stored in .mygit/objects, so
+// neither side has to recompress anything.
+struct UnbundleResult
+{
+    size_t object_count = 0;
+    std::vector<std::pair<std::string, std::string>> updated_refs; // (refname, sha)
+    std::vector<std::pair<std::string, std::string>> rejected_refs; // not fast-forwards
+};
+
+Status create_bundle(const Repository &repo, const fs::path &bundle_file, const std::string &since_commit,
+                     size_t &object_count);
+Status unbundle(Repository &repo, const fs::path &bundle_file, UnbundleResult &result);
+
+#endif // BUNDLE_H
@@ -0,0 +1,37 @@
+#ifndef CHUNKING_H
+#define CHUNKING_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Content-defined chunking (FastCDC): cut points come from a Gear rolling
+// hash over the bytes themselves, so an insert or edit only moves the
+// boundaries next to it and the chunks around it keep their IDs.
+struct ChunkingParams
+{
+    size_t min_size = 16 * 1024;
+    size_t average_size = 64 * 1024;
+    size_t max_size = 256 * 1024;
+};
+
+// Length of the chunk starting at `data`, given `size` bytes of it. `size`
+// must be at least `max_size` unless this is the end of the input.
+size_t next_chunk_boundary(const unsigned char *data, size_t size, const ChunkingParams &params);
+
+// Reads `path` in bounded memory and calls `emit` with each chunk in order.
+Status split_file_into_chunks(const fs::path &path, const ChunkingParams &params,
+                              const std::function<Status(std::string chunk)> &emit);
+
+// A "chunks" object stands in for a large file's blob: one "<sha> <size>"
+// line per chunk, each chunk stored as a blob.
+struct ChunkRef
+{
+    std::string sha;
+    size_t size = 0;
+};
+
+bool parse_chunk_list(const std::string &content, std::vector<ChunkRef> &chunks);
+
+#endif // CHUNKING_H
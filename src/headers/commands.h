@@ -0,0 +1,20 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Repository;
+
+// Runs one CLI command (args[0] is the command name) against the repository
+// in the current directory, writing to the given streams instead of the
+// process's standard ones. Returns the process exit code.
+int run_command(const std::vector<std::string> &args, std::istream &in, std::ostream &out, std::ostream &err);
+
+// Same, against an already open repository whose caches stay warm between
+// calls.
+int run_command(Repository &repo, const std::vector<std::string> &args, std::istream &in, std::ostream &out,
+                std::ostream &err);
+
+#endif // COMMANDS_H
@@ -0,0 +1,53 @@
+#ifndef COMMIT_ORDER_H
+#define COMMIT_ORDER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Whether `ancestor_sha` is reachable from `descendant`'s parents through
+// commits made no earlier than `since` (seconds since the epoch). Parents
+// are not newer than their children, so this settles ancestry between
+// commits made in the same second without walking older history.
+bool reaches_since(const Repository &repo, const Commit &descendant, const std::string &ancestor_sha,
+                   int64_t since);
+
+// The entry of `pending` (by commit sha) that newest-first history shows
+// next: the latest commit time, and of commits made in the same second, one
+// that none of the others descends from. `commit_of` maps an entry's value
+// to its Commit.
+template <typename Value, typename CommitOf>
+typename std::map<std::string, Value>::iterator newest_pending(const Repository &repo,
+                                                               std::map<std::string, Value> &pending,
+                                                               CommitOf commit_of)
+{
+    auto newest = pending.end();
+    int64_t newest_time = 0;
+    std::vector<typename std::map<std::string, Value>::iterator> ties;
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+    {
+        int64_t time = commit_of(it->second).time();
+        if (newest == pending.end() || time > newest_time)
+        {
+            newest = it;
+            newest_time = time;
+            ties.clear();
+        }
+        else if (time == newest_time)
+        {
+            ties.push_back(it);
+        }
+    }
+    // A child goes before its parent, however the shas sort
+    for (auto tie : ties)
+    {
+        if (reaches_since(repo, commit_of(tie->second), newest->first, newest_time))
+        {
+            newest = tie;
+        }
+    }
+    return newest;
+}
+
+#endif // COMMIT_ORDER_H
@@ -0,0 +1,21 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// An optional per-repository background process that keeps one Repository
+// open with its caches enabled, watches the working tree with inotify so the
+// caches stay truthful, and runs CLI commands sent to .mygit/daemon.sock,
+// one thread per connection.
+Status start_daemon(const Repository &repo, int &pid);
+
+// Runs `args` in the daemon serving the repository at `root`, relaying stdin
+// (for commands that read it) and copying the command's output to `out` and
+// `err`. Returns false, having done nothing, if no daemon is listening.
+bool run_via_daemon(const fs::path &root, const std::vector<std::string> &args, std::ostream &out,
+                    std::ostream &err, int &exit_code);
+
+#endif // DAEMON_H
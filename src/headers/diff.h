@@ -0,0 +1,105 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "repository.h"
+
+// File-level differences between two trees, with rename and copy detection.
+struct TreeChange
+{
+    char status = 'M'; // A, D, M, R (renamed) or C (copied)
+    std::string old_path; // Empty for A
+    std::string new_path; // Empty for D
+    std::string old_mode;
+    std::string new_mode;
+    std::string old_sha;
+    std::string new_sha;
+    int similarity = 0; // Percent, for R and C
+};
+
+// Renames (and, with `detect_copies`, copies) are paired in two passes.
+// Added files are first matched to deleted ones with the same blob ID.
+// What is left is scored by estimated similarity, and pairs at or above
+// `threshold` percent are taken best first. Each deleted file is renamed at
+// most once. Copy sources are deleted files and the old versions of
+// modified files, and may be used any number of times.
+struct RenameOptions
+{
+    bool detect_renames = true;
+    bool detect_copies = false;
+    int threshold = 50;
+};
+
+struct RenameStats
+{
+    size_t exact = 0;
+    size_t inexact = 0;
+    size_t copies = 0;
+    size_t sources = 0;    // Files sketched as possible sources
+    size_t targets = 0;    // Added files sketched
+    size_t candidates = 0; // Pairs scored
+};
+
+// Estimates how alike two files are without comparing them. A file is cut
+// into chunks at newlines (and every 64 bytes within longer lines), and
+// each distinct chunk is hashed once. The hash picks one of SLOTS buckets,
+// and each bucket keeps the smallest hash it saw (one-permutation MinHash).
+// Empty buckets borrow from the next filled one. The fraction of slots two
+// sketches agree on estimates the Jaccard similarity of their chunk sets,
+// to within about 6 points.
+class SimilaritySketch
+{
+public:
+    static const size_t SLOTS = 64;
+
+    static SimilaritySketch of(const std::string &data);
+
+    // 0 to 100
+    int similarity(const SimilaritySketch &other) const;
+    size_t size() const { return size_; }
+    bool empty() const { return chunks_ == 0; }
+    const std::array<uint64_t, SLOTS> &slots() const { return slots_; }
+
+private:
+    std::array<uint64_t, SLOTS> slots_{};
+    size_t size_ = 0;
+    size_t chunks_ = 0;
+};
+
+// Directories whose tree IDs match on both sides are skipped without being
+// read. Changes come out in path order, without rename detection.
+Status diff_trees(const Repository &repo, const std::string &old_tree_sha, const std::string &new_tree_sha,
+                  std::vector<TreeChange> &changes);
+
+// Rewrites matching A and D changes into R and C changes
+Status detect_renames(const Repository &repo, const RenameOptions &options, std::vector<TreeChange> &changes,
+                      RenameStats *stats = nullptr);
+
+// A run of old lines [old_start, old_end) replaced by new lines
+// [new_start, new_end)
+struct LineHunk
+{
+    size_t old_start;
+    size_t old_end;
+    size_t new_start;
+    size_t new_end;
+};
+
+// Lines end after each '\n'; a last line without one is kept
+std::vector<std::string_view> split_lines(const std::string &text);
+
+// Line diffs in the fewest hunks of changed lines (Myers). Past 2048
+// differing lines the whole changed region becomes one hunk. The _ids form
+// compares lines already mapped to IDs, equal lines sharing one.
+std::vector<LineHunk> diff_lines(const std::vector<std::string_view> &a, const std::vector<std::string_view> &b);
+std::vector<LineHunk> diff_line_ids(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b);
+
+// diff.renames (true, false or copies) and diff.renameThreshold (percent)
+// from the repository's config
+Status rename_options_from_config(const Repository &repo, RenameOptions &options);
+
+#endif // DIFF_H
@@ -0,0 +1,34 @@
+#ifndef FSCK_H
+#define FSCK_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Verifies every loose object on all cores: the file must inflate to the
+// size in its header, hash back to its name, and parse as its type (tree
+// lines, commit headers, chunk lists). A second pass checks that everything
+// an object, a ref or the index refers to exists with the expected type.
+struct FsckProblem
+{
+    std::string sha; // The object (or ref/index path) at fault
+    std::string message;
+};
+
+struct FsckReport
+{
+    size_t objects = 0;
+    uint64_t bytes = 0; // Stored (compressed) bytes read
+    size_t blobs = 0, trees = 0, commits = 0, chunk_lists = 0;
+    std::vector<FsckProblem> problems; // Sorted by sha
+};
+
+// `progress` is called from the calling thread every so often, and once at
+// the end, with the number of objects checked so far.
+typedef std::function<void(size_t checked, size_t total)> FsckProgress;
+
+Status check_repository(const Repository &repo, FsckReport &report, const FsckProgress &progress = nullptr);
+
+#endif // FSCK_H
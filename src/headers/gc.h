@@ -0,0 +1,41 @@
+#ifndef GC_H
+#define GC_H
+
+#include <chrono>
+#include <cstdint>
+#include "repository.h"
+
+// Garbage collection of loose objects. Marking starts from every branch and
+// tag, every worktree's HEAD and every index entry, and follows commits,
+// trees and chunk lists on several threads that share one visited set, so a
+// subtree reached from many commits is read once.
+//
+// Objects are listed before marking starts, and only listed objects whose
+// mtime is older than the grace period are deleted. An `add` running at the
+// same time either writes new files, which are not listed, or finds an
+// object already stored and bumps its mtime (Repository::freshen_object);
+// either way the object survives. A grace period of zero gives up that
+// protection for objects written while the collection runs.
+struct GcOptions
+{
+    bool prune = false; // Otherwise only count what would go
+    std::chrono::seconds grace = std::chrono::hours(24 * 14);
+};
+
+struct GcReport
+{
+    size_t loose_objects = 0;
+    size_t reachable = 0;
+    size_t unreachable = 0;
+    size_t kept_recent = 0; // Unreachable but within the grace period
+    size_t pruned = 0;
+    uint64_t unreachable_bytes = 0;
+    uint64_t bytes_reclaimed = 0;
+    size_t temp_files_removed = 0;
+    size_t cache_files_pruned = 0; // Worktree file cache entries of pruned blobs
+    double mark_ms = 0;
+};
+
+Status collect_garbage(const Repository &repo, const GcOptions &options, GcReport &report);
+
+#endif // GC_H
@@ -0,0 +1,52 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include "repository.h"
+
+// Finds lines containing a literal string or matching a POSIX extended
+// regex. Literals are located with an SSE2 scan that compares the first and
+// last byte of the needle 16 positions at a time and only then compares the
+// whole needle; regexes get the same prefilter when they contain a literal
+// every match must include.
+class LineMatcher
+{
+public:
+    static Status create(const std::string &pattern, bool fixed_string, bool ignore_case,
+                         std::unique_ptr<LineMatcher> &matcher);
+    virtual ~LineMatcher() = default;
+
+    // Calls `found` with the start and length of every matching line in
+    // `data`, which must end at a line boundary (or be the end of the file).
+    virtual void search(const char *data, size_t size,
+                        const std::function<void(const char *line, size_t length)> &found) const = 0;
+};
+
+// Position of the first `needle` in `haystack`, or `size` if there is none.
+size_t find_literal(const char *haystack, size_t size, const std::string &needle);
+
+struct GrepMatch
+{
+    std::string path;
+    size_t line_number = 0; // 1-based
+    std::string line;
+};
+
+struct GrepOptions
+{
+    std::string pattern;
+    bool fixed_string = false;
+    bool ignore_case = false;
+};
+
+// Searches every file in `commit_sha`'s tree straight from the object store,
+// on one thread per core. Binary files (a NUL byte near the start) are
+// skipped. `found` is called on the calling thread, in path order and then
+// line order.
+Status grep_commit(const Repository &repo, const std::string &commit_sha, const GrepOptions &options,
+                   const std::function<void(const GrepMatch &match)> &found);
+
+#endif // GREP_H
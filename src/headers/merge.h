@@ -0,0 +1,85 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Three-way merges of HEAD with another commit.
+//
+// Trees are merged level by level against the merge base. When two of the
+// three sides give a path the same ID, the result is known without looking
+// inside it: both sides agree, or only one side changed it. A subtree is
+// then taken whole, by ID, and never read. Only paths that both sides changed
+// differently are descended into. Only files that both sides changed are
+// merged line by line.
+//
+// A merge with conflicts leaves the merged tree, conflict markers included,
+// in the working tree and records it in .mygit/MERGE_HEAD:
+//
+//   <their commit sha>
+//   tree <merged tree sha>
+//   conflict <path>         one per conflicted path
+//
+// `commit` then finishes the merge once every conflicted path is added
+// again. Each worktree has its own MERGE_HEAD.
+struct MergeOptions
+{
+    std::string message; // Defaults to "Merge <their_name>"
+    std::string their_name;
+};
+
+struct MergeConflict
+{
+    std::string path;
+    std::string kind; // content, binary, modify/delete or file/directory
+};
+
+struct MergeResult
+{
+    std::string base_sha; // Empty when the histories are unrelated
+    std::string commit_sha;
+    bool up_to_date = false;
+    bool fast_forward = false;
+    std::vector<MergeConflict> conflicts;
+    size_t trees_taken = 0; // Subtrees taken by ID without being read
+    size_t trees_read = 0;
+    size_t files_merged = 0; // Line-level merges
+};
+
+struct MergeState
+{
+    std::string their_sha;
+    std::string tree_sha;
+    std::vector<std::string> conflicts;
+};
+
+// The nearest common ancestor of two commits. If there are several, as after
+// criss-cross merges, the newest one. Leaves `base_sha` empty if there is
+// none.
+Status find_merge_base(const Repository &repo, const std::string &ours, const std::string &theirs,
+                       std::string &base_sha);
+
+// Merges `their_sha` into HEAD. The index must be empty. A clean merge is
+// committed and checked out. A conflicted one is checked out and recorded as
+// above, and its conflicts are returned.
+Status merge_commit(Repository &repo, const std::string &their_sha, const MergeOptions &options,
+                    MergeResult &result);
+
+// Forgets a conflicted merge and checks out HEAD again
+Status abort_merge(Repository &repo);
+
+// False if no merge is in progress
+bool read_merge_state(const Repository &repo, MergeState &state);
+// Pending merges of every worktree, whose trees gc must keep
+void read_all_merge_states(const Repository &repo, std::vector<MergeState> &states);
+void clear_merge_state(const Repository &repo);
+
+// Line-level three-way merge. Lines changed on only one side are taken from
+// that side. Where both sides changed the same or adjacent lines
+// differently, both versions are written between conflict markers. Returns
+// false if there were conflicts.
+bool merge_text(const std::string &base, const std::string &ours, const std::string &theirs,
+                const std::string &their_label, std::string &merged);
+
+#endif // MERGE_H
@@ -0,0 +1,68 @@
+#ifndef OBJECT_PIPELINE_H
+#define OBJECT_PIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "repository.h"
+
+struct PipelineStageStats
+{
+    std::string name;
+    size_t items = 0;
+    size_t bytes = 0;
+    double busy_ms = 0;    // Doing the stage's own work
+    double starved_ms = 0; // Waiting for input
+    double blocked_ms = 0; // Waiting for room in the next queue
+};
+
+struct PipelineQueueStats
+{
+    std::string name;
+    size_t capacity = 0;
+    size_t max_depth = 0;
+    double mean_depth = 0; // Sampled at every push
+};
+
+struct PipelineReport
+{
+    double wall_ms = 0;
+    size_t already_stored = 0;
+    std::vector<PipelineStageStats> stages;
+    std::vector<PipelineQueueStats> queues;
+};
+
+// Stores objects through four stages on their own threads, connected by
+// bounded queues so the disk and the CPU stay busy at the same time:
+//
+//   read file -> hash -> compress -> write
+//
+// A full queue blocks the stage feeding it, which bounds memory to roughly
+// `queue_bytes` per queue however many files are queued. Objects already in
+// the store (or already queued) are dropped after hashing.
+class ObjectPipeline
+{
+public:
+    explicit ObjectPipeline(Repository &repo, size_t queue_items = 64, size_t queue_bytes = 32 << 20);
+    ~ObjectPipeline();
+    ObjectPipeline(const ObjectPipeline &) = delete;
+    ObjectPipeline &operator=(const ObjectPipeline &) = delete;
+
+    // Queues a working tree file to be stored as a blob. Its ID is at the
+    // returned position of finish()'s `file_shas`. `size`, if the caller
+    // knows it, keeps the files read in one batch within a few megabytes.
+    size_t add_file(const fs::path &path, size_t size = 0);
+
+    // For objects the caller needs the ID of right away (trees): hashes on
+    // the calling thread and leaves compressing and writing to the pipeline.
+    std::string add_object(const std::string &type, std::string content);
+
+    // Waits for every queued object to reach the store.
+    Status finish(std::vector<std::string> &file_shas, PipelineReport *report = nullptr);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+#endif // OBJECT_PIPELINE_H
@@ -0,0 +1,93 @@
+#ifndef REFTABLE_H
+#define REFTABLE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "repository.h"
+
+// Refs under refs/ are kept in one sorted file, .mygit/reftable, instead of
+// a file each. The file is cut into blocks of at most 4 KB. A block stores
+// each name as the length of the prefix it shares with the name before it,
+// plus the rest of the name and then the binary SHA-1. Every 16th name is
+// a restart point, stored whole, and the block ends with their offsets. An
+// index block lists every block's first name along with a table of entry
+// offsets. A lookup binary-searches the index, then the block's restart
+// points, and decodes at most 16 records. The file is mapped rather than
+// read, so lookups and prefix listings never touch blocks they do not need.
+//
+// Layout (integers big-endian, varints LEB128):
+//   header  "MGRT" version:u8 0:u8[3] block_size:u32
+//   blocks  { shared:varint suffix_length:varint suffix sha:20 }... restart:u16 * count count:u16
+//   index   { name_length:varint name offset:u64 length:u32 }... entry:u32 * block_count
+//   footer  index_offset:u64 block_count:u32 ref_count:u64 crc32:u32 "MGRT"
+//
+// The table is only ever replaced as a whole. A writer creates
+// .mygit/reftable.lock exclusively, writes the new table into it, and
+// renames it over the old one. Readers therefore see either the old table
+// or the new one. A second writer fails instead of losing an update.
+class RefTable
+{
+public:
+    static const uint32_t DEFAULT_BLOCK_SIZE = 4096;
+
+    RefTable() = default;
+    ~RefTable();
+    RefTable(RefTable &&other) noexcept;
+    RefTable &operator=(RefTable &&other) noexcept;
+    RefTable(const RefTable &) = delete;
+    RefTable &operator=(const RefTable &) = delete;
+
+    // A missing file is an empty table
+    static Status open(const fs::path &path, RefTable &table);
+    static std::string encode(const std::map<std::string, std::string> &refs,
+                              uint32_t block_size = DEFAULT_BLOCK_SIZE);
+
+    size_t size() const { return ref_count_; }
+    // Leaves `sha` empty if there is no such ref
+    Status lookup(const std::string &name, std::string &sha) const;
+    // Every ref whose name starts with `prefix`, in name order
+    Status list(const std::string &prefix, std::map<std::string, std::string> &refs) const;
+    // Recomputes the checksum over the whole file
+    bool verify() const;
+
+private:
+    bool block_starts_at_most(size_t block, const std::string &name) const;
+    size_t find_block(const std::string &name) const;
+    Status scan_block(size_t block, const std::string &from,
+                      const std::function<bool(const std::string &name, const char *binary_sha)> &visit,
+                      bool &stopped) const;
+
+    fs::path path_;
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    uint64_t index_offset_ = 0;
+    uint32_t block_count_ = 0;
+    uint64_t ref_count_ = 0;
+};
+
+// Holds .mygit/reftable.lock while a new table is written. Dropping the
+// lock without commit() leaves the current table in place.
+class RefTableLock
+{
+public:
+    RefTableLock() = default;
+    ~RefTableLock();
+    RefTableLock(const RefTableLock &) = delete;
+    RefTableLock &operator=(const RefTableLock &) = delete;
+
+    Status acquire(const fs::path &table_path);
+    Status commit(const std::map<std::string, std::string> &refs);
+
+private:
+    fs::path table_path_;
+    fs::path lock_path_;
+    int fd_ = -1;
+};
+
+// Branch and tag names: components are non-empty and do not start with
+// '.'; no "..", "@{", spaces, control characters or any of ~^:?*[\; no
+// leading '-' and no trailing ".lock" or "/".
+bool is_valid_ref_name(const std::string &name);
+
+#endif // REFTABLE_H
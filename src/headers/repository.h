@@ -1,31 +1,212 @@
 #ifndef REPOSITORY_H
 #define REPOSITORY_H
 
+#include <cstdint>
 #include <string>
 #include <map>
 #include <vector>
 #include <filesystem>
+#include <functional>
+#include <memory>
 
 namespace fs = std::filesystem;
 
-// Forward declaration of TreeEntry struct
+struct PipelineReport;
+class SparseCheckout;
+class RefTable;
+struct MaterializeStats;
+
+enum class ErrorCode
+{
+    Ok,
+    NotARepository,
+    NotFound,
+    Ambiguous,
+    Corrupt,
+    InvalidArgument,
+    IoError,
+};
+
+// Result of a library call. Nothing in the library prints; callers decide
+// how to surface `message`.
+struct Status
+{
+    ErrorCode code = ErrorCode::Ok;
+    std::string message;
+
+    bool ok() const { return code == ErrorCode::Ok; }
+    static Status error(ErrorCode code, std::string message) { return {code, std::move(message)}; }
+};
+
 struct TreeEntry {
     std::string mode;
     std::string name;
     std::string sha;
 };
 
-void init_repository();
-void add_to_index(const std::string &file_path, const std::string &sha);
-void add_file(const fs::path &file_path);
-void add_files(const std::vector<std::string> &files);
-void create_tree_from_commit(std::map<std::string, std::vector<std::string>>& adjList, const std::string& commit_sha);
-void populate_tree_entries(const std::string& tree_sha, std::map<std::string, TreeEntry>& tree_entries);
-std::map<std::string, std::vector<std::string>> create_tree_from_index(const std::map<std::string, TreeEntry>& index_entries);
-TreeEntry generate_tree_sha(const std::map<std::string, std::vector<std::string>>& adjList, const std::string& current = "");
-TreeEntry write_tree();
-void log();
-void commit(std::string  message);
-void checkout(std::string commit_sha);
+struct Object
+{
+    std::string type;
+    std::string content;
+};
+
+struct Commit
+{
+    std::string tree_sha;
+    std::vector<std::string> parents; // Two for a merge, the first being HEAD's
+    std::string message;
+    std::string author;
+    std::string committer;
+    std::string timestamp; // "2024-05-01 12:00:00 +0200", in the committer's zone
+
+    // `timestamp` in seconds since the epoch; 0 if it does not parse. Order
+    // commits by this, not by `timestamp`, whose zones may differ.
+    int64_t time() const;
+    std::string serialize() const;
+    static bool parse(const std::string &content, Commit &commit);
+};
+
+// One change in Repository::update_refs. An empty `new_sha` deletes the
+// ref. With `check_old` the update only applies if the ref is currently
+// `old_sha` (empty: the ref must not exist).
+struct RefUpdate
+{
+    std::string name;
+    std::string new_sha;
+    bool check_old = false;
+    std::string old_sha;
+};
+
+// A repository rooted at `root`, with its metadata in `root/.mygit`. All
+// paths are resolved against the root rather than the process's current
+// directory, so any number of repositories can be open at once.
+//
+// In a linked worktree (see worktree.h) `root/.mygit` is a file naming the
+// worktree's own directory under the main repository's .mygit/worktrees.
+// That directory holds what belongs to one working tree (index, HEAD,
+// sparse-checkout, config overrides); objects, refs and config live in the
+// main .mygit, the common directory.
+class Repository
+{
+public:
+    Repository();
+    ~Repository();
+    Repository(Repository &&) noexcept;
+    Repository &operator=(Repository &&) noexcept;
+    Repository(const Repository &) = delete;
+    Repository &operator=(const Repository &) = delete;
+
+    static Status init(const fs::path &root, Repository &repo);
+    static Status open(const fs::path &root, Repository &repo);
+
+    const fs::path &root() const { return root_; }
+    const fs::path &git_dir() const { return git_dir_; }
+    const fs::path &common_dir() const { return common_dir_; }
+    bool is_linked_worktree() const { return git_dir_ != common_dir_; }
+
+    // "key = value" settings from .mygit/config, then a linked worktree's
+    // own config
+    std::string config_value(const std::string &key, const std::string &fallback = "") const;
+
+    // In-memory caches for long-lived processes such as the daemon or
+    // `cat-file --batch`: inflated objects, the parsed index and HEAD tree.
+    // When `working_tree_watched` is set the caller promises to report every
+    // working tree change through forget_working_tree_path(), and `add` then
+    // reuses blob IDs of files it has already hashed.
+    void enable_caching(size_t object_cache_bytes, bool working_tree_watched = false);
+    bool caching_enabled() const { return cache_ != nullptr; }
+    void forget_working_tree_path(const std::string &relative_path);
+    void forget_working_tree();
+
+    // Object store
+    fs::path object_path(const std::string &sha) const;
+    bool has_object(const std::string &sha) const;
+    // Every loose object's ID, sorted
+    Status list_objects(std::vector<std::string> &shas) const;
+    // has_object for writers that skip storing an object they find: also
+    // bumps its mtime so a concurrent `gc --prune` treats it as new.
+    bool freshen_object(const std::string &sha) const;
+    Status resolve_object_name(const std::string &name, std::string &sha) const;
+    Status read_object(const std::string &sha, Object &object) const;
+    Status read_object_header(const std::string &sha, std::string &type, size_t &size) const;
+    Status write_object(const std::string &type, std::string content, std::string &sha);
+    // Stores a file's content as add would: as a blob, or split into chunks
+    // at `chunking.threshold` bytes.
+    Status write_file_object(std::string content, std::string &sha);
+    // A file's content in order: a blob in one piece, a chunk list (large
+    // files, see chunking.h) one chunk at a time.
+    Status stream_blob(const std::string &sha, const std::function<Status(const std::string &data)> &sink) const;
+    fs::path temp_object_path() const;
+    Status store_raw_object(const std::string &sha, const fs::path &raw_file);
+
+    // Trees and commits
+    Status read_tree(const std::string &tree_sha, std::vector<TreeEntry> &entries) const;
+    // With `sparse`, subtrees it excludes are listed but not read.
+    Status read_tree_recursive(const std::string &tree_sha, std::map<std::string, TreeEntry> &entries,
+                               const SparseCheckout *sparse = nullptr) const;
+    Status read_commit(const std::string &commit_sha, Commit &commit) const;
+
+    // Refs. Branches and tags live in the ref table (see reftable.h);
+    // loose files under .mygit/refs are still read, and win over the table.
+    fs::path ref_table_path() const;
+    Status read_ref(const std::string &ref_name, std::string &sha) const;
+    Status update_ref(const std::string &ref_name, const std::string &sha);
+    Status delete_ref(const std::string &ref_name);
+    // Applies every update or none of them
+    Status update_refs(const std::vector<RefUpdate> &updates);
+    // Every ref whose name starts with `prefix` as (name, sha), sorted by
+    // name, including each linked worktree's own HEAD as
+    // "worktrees/<name>/HEAD"
+    Status list_refs(std::map<std::string, std::string> &refs, const std::string &prefix = "") const;
+    Status read_head(std::string &commit_sha) const;
+    Status update_head(const std::string &commit_sha);
+    // The branch HEAD points at ("refs/heads/<name>"), or "" if HEAD holds a
+    // commit of its own
+    std::string head_branch() const;
+    Status set_head_branch(const std::string &ref_name);
+
+    // Index and working tree
+    Status read_index(std::map<std::string, TreeEntry> &entries) const;
+    // The entries of every worktree's index, this one's included
+    Status read_all_indexes(std::vector<TreeEntry> &entries) const;
+    // add and commit store objects through an ObjectPipeline; pass `report`
+    // to get its per-stage timings. add splits files of at least
+    // `chunking.threshold` bytes (default 8M, 0 disables) into chunks.
+    Status add(const std::vector<std::string> &paths, std::vector<std::string> &missing,
+               PipelineReport *report = nullptr);
+    // Deletes tracked files and stages their removal, so the next commit
+    // leaves them out
+    Status remove(const std::vector<std::string> &paths, std::vector<std::string> &missing);
+    Status write_tree(TreeEntry &root_entry, PipelineReport *report = nullptr);
+    // While a conflicted merge is pending (see merge.h), commit starts from
+    // the merged tree and records both parents.
+    Status commit(const std::string &message, std::string &commit_sha, PipelineReport *report = nullptr);
+    // Writes a commit object by the usual author; refs are left alone
+    Status create_commit(const std::string &tree_sha, const std::vector<std::string> &parents,
+                         const std::string &message, std::string &commit_sha);
+    // With `checkout.fileCache = true` in the config, files are cloned or
+    // copied from an uncompressed cache keyed by blob ID (see worktree.h)
+    // instead of being written.
+    Status checkout(const std::string &commit_sha, MaterializeStats *stats = nullptr);
+    // Checks out the branch's commit and points HEAD at the branch
+    Status switch_branch(const std::string &ref_name, MaterializeStats *stats = nullptr);
+    // Replaces the working tree with `tree_sha`; HEAD and the index are left
+    // alone
+    Status restore_working_tree(const std::string &tree_sha, MaterializeStats *stats = nullptr);
+
+private:
+    struct Cache;
+
+    std::string head_ref() const;
+    Status with_ref_table(const std::function<Status(const RefTable &table)> &use) const;
+    Status check_out_tree(const std::string &commit_sha, MaterializeStats *stats);
+    Status append_to_index(std::vector<TreeEntry> entries);
+    Status base_tree(std::string &tree_sha) const;
+
+    fs::path root_;
+    fs::path git_dir_;
+    fs::path common_dir_;
+    std::unique_ptr<Cache> cache_;
+};
 
 #endif // REPOSITORY_H
@@ -0,0 +1,57 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "repository.h"
+
+// Patterns from the repository's .mygitignore, compiled once into lookup
+// buckets so the common shapes never reach the general glob matcher:
+//
+//   name, dir/name        exact basename / exact path   (hash lookup)
+//   *.ext                 extension                     (hash lookup)
+//   *suffix, prefix*      suffix / prefix               (string compare)
+//   anything else         glob with *, ?, [...] and **  (backtracking match)
+//
+// Syntax follows .gitignore: '#' comments, a trailing '/' matches only
+// directories, a leading or inner '/' anchors the pattern to the root, '!'
+// re-includes, and the last matching pattern wins.
+class IgnoreRules
+{
+public:
+    static IgnoreRules load(const fs::path &root);
+
+    void add_pattern(const std::string &line);
+    bool is_ignored(const std::string &relative_path, bool is_directory) const;
+
+private:
+    struct Rule
+    {
+        std::string pattern;
+        bool negate = false;
+        bool directory_only = false;
+        bool anchored = false;
+    };
+
+    typedef std::unordered_map<std::string, std::vector<size_t>> RuleIndex;
+
+    std::vector<Rule> rules_;
+    RuleIndex literal_names_;
+    RuleIndex literal_paths_;
+    RuleIndex extensions_;
+    std::vector<std::pair<std::string, size_t>> suffixes_;
+    std::vector<std::pair<std::string, size_t>> prefixes_;
+    std::vector<size_t> globs_;
+};
+
+bool glob_match(const char *pattern, const char *text);
+
+// Lists the regular files (and symlinks to them) under each of `relative_dirs`
+// ("" is the root), skipping .mygit and anything `rules` ignores. Directories
+// are read in parallel and classified by readdir's d_type, so the walk costs
+// no stat calls on filesystems that report it. The result is sorted.
+Status scan_working_tree(const fs::path &root, const std::vector<std::string> &relative_dirs, const IgnoreRules &rules,
+                         std::vector<std::string> &files);
+
+#endif // SCANNER_H
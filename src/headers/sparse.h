@@ -0,0 +1,45 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Which paths a sparse checkout materializes, from
+// .mygit/info/sparse-checkout. Each line is either
+//
+//   deploy/            a cone: the path and everything below it
+//   config/site1       (trailing '/' optional; a file path works too)
+//   *.md               a pattern, glob-matched against whole file paths
+//                      ('*' stays within a directory, '**' crosses them)
+//
+// '#' starts a comment. Without the file (or with no lines) every path is
+// included. Top-level files are not included unless listed; add a "*" line
+// to get them all.
+class SparseCheckout
+{
+public:
+    static Status load(const Repository &repo, SparseCheckout &sparse);
+    static Status save(const Repository &repo, const std::vector<std::string> &lines);
+    static fs::path config_path(const Repository &repo);
+
+    bool enabled() const { return !cones_.empty() || !patterns_.empty(); }
+    const std::vector<std::string> &lines() const { return lines_; }
+
+    bool includes_file(const std::string &path) const;
+    // True if anything included could be below `path`, so it must be read.
+    bool includes_directory(const std::string &path) const;
+
+private:
+    struct Pattern
+    {
+        std::string text;
+        std::vector<std::string> components; // `text` split at '/'
+    };
+
+    std::vector<std::string> lines_;
+    std::vector<std::string> cones_;
+    std::vector<Pattern> patterns_;
+};
+
+#endif // SPARSE_H
@@ -0,0 +1,96 @@
+#ifndef TREE_BUILDER_H
+#define TREE_BUILDER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "repository.h"
+
+// Bump allocator for data that lives exactly as long as its owner: nothing is
+// freed individually, and every byte goes when the arena does.
+class Arena
+{
+public:
+    explicit Arena(size_t block_size = 64 * 1024);
+
+    void *allocate(size_t size, size_t alignment);
+    std::string_view copy(std::string_view text);
+
+    template <typename T>
+    T *allocate_array(size_t count)
+    {
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t bytes_used() const { return bytes_used_; }
+    size_t block_count() const { return blocks_.size(); }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *next_ = nullptr;
+    char *end_ = nullptr;
+    size_t block_size_;
+    size_t bytes_used_ = 0;
+};
+
+// Turns path-ordered (index/std::map order) entries into the nested trees a
+// commit points at, in one pass. Open directories sit on a stack, and a
+// directory is closed once a path outside it arrives. Its children are then
+// copied into one arena array. Every string is a view into the arena, and a
+// directory's path is a prefix of its first entry's path copy.
+//
+// Path order is also the order git sorts a tree's entries in (a directory
+// compares as "name/"), so children come out sorted without a sort.
+class TreeBuilder
+{
+public:
+    struct Node
+    {
+        std::string_view path;
+        std::string_view mode;
+        std::string_view sha;
+        const Node *children = nullptr;
+        size_t child_count = 0;
+        bool is_directory = false;
+    };
+
+    // Paths must arrive in ascending order. A "040000" entry only makes sure
+    // its directory exists. A file that is later needed as a directory is
+    // replaced by the directory, and directories left empty are dropped.
+    void add(std::string_view path, std::string_view mode, std::string_view sha);
+    // An existing tree kept as it is, e.g. one a sparse checkout never read.
+    // Nothing may be added inside it.
+    void add_subtree(std::string_view path, std::string_view sha);
+    const Node &finish();
+
+    // Stores every tree object bottom-up through `store`, which must return
+    // each tree's ID. An empty root yields an empty sha.
+    typedef std::function<Status(const std::string &type, std::string content, std::string &sha)> ObjectStore;
+    Status write(const ObjectStore &store, TreeEntry &root_entry) const;
+
+    size_t node_count() const { return node_count_; }
+    const Arena &arena() const { return arena_; }
+
+private:
+    struct Level
+    {
+        std::string_view path;
+        std::vector<Node> children;
+    };
+
+    std::string_view enter_parent(std::string_view path);
+    void add_leaf(std::string_view stored, std::string_view mode, std::string_view sha);
+    void open_directory(std::string_view path);
+    void close_directory();
+    Status write_directory(const ObjectStore &store, const Node &directory, std::string &sha) const;
+
+    Arena arena_;
+    std::vector<Level> levels_{1}; // levels_[0] is the root, reused across closes
+    size_t depth_ = 1;
+    size_t node_count_ = 0;
+    Node root_;
+};
+
+#endif // TREE_BUILDER_H
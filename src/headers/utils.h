@@ -5,14 +5,43 @@
 #include <filesystem>
 #include <vector>
 
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+// Incremental SHA-1 for content that is processed in chunks.
+class Sha1Stream
+{
+public:
+    Sha1Stream();
+    ~Sha1Stream();
+    Sha1Stream(const Sha1Stream &) = delete;
+    Sha1Stream &operator=(const Sha1Stream &) = delete;
+
+    void update(const char *data, size_t len);
+    void update(const std::string &data) { update(data.data(), data.size()); }
+    std::string hex_digest();
+
+private:
+    EVP_MD_CTX *ctx_;
+};
+
 std::string calculate_sha1(const std::string &content);
 std::string compress_data(const std::string &data);
 std::string decompress_data(const std::string &compressed_data, size_t original_size);
-void write_blob(const std::string &hash, const std::string &content);
+std::string decompress_data(const char *compressed_data, size_t compressed_size, size_t original_size);
 std::string read_file_content(const std::filesystem::path &filepath);
-std::string get_or_create_blob(const std::string &file_content);
-void hash_object(const std::string &filename, bool write);
-void cat_file(const std::string &flag, const std::string &file_sha);
-void ls_tree(const std::string &tree_sha, bool name_only);
+bool is_hex_string(const std::string &text);
+
+std::string object_header(const std::string &type, size_t size);
+bool parse_object_header(const std::string &header, std::string &type, size_t &size);
+
+// An outgoing edge of the object graph: a commit's tree and parents, a
+// tree's entries, or a chunk list's chunks.
+struct ObjectRef
+{
+    std::string sha;
+    std::string type;
+};
+
+std::vector<ObjectRef> referenced_objects(const std::string &type, const std::string &content);
 
 #endif // UTILS_H
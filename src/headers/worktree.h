@@ -0,0 +1,54 @@
+#ifndef WORKTREE_H
+#define WORKTREE_H
+
+#include <string>
+#include <vector>
+#include "repository.h"
+
+// Linked worktrees: extra working trees that share one object store, refs
+// and config. `<dir>/.mygit` is a file pointing at the worktree's own
+// directory, .mygit/worktrees/<name>, which holds its HEAD, index and
+// config overrides.
+//
+// Checkouts can also be materialized from a file cache, .mygit/file-cache,
+// holding each blob uncompressed under its ID. A file is then cloned from
+// the cache (FICLONE), so N worktrees of the same commit cost the disk one
+// copy of each file rather than N. New worktrees use the cache only where
+// reflinks work; a worktree configured for it elsewhere gets copies. Files
+// are never hardlinked, since an edit in place would then reach the cache
+// and every other worktree.
+struct MaterializeStats
+{
+    size_t files = 0;
+    size_t cloned = 0;
+    size_t copied = 0;
+    size_t written = 0; // Without the cache
+    size_t cache_entries_added = 0;
+};
+
+struct WorktreeInfo
+{
+    std::string name;
+    fs::path root;
+    std::string head;
+};
+
+// Creates a worktree at `dir` (which must be missing or empty) with
+// `commit_sha` checked out. The name is the directory's last component,
+// made unique if another worktree already has it. `use_file_cache` is
+// turned off, and the worktree checked out without the cache, when files
+// cannot be cloned from the cache into `dir`.
+Status add_worktree(const Repository &repo, const fs::path &dir, const std::string &commit_sha,
+                    bool &use_file_cache, MaterializeStats &stats);
+
+// The main worktree first, then linked ones by name
+Status list_worktrees(const Repository &repo, std::vector<WorktreeInfo> &worktrees);
+
+fs::path file_cache_dir(const Repository &repo);
+
+// Puts blob `sha` at `target` through the file cache, adding it to the cache
+// first if needed.
+Status materialize_from_cache(const Repository &repo, const std::string &sha, const fs::path &target,
+                              MaterializeStats &stats);
+
+#endif // WORKTREE_H
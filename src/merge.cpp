@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include "headers/diff.h"
+#include "headers/merge.h"
+#include "headers/tree_builder.h"
+
+namespace
+{
+// Like git, a NUL byte this close to the start marks a file as binary
+const size_t BINARY_CHECK_BYTES = 8000;
+const char *DIRECTORY_MODE = "040000";
+
+fs::path merge_state_path(const Repository &repo)
+{
+    return repo.git_dir() / "MERGE_HEAD";
+}
+
+bool read_merge_state_file(const fs::path &path, MergeState &state)
+{
+    std::ifstream file(path);
+    if (!file || !std::getline(file, state.their_sha))
+    {
+        return false;
+    }
+    state.tree_sha.clear();
+    state.conflicts.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, 5, "tree ") == 0)
+        {
+            state.tree_sha = line.substr(5);
+        }
+        else if (line.compare(0, 9, "conflict ") == 0)
+        {
+            state.conflicts.push_back(line.substr(9));
+        }
+    }
+    return true;
+}
+
+bool is_binary(const std::string &data)
+{
+    return std::memchr(data.data(), '\0', std::min(data.size(), BINARY_CHECK_BYTES)) != nullptr;
+}
+
+void append_lines(std::string &out, const std::vector<std::string_view> &lines, size_t start, size_t end)
+{
+    for (size_t i = start; i < end; ++i)
+    {
+        out.append(lines[i]);
+    }
+}
+
+// One side's version of base lines [start, end), given that side's hunks
+// falling inside that range
+std::string side_version(const std::vector<std::string_view> &base, const std::vector<std::string_view> &side,
+                         const std::vector<const LineHunk *> &hunks, size_t start, size_t end)
+{
+    std::string out;
+    size_t at = start;
+    for (const LineHunk *hunk : hunks)
+    {
+        append_lines(out, base, at, hunk->old_start);
+        append_lines(out, side, hunk->new_start, hunk->new_end);
+        at = hunk->old_end;
+    }
+    append_lines(out, base, at, end);
+    return out;
+}
+
+void append_conflict_section(std::string &out, const std::string &text)
+{
+    out += text;
+    if (!text.empty() && text.back() != '\n')
+    {
+        out += '\n';
+    }
+}
+
+struct TreeMerge
+{
+    TreeMerge(Repository &repo, MergeResult &result, const std::string &their_label)
+        : repo(repo), result(result), their_label(their_label)
+    {
+    }
+
+    Repository &repo;
+    MergeResult &result;
+    const std::string &their_label;
+    std::map<std::string, TreeEntry> files;      // Merged entries by path
+    std::map<std::string, std::string> subtrees; // Taken whole: path -> tree sha
+
+    static bool same(const TreeEntry *a, const TreeEntry *b)
+    {
+        if (!a || !b)
+        {
+            return a == b;
+        }
+        return a->mode == b->mode && a->sha == b->sha;
+    }
+
+    static bool is_directory(const TreeEntry *entry) { return entry && entry->mode == DIRECTORY_MODE; }
+
+    Status read_children(const std::string &tree_sha, std::map<std::string, TreeEntry> &children)
+    {
+        if (tree_sha.empty())
+        {
+            return {};
+        }
+        std::vector<TreeEntry> entries;
+        Status status = repo.read_tree(tree_sha, entries);
+        ++result.trees_read;
+        for (auto &entry : entries)
+        {
+            std::string path = entry.name;
+            children.emplace(std::move(path), std::move(entry));
+        }
+        return status;
+    }
+
+    void take(const std::string &path, const TreeEntry *entry)
+    {
+        if (is_directory(entry))
+        {
+            subtrees[path] = entry->sha;
+            ++result.trees_taken;
+        }
+        else if (entry)
+        {
+            files[path] = *entry;
+        }
+    }
+
+    Status merge_trees(const std::string &base_sha, const std::string &ours_sha, const std::string &theirs_sha)
+    {
+        std::map<std::string, TreeEntry> base, ours, theirs;
+        Status status = read_children(base_sha, base);
+        if (status.ok())
+        {
+            status = read_children(ours_sha, ours);
+        }
+        if (status.ok())
+        {
+            status = read_children(theirs_sha, theirs);
+        }
+        std::set<std::string> paths;
+        for (const auto *side : {&base, &ours, &theirs})
+        {
+            for (const auto &child : *side)
+            {
+                paths.insert(child.first);
+            }
+        }
+
+        for (auto it = paths.begin(); status.ok() && it != paths.end(); ++it)
+        {
+            const std::string &path = *it;
+            auto find = [&path](const std::map<std::string, TreeEntry> &side) -> const TreeEntry * {
+                auto found = side.find(path);
+                return found == side.end() ? nullptr : &found->second;
+            };
+            const TreeEntry *b = find(base);
+            const TreeEntry *o = find(ours);
+            const TreeEntry *t = find(theirs);
+
+            if (same(o, t) || same(b, t))
+            {
+                take(path, o);
+            }
+            else if (same(b, o))
+            {
+                take(path, t);
+            }
+            else if (is_directory(o) && is_directory(t))
+            {
+                status = merge_trees(is_directory(b) ? b->sha : "", o->sha, t->sha);
+            }
+            else if (o && t && !is_directory(o) && !is_directory(t))
+            {
+                status = merge_files(path, b && !is_directory(b) ? b : nullptr, *o, *t);
+            }
+            else
+            {
+                // Deleted on one side and changed on the other, or a file on
+                // one side and a directory on the other: keep what is there,
+                // ours first
+                result.conflicts.push_back({path, o && t ? "file/directory" : "modify/delete"});
+                take(path, o ? o : t);
+            }
+        }
+        return status;
+    }
+
+    // Large files are stored as chunk lists; this reads either kind whole
+    Status read_blob(const std::string &sha, std::string &data)
+    {
+        return repo.stream_blob(sha, [&data](const std::string &part) {
+            data += part;
+            return Status();
+        });
+    }
+
+    Status merge_files(const std::string &path, const TreeEntry *b, const TreeEntry &o, const TreeEntry &t)
+    {
+        std::string base, ours, theirs;
+        Status status = b ? read_blob(b->sha, base) : Status();
+        if (status.ok())
+        {
+            status = read_blob(o.sha, ours);
+        }
+        if (status.ok())
+        {
+            status = read_blob(t.sha, theirs);
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+
+        ++result.files_merged;
+        // A mode change on one side carries over
+        std::string mode = b && o.mode == b->mode ? t.mode : o.mode;
+        if (is_binary(base) || is_binary(ours) || is_binary(theirs))
+        {
+            result.conflicts.push_back({path, "binary"});
+            files[path] = {mode, path, o.sha};
+            return {};
+        }
+        std::string merged;
+        if (!merge_text(base, ours, theirs, their_label, merged))
+        {
+            result.conflicts.push_back({path, "content"});
+        }
+        std::string sha;
+        status = repo.write_file_object(std::move(merged), sha);
+        files[path] = {mode, path, sha};
+        return status;
+    }
+
+    Status write(TreeEntry &root_entry)
+    {
+        // Both maps are in path order; interleave them into the builder
+        TreeBuilder builder;
+        auto file = files.begin();
+        auto subtree = subtrees.begin();
+        while (file != files.end() || subtree != subtrees.end())
+        {
+            if (subtree == subtrees.end() || (file != files.end() && file->first < subtree->first))
+            {
+                builder.add(file->first, file->second.mode, file->second.sha);
+                ++file;
+            }
+            else
+            {
+                builder.add_subtree(subtree->first, subtree->second);
+                ++subtree;
+            }
+        }
+        builder.finish();
+        return builder.write(
+            [this](const std::string &type, std::string content, std::string &sha) {
+                return repo.write_object(type, std::move(content), sha);
+            },
+            root_entry);
+    }
+};
+
+Status write_merge_state(const Repository &repo, const MergeState &state)
+{
+    fs::path path = merge_state_path(repo);
+    std::ofstream file(path, std::ios::trunc);
+    file << state.their_sha << "\ntree " << state.tree_sha << "\n";
+    for (const auto &conflict : state.conflicts)
+    {
+        file << "conflict " << conflict << "\n";
+    }
+    if (!file)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to write " + path.string());
+    }
+    return {};
+}
+} // namespace
+
+bool merge_text(const std::string &base, const std::string &ours, const std::string &theirs,
+                const std::string &their_label, std::string &merged)
+{
+    std::vector<std::string_view> base_lines = split_lines(base);
+    std::vector<std::string_view> our_lines = split_lines(ours);
+    std::vector<std::string_view> their_lines = split_lines(theirs);
+
+    // Lines are compared by ID, equal lines sharing one
+    std::unordered_map<std::string_view, uint32_t> line_ids;
+    auto to_ids = [&line_ids](const std::vector<std::string_view> &lines) {
+        std::vector<uint32_t> ids;
+        ids.reserve(lines.size());
+        for (const auto &line : lines)
+        {
+            ids.push_back(line_ids.emplace(line, static_cast<uint32_t>(line_ids.size())).first->second);
+        }
+        return ids;
+    };
+    std::vector<uint32_t> base_ids = to_ids(base_lines);
+    std::vector<LineHunk> our_hunks = diff_line_ids(base_ids, to_ids(our_lines));
+    std::vector<LineHunk> their_hunks = diff_line_ids(base_ids, to_ids(their_lines));
+
+    merged.clear();
+    bool clean = true;
+    size_t at = 0;
+    auto next_ours = our_hunks.cbegin();
+    auto next_theirs = their_hunks.cbegin();
+    while (next_ours != our_hunks.cend() || next_theirs != their_hunks.cend())
+    {
+        // A group starts at the earlier next hunk and takes in every hunk,
+        // from either side, that overlaps or touches it
+        std::vector<const LineHunk *> ours_in_group, theirs_in_group;
+        if (next_theirs == their_hunks.cend() ||
+            (next_ours != our_hunks.cend() && next_ours->old_start <= next_theirs->old_start))
+        {
+            ours_in_group.push_back(&*next_ours++);
+        }
+        else
+        {
+            theirs_in_group.push_back(&*next_theirs++);
+        }
+        const LineHunk *first = ours_in_group.empty() ? theirs_in_group.front() : ours_in_group.front();
+        size_t start = first->old_start;
+        size_t end = first->old_end;
+        for (bool grew = true; grew;)
+        {
+            grew = false;
+            if (next_ours != our_hunks.cend() && next_ours->old_start <= end)
+            {
+                end = std::max(end, next_ours->old_end);
+                ours_in_group.push_back(&*next_ours++);
+                grew = true;
+            }
+            if (next_theirs != their_hunks.cend() && next_theirs->old_start <= end)
+            {
+                end = std::max(end, next_theirs->old_end);
+                theirs_in_group.push_back(&*next_theirs++);
+                grew = true;
+            }
+        }
+
+        append_lines(merged, base_lines, at, start);
+        if (theirs_in_group.empty())
+        {
+            append_lines(merged, our_lines, ours_in_group.front()->new_start, ours_in_group.back()->new_end);
+        }
+        else if (ours_in_group.empty())
+        {
+            append_lines(merged, their_lines, theirs_in_group.front()->new_start, theirs_in_group.back()->new_end);
+        }
+        else
+        {
+            std::string our_version = side_version(base_lines, our_lines, ours_in_group, start, end);
+            std::string their_version = side_version(base_lines, their_lines, theirs_in_group, start, end);
+            if (our_version == their_version)
+            {
+                merged += our_version;
+            }
+            else
+            {
+                clean = false;
+                merged += "<<<<<<< HEAD\n";
+                append_conflict_section(merged, our_version);
+                merged += "=======\n";
+                append_conflict_section(merged, their_version);
+                merged += ">>>>>>> " + their_label + "\n";
+            }
+        }
+        at = end;
+    }
+    append_lines(merged, base_lines, at, base_lines.size());
+    return clean;
+}
+
+Status find_merge_base(const Repository &repo, const std::string &ours, const std::string &theirs,
+                       std::string &base_sha)
+{
+    auto ancestors_of = [&repo](const std::vector<std::string> &starts, std::unordered_set<std::string> &seen) {
+        std::vector<std::string> stack = starts;
+        while (!stack.empty())
+        {
+            std::string sha = stack.back();
+            stack.pop_back();
+            Commit commit;
+            if (seen.insert(sha).second && repo.read_commit(sha, commit).ok())
+            {
+                stack.insert(stack.end(), commit.parents.begin(), commit.parents.end());
+            }
+        }
+    };
+    std::unordered_set<std::string> our_ancestors;
+    ancestors_of({ours}, our_ancestors);
+
+    // Walk back from theirs, stopping at the first commits ours also reaches
+    std::vector<std::string> candidates;
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> stack = {theirs};
+    while (!stack.empty())
+    {
+        std::string sha = stack.back();
+        stack.pop_back();
+        if (!seen.insert(sha).second)
+        {
+            continue;
+        }
+        if (our_ancestors.count(sha))
+        {
+            candidates.push_back(sha);
+            continue;
+        }
+        Commit commit;
+        Status status = repo.read_commit(sha, commit);
+        if (!status.ok())
+        {
+            return status;
+        }
+        stack.insert(stack.end(), commit.parents.begin(), commit.parents.end());
+    }
+
+    // A candidate reachable from another one is not the nearest
+    std::vector<std::pair<int64_t, std::string>> nearest; // (commit time, sha)
+    for (const auto &candidate : candidates)
+    {
+        std::vector<std::string> others;
+        for (const auto &other : candidates)
+        {
+            if (other != candidate)
+            {
+                Commit commit;
+                repo.read_commit(other, commit);
+                others.insert(others.end(), commit.parents.begin(), commit.parents.end());
+            }
+        }
+        std::unordered_set<std::string> reachable;
+        ancestors_of(others, reachable);
+        Commit commit;
+        if (!reachable.count(candidate) && repo.read_commit(candidate, commit).ok())
+        {
+            nearest.emplace_back(commit.time(), candidate);
+        }
+    }
+    base_sha = nearest.empty() ? "" : std::max_element(nearest.begin(), nearest.end())->second;
+    return {};
+}
+
+Status merge_commit(Repository &repo, const std::string &their_sha, const MergeOptions &options,
+                    MergeResult &result)
+{
+    result = MergeResult();
+    std::string our_sha;
+    Status status = repo.read_head(our_sha);
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (our_sha.empty())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Nothing to merge into, HEAD has no commits.");
+    }
+    MergeState state;
+    if (read_merge_state(repo, state))
+    {
+        return Status::error(ErrorCode::InvalidArgument,
+                             "Error: A merge is already in progress; commit it or run `merge --abort`.");
+    }
+    std::map<std::string, TreeEntry> index_entries;
+    status = repo.read_index(index_entries);
+    if (status.ok() && !index_entries.empty())
+    {
+        status = Status::error(ErrorCode::InvalidArgument, "Error: There are staged changes; commit them first.");
+    }
+    Commit ours, theirs, base;
+    if (status.ok())
+    {
+        status = repo.read_commit(our_sha, ours);
+    }
+    if (status.ok() && !repo.read_commit(their_sha, theirs).ok())
+    {
+        status = Status::error(ErrorCode::InvalidArgument, "Error: Invalid commit SHA.");
+    }
+    if (status.ok())
+    {
+        status = find_merge_base(repo, our_sha, their_sha, result.base_sha);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    if (result.base_sha == their_sha)
+    {
+        result.up_to_date = true;
+        result.commit_sha = our_sha;
+        return {};
+    }
+    if (result.base_sha == our_sha)
+    {
+        result.fast_forward = true;
+        result.commit_sha = their_sha;
+        return repo.checkout(their_sha);
+    }
+    if (!result.base_sha.empty())
+    {
+        status = repo.read_commit(result.base_sha, base);
+        if (!status.ok())
+        {
+            return status;
+        }
+    }
+
+    TreeMerge merge(repo, result, options.their_name);
+    status = merge.merge_trees(base.tree_sha, ours.tree_sha, theirs.tree_sha);
+    TreeEntry root_entry;
+    if (status.ok())
+    {
+        status = merge.write(root_entry);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    if (result.conflicts.empty())
+    {
+        std::string message = options.message.empty() ? "Merge " + options.their_name : options.message;
+        status = repo.create_commit(root_entry.sha, {our_sha, their_sha}, message, result.commit_sha);
+        return status.ok() ? repo.checkout(result.commit_sha) : status;
+    }
+
+    state.their_sha = their_sha;
+    state.tree_sha = root_entry.sha;
+    for (const auto &conflict : result.conflicts)
+    {
+        state.conflicts.push_back(conflict.path);
+    }
+    status = repo.restore_working_tree(root_entry.sha);
+    return status.ok() ? write_merge_state(repo, state) : status;
+}
+
+Status abort_merge(Repository &repo)
+{
+    MergeState state;
+    if (!read_merge_state(repo, state))
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: There is no merge to abort.");
+    }
+    clear_merge_state(repo);
+    std::string head_sha;
+    Status status = repo.read_head(head_sha);
+    return status.ok() ? repo.checkout(head_sha) : status;
+}
+
+bool read_merge_state(const Repository &repo, MergeState &state)
+{
+    return read_merge_state_file(merge_state_path(repo), state);
+}
+
+void read_all_merge_states(const Repository &repo, std::vector<MergeState> &states)
+{
+    std::vector<fs::path> paths = {repo.common_dir() / "MERGE_HEAD"};
+    std::error_code ec;
+    for (const auto &worktree : fs::directory_iterator(repo.common_dir() / "worktrees", ec))
+    {
+        paths.push_back(worktree.path() / "MERGE_HEAD");
+    }
+    for (const auto &path : paths)
+    {
+        MergeState state;
+        if (read_merge_state_file(path, state))
+        {
+            states.push_back(std::move(state));
+        }
+    }
+}
+
+void clear_merge_state(const Repository &repo)
+{
+    std::error_code ec;
+    fs::remove(merge_state_path(repo), ec);
+}
@@ -0,0 +1,436 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include "headers/batch_io.h"
+#include "headers/object_pipeline.h"
+#include "headers/utils.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+// Most files the reader or writer hands to BatchIO at once, and most bytes
+// of them. A file bigger than IO_BATCH_BYTES goes through on its own.
+const size_t IO_BATCH = 32;
+const size_t IO_BATCH_BYTES = 8 << 20;
+
+double elapsed_ms(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+struct Item
+{
+    size_t slot = 0;
+    fs::path path;
+    std::string type = "blob";
+    std::string header;
+    std::string data;
+    std::string sha;
+    size_t file_size = 0; // As stat() saw it when queued; 0 if unknown
+
+    size_t weight() const { return data.size() + path.native().size(); }
+    // What a batch holding this item takes: its data, or the file to be read
+    size_t batch_bytes() const { return data.empty() ? file_size : data.size(); }
+};
+
+// Blocking queue bounded by item count and by bytes. A single item larger
+// than the byte limit is still let through once the queue is empty.
+class WorkQueue
+{
+public:
+    WorkQueue(std::string name, size_t max_items, size_t max_bytes)
+        : name_(std::move(name)), max_items_(max_items), max_bytes_(max_bytes)
+    {
+    }
+
+    void push(Item item)
+    {
+        size_t weight = item.weight();
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto start = Clock::now();
+        not_full_.wait(lock, [&] {
+            return items_.empty() || (items_.size() < max_items_ && bytes_ + weight <= max_bytes_);
+        });
+        push_wait_ += Clock::now() - start;
+
+        bytes_ += weight;
+        items_.push_back(std::move(item));
+        max_depth_ = std::max(max_depth_, items_.size());
+        depth_sum_ += items_.size();
+        ++pushes_;
+        not_empty_.notify_one();
+    }
+
+    // Returns false once the queue is closed and drained.
+    bool pop(Item &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto start = Clock::now();
+        not_empty_.wait(lock, [&] { return !items_.empty() || closed_; });
+        pop_wait_ += Clock::now() - start;
+        if (items_.empty())
+        {
+            return false;
+        }
+
+        item = std::move(items_.front());
+        items_.pop_front();
+        bytes_ -= item.weight();
+        not_full_.notify_all();
+        return true;
+    }
+
+    // Takes more items without waiting, up to `limit` items and
+    // `max_bytes` of batch_bytes() in total, so a stage can handle whatever
+    // has queued up as one batch.
+    void pop_more(std::vector<Item> &items, size_t limit, size_t max_bytes)
+    {
+        size_t batch_bytes = 0;
+        for (const auto &item : items)
+        {
+            batch_bytes += item.batch_bytes();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (items.size() < limit && !items_.empty() && batch_bytes + items_.front().batch_bytes() <= max_bytes)
+        {
+            batch_bytes += items_.front().batch_bytes();
+            bytes_ -= items_.front().weight();
+            items.push_back(std::move(items_.front()));
+            items_.pop_front();
+        }
+        not_full_.notify_all();
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+    PipelineQueueStats stats() const
+    {
+        return {name_, max_items_, max_depth_, pushes_ ? static_cast<double>(depth_sum_) / pushes_ : 0.0};
+    }
+    double push_wait_ms() const { return elapsed_ms(push_wait_); }
+    double pop_wait_ms() const { return elapsed_ms(pop_wait_); }
+
+private:
+    std::string name_;
+    size_t max_items_;
+    size_t max_bytes_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<Item> items_;
+    size_t bytes_ = 0;
+    bool closed_ = false;
+
+    size_t max_depth_ = 0;
+    size_t depth_sum_ = 0;
+    size_t pushes_ = 0;
+    Clock::duration push_wait_{};
+    Clock::duration pop_wait_{};
+};
+
+// Work done by one stage, kept by the thread running it
+struct StageClock
+{
+    size_t items = 0;
+    size_t bytes = 0;
+    Clock::duration busy{};
+};
+} // namespace
+
+struct ObjectPipeline::State
+{
+    Repository &repo;
+    Clock::time_point started = Clock::now();
+
+    WorkQueue read_queue;
+    WorkQueue hash_queue;
+    WorkQueue compress_queue;
+    WorkQueue write_queue;
+    std::thread reader, hasher, compressor, writer;
+    StageClock read_clock, hash_clock, inline_hash_clock, compress_clock, write_clock;
+
+    std::mutex mutex; // Guards everything below
+    std::vector<std::string> file_shas;
+    std::unordered_set<std::string> claimed;
+    size_t already_stored = 0;
+    Status error;
+    bool finished = false;
+
+    State(Repository &repo, size_t items, size_t bytes)
+        : repo(repo), read_queue("read", items, bytes), hash_queue("hash", items, bytes),
+          compress_queue("compress", items, bytes), write_queue("write", items, bytes)
+    {
+    }
+
+    bool failed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !error.ok();
+    }
+
+    void fail(Status status)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error.ok())
+        {
+            error = std::move(status);
+        }
+    }
+
+    // True if this caller should store `sha`: nobody stored or queued it yet.
+    bool claim(const std::string &sha)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!claimed.insert(sha).second)
+            {
+                ++already_stored;
+                return false;
+            }
+        }
+        if (repo.freshen_object(sha))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++already_stored;
+            return false;
+        }
+        return true;
+    }
+
+    void run_reader()
+    {
+        std::unique_ptr<BatchIO> io = BatchIO::create();
+        std::vector<Item> batch(1);
+        while (read_queue.pop(batch[0]))
+        {
+            read_queue.pop_more(batch, IO_BATCH, IO_BATCH_BYTES);
+            if (failed())
+            {
+                batch.resize(1);
+                continue;
+            }
+
+            auto start = Clock::now();
+            std::vector<FileRead> reads(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                reads[i].path = batch[i].path;
+            }
+            io->read_files(reads);
+            read_clock.busy += Clock::now() - start;
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                Item &item = batch[i];
+                if (reads[i].error)
+                {
+                    fail(Status::error(ErrorCode::IoError, "Error: Unable to read " + item.path.string()));
+                    continue;
+                }
+                item.data = std::move(reads[i].data);
+                item.header = object_header(item.type, item.data.size());
+                ++read_clock.items;
+                read_clock.bytes += item.data.size();
+                hash_queue.push(std::move(item));
+            }
+            batch.resize(1);
+        }
+    }
+
+    void run_hasher()
+    {
+        Item item;
+        while (hash_queue.pop(item))
+        {
+            auto start = Clock::now();
+            Sha1Stream sha1;
+            sha1.update(item.header);
+            sha1.update(item.data);
+            item.sha = sha1.hex_digest();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                file_shas[item.slot] = item.sha;
+            }
+            bool store = claim(item.sha);
+            hash_clock.busy += Clock::now() - start;
+            ++hash_clock.items;
+            hash_clock.bytes += item.data.size();
+            if (store)
+            {
+                compress_queue.push(std::move(item));
+            }
+        }
+    }
+
+    void run_compressor()
+    {
+        Item item;
+        while (compress_queue.pop(item))
+        {
+            auto start = Clock::now();
+            compress_clock.bytes += item.data.size();
+            item.data = compress_data(item.data);
+            compress_clock.busy += Clock::now() - start;
+            ++compress_clock.items;
+            write_queue.push(std::move(item));
+        }
+    }
+
+    void run_writer()
+    {
+        std::unique_ptr<BatchIO> io = BatchIO::create();
+        std::vector<Item> batch(1);
+        while (write_queue.pop(batch[0]))
+        {
+            write_queue.pop_more(batch, IO_BATCH, IO_BATCH_BYTES);
+            if (failed())
+            {
+                batch.resize(1);
+                continue;
+            }
+
+            // Objects go to temporary files first and are renamed into place
+            auto start = Clock::now();
+            std::vector<FileWrite> writes(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                writes[i].path = repo.temp_object_path();
+                writes[i].data = batch[i].header + batch[i].data;
+                write_clock.bytes += writes[i].data.size();
+            }
+            io->write_files(writes);
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                std::error_code ec;
+                if (writes[i].error)
+                {
+                    fs::remove(writes[i].path, ec);
+                    fail(Status::error(ErrorCode::IoError, "Error: Unable to write object " + writes[i].path.string()));
+                    continue;
+                }
+                Status status = repo.store_raw_object(batch[i].sha, writes[i].path);
+                if (!status.ok())
+                {
+                    fail(status);
+                }
+                ++write_clock.items;
+            }
+            write_clock.busy += Clock::now() - start;
+            batch.resize(1);
+        }
+    }
+};
+
+ObjectPipeline::ObjectPipeline(Repository &repo, size_t queue_items, size_t queue_bytes)
+    : state_(std::make_unique<State>(repo, queue_items, queue_bytes))
+{
+    State &state = *state_;
+    state.reader = std::thread([&state] { state.run_reader(); });
+    state.hasher = std::thread([&state] { state.run_hasher(); });
+    state.compressor = std::thread([&state] { state.run_compressor(); });
+    state.writer = std::thread([&state] { state.run_writer(); });
+}
+
+ObjectPipeline::~ObjectPipeline()
+{
+    std::vector<std::string> ignored;
+    finish(ignored);
+}
+
+size_t ObjectPipeline::add_file(const fs::path &path, size_t size)
+{
+    Item item;
+    item.path = path;
+    item.file_size = size;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        item.slot = state_->file_shas.size();
+        state_->file_shas.emplace_back();
+    }
+    size_t slot = item.slot;
+    state_->read_queue.push(std::move(item));
+    return slot;
+}
+
+std::string ObjectPipeline::add_object(const std::string &type, std::string content)
+{
+    auto start = Clock::now();
+    Item item;
+    item.type = type;
+    item.header = object_header(type, content.size());
+    Sha1Stream sha1;
+    sha1.update(item.header);
+    sha1.update(content);
+    item.sha = sha1.hex_digest();
+    item.data = std::move(content);
+
+    StageClock &clock = state_->inline_hash_clock;
+    clock.busy += Clock::now() - start;
+    ++clock.items;
+    clock.bytes += item.data.size();
+
+    std::string sha = item.sha;
+    if (state_->claim(sha))
+    {
+        state_->compress_queue.push(std::move(item));
+    }
+    return sha;
+}
+
+Status ObjectPipeline::finish(std::vector<std::string> &file_shas, PipelineReport *report)
+{
+    State &state = *state_;
+    if (!state.finished)
+    {
+        // Each stage ends once its input is closed and drained
+        state.read_queue.close();
+        state.reader.join();
+        state.hash_queue.close();
+        state.hasher.join();
+        state.compress_queue.close();
+        state.compressor.join();
+        state.write_queue.close();
+        state.writer.join();
+        state.finished = true;
+    }
+
+    if (report)
+    {
+        StageClock hash_clock = state.hash_clock;
+        hash_clock.items += state.inline_hash_clock.items;
+        hash_clock.bytes += state.inline_hash_clock.bytes;
+        hash_clock.busy += state.inline_hash_clock.busy;
+
+        auto stage = [](const char *name, const StageClock &clock, const WorkQueue &input, const WorkQueue *output) {
+            return PipelineStageStats{name,
+                                      clock.items,
+                                      clock.bytes,
+                                      elapsed_ms(clock.busy),
+                                      input.pop_wait_ms(),
+                                      output ? output->push_wait_ms() : 0.0};
+        };
+        report->wall_ms = elapsed_ms(Clock::now() - state.started);
+        report->already_stored = state.already_stored;
+        report->stages = {stage("read", state.read_clock, state.read_queue, &state.hash_queue),
+                          stage("hash", hash_clock, state.hash_queue, &state.compress_queue),
+                          stage("compress", state.compress_clock, state.compress_queue, &state.write_queue),
+                          stage("write", state.write_clock, state.write_queue, nullptr)};
+        report->queues = {state.read_queue.stats(), state.hash_queue.stats(), state.compress_queue.stats(),
+                          state.write_queue.stats()};
+    }
+
+    file_shas = state.file_shas;
+    return state.error;
+}
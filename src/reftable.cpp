@@ -0,0 +1,519 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "headers/reftable.h"
+#include "headers/utils.h"
+
+namespace
+{
+const char MAGIC[] = "MGRT";
+const uint8_t VERSION = 1;
+const size_t HEADER_SIZE = 12;
+const size_t FOOTER_SIZE = 28;
+const size_t SHA_BYTES = 20;
+// Every 16th record in a block stores its whole name
+const size_t RESTART_INTERVAL = 16;
+
+void put_u32(std::string &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out += static_cast<char>((value >> shift) & 0xff);
+    }
+}
+
+void put_u64(std::string &out, uint64_t value)
+{
+    put_u32(out, static_cast<uint32_t>(value >> 32));
+    put_u32(out, static_cast<uint32_t>(value));
+}
+
+void put_varint(std::string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+uint64_t get_be(const unsigned char *at, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        value = (value << 8) | at[i];
+    }
+    return value;
+}
+
+// Bounds-checked reads from the mapped file; any overrun sets `failed`
+struct Cursor
+{
+    const unsigned char *at;
+    const unsigned char *end;
+    bool failed = false;
+
+    bool has(size_t bytes)
+    {
+        failed = failed || static_cast<size_t>(end - at) < bytes;
+        return !failed;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && has(1); shift += 7)
+        {
+            unsigned char byte = *at++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        failed = true;
+        return 0;
+    }
+
+    uint64_t fixed(size_t bytes)
+    {
+        if (!has(bytes))
+        {
+            return 0;
+        }
+        uint64_t value = get_be(at, bytes);
+        at += bytes;
+        return value;
+    }
+
+    const char *bytes(size_t count)
+    {
+        if (!has(count))
+        {
+            return nullptr;
+        }
+        const char *start = reinterpret_cast<const char *>(at);
+        at += count;
+        return start;
+    }
+};
+
+std::string to_binary_sha(const std::string &hex)
+{
+    std::string binary(SHA_BYTES, '\0');
+    for (size_t i = 0; i < SHA_BYTES; ++i)
+    {
+        binary[i] = static_cast<char>(std::stoi(hex.substr(i * 2, 2), nullptr, 16));
+    }
+    return binary;
+}
+
+std::string to_hex_sha(const char *binary)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(SHA_BYTES * 2, '0');
+    for (size_t i = 0; i < SHA_BYTES; ++i)
+    {
+        unsigned char byte = static_cast<unsigned char>(binary[i]);
+        hex[i * 2] = digits[byte >> 4];
+        hex[i * 2 + 1] = digits[byte & 0xf];
+    }
+    return hex;
+}
+
+std::string encode_record(const std::string &previous, const std::string &name, const std::string &binary_sha)
+{
+    size_t shared = 0;
+    while (shared < previous.size() && shared < name.size() && previous[shared] == name[shared])
+    {
+        ++shared;
+    }
+    std::string record;
+    put_varint(record, shared);
+    put_varint(record, name.size() - shared);
+    record.append(name, shared, std::string::npos);
+    record += binary_sha;
+    return record;
+}
+
+Status corrupt(const fs::path &path)
+{
+    return Status::error(ErrorCode::Corrupt, "Error: Ref table " + path.string() + " is corrupt.");
+}
+} // namespace
+
+RefTable::~RefTable()
+{
+    if (data_)
+    {
+        munmap(const_cast<unsigned char *>(data_), size_);
+    }
+}
+
+RefTable::RefTable(RefTable &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+RefTable &RefTable::operator=(RefTable &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (data_)
+        {
+            munmap(const_cast<unsigned char *>(data_), size_);
+        }
+        path_ = std::move(other.path_);
+        data_ = other.data_;
+        size_ = other.size_;
+        index_offset_ = other.index_offset_;
+        block_count_ = other.block_count_;
+        ref_count_ = other.ref_count_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.block_count_ = 0;
+        other.ref_count_ = 0;
+    }
+    return *this;
+}
+
+Status RefTable::open(const fs::path &path, RefTable &table)
+{
+    table = RefTable();
+    table.path_ = path;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno == ENOENT ? Status() : Status::error(ErrorCode::IoError, "Error: Unable to read " + path.string());
+    }
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= HEADER_SIZE + FOOTER_SIZE)
+    {
+        mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return corrupt(path);
+    }
+    table.data_ = static_cast<const unsigned char *>(mapped);
+    table.size_ = info.st_size;
+
+    const unsigned char *footer = table.data_ + table.size_ - FOOTER_SIZE;
+    table.index_offset_ = get_be(footer, 8);
+    table.block_count_ = static_cast<uint32_t>(get_be(footer + 8, 4));
+    table.ref_count_ = get_be(footer + 12, 8);
+    size_t index_end = table.size_ - FOOTER_SIZE;
+    if (std::memcmp(table.data_, MAGIC, 4) != 0 || table.data_[4] != VERSION ||
+        std::memcmp(footer + 24, MAGIC, 4) != 0 || table.index_offset_ < HEADER_SIZE ||
+        table.index_offset_ > index_end || (index_end - table.index_offset_) / 4 < table.block_count_)
+    {
+        return corrupt(path);
+    }
+    return {};
+}
+
+std::string RefTable::encode(const std::map<std::string, std::string> &refs, uint32_t block_size)
+{
+    std::string out(MAGIC, 4);
+    out += static_cast<char>(VERSION);
+    out.append(3, '\0');
+    put_u32(out, block_size);
+
+    std::string index;
+    std::vector<uint32_t> entries;
+    std::string block;
+    std::vector<uint16_t> restarts;
+    size_t records = 0;
+    std::string first_name;
+    std::string previous;
+    auto flush = [&] {
+        for (uint16_t restart : restarts)
+        {
+            block += static_cast<char>(restart >> 8);
+            block += static_cast<char>(restart & 0xff);
+        }
+        block += static_cast<char>(restarts.size() >> 8);
+        block += static_cast<char>(restarts.size() & 0xff);
+        entries.push_back(static_cast<uint32_t>(index.size()));
+        put_varint(index, first_name.size());
+        index += first_name;
+        put_u64(index, out.size());
+        put_u32(index, static_cast<uint32_t>(block.size()));
+        out += block;
+        block.clear();
+        restarts.clear();
+        records = 0;
+    };
+    for (const auto &[name, sha] : refs)
+    {
+        std::string binary_sha = to_binary_sha(sha);
+        bool restart = records % RESTART_INTERVAL == 0;
+        std::string record = encode_record(restart ? "" : previous, name, binary_sha);
+        size_t trailer = 2 * (restarts.size() + (restart ? 1 : 0)) + 2;
+        if (records > 0 && block.size() + record.size() + trailer > block_size)
+        {
+            flush();
+            restart = true;
+            record = encode_record("", name, binary_sha);
+        }
+        if (records == 0)
+        {
+            first_name = name;
+        }
+        if (restart)
+        {
+            restarts.push_back(static_cast<uint16_t>(block.size()));
+        }
+        block += record;
+        previous = name;
+        ++records;
+    }
+    if (records > 0)
+    {
+        flush();
+    }
+
+    uint64_t index_offset = out.size();
+    out += index;
+    for (uint32_t entry : entries)
+    {
+        put_u32(out, entry);
+    }
+    put_u64(out, index_offset);
+    put_u32(out, static_cast<uint32_t>(entries.size()));
+    put_u64(out, refs.size());
+    put_u32(out, crc32(0, reinterpret_cast<const Bytef *>(out.data()), out.size()));
+    out.append(MAGIC, 4);
+    return out;
+}
+
+// Whether block `block`'s first name, read straight from the index, sorts
+// at or before `name`
+bool RefTable::block_starts_at_most(size_t block, const std::string &name) const
+{
+    const unsigned char *entries = data_ + size_ - FOOTER_SIZE - 4 * static_cast<size_t>(block_count_);
+    Cursor cursor{data_ + index_offset_ + get_be(entries + 4 * block, 4), entries};
+    size_t length = cursor.varint();
+    const char *first = cursor.bytes(length);
+    return first && name.compare(0, std::string::npos, first, length) >= 0;
+}
+
+// The last block whose first name is not after `name`, or block_count_ if
+// `name` sorts before every ref
+size_t RefTable::find_block(const std::string &name) const
+{
+    size_t low = 0;
+    size_t high = block_count_;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (block_starts_at_most(middle, name))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low == 0 ? block_count_ : low - 1;
+}
+
+// Decodes block `block` from its last restart point at or before `from`,
+// calling `visit` until it returns false
+Status RefTable::scan_block(size_t block, const std::string &from,
+                            const std::function<bool(const std::string &name, const char *binary_sha)> &visit,
+                            bool &stopped) const
+{
+    const unsigned char *entries = data_ + size_ - FOOTER_SIZE - 4 * static_cast<size_t>(block_count_);
+    Cursor entry{data_ + index_offset_ + get_be(entries + 4 * block, 4), entries};
+    entry.bytes(entry.varint());
+    uint64_t offset = entry.fixed(8);
+    uint64_t length = entry.fixed(4);
+    if (entry.failed || offset < HEADER_SIZE || offset > index_offset_ || length > index_offset_ - offset ||
+        length < 2)
+    {
+        return corrupt(path_);
+    }
+    const unsigned char *start = data_ + offset;
+    size_t restart_count = get_be(start + length - 2, 2);
+    if (restart_count == 0 || length < 2 + 2 * restart_count)
+    {
+        return corrupt(path_);
+    }
+    const unsigned char *restarts = start + length - 2 - 2 * restart_count;
+
+    // Restart records store their whole name, so they can be compared in place
+    size_t low = 0;
+    size_t high = restart_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        Cursor cursor{start + get_be(restarts + 2 * middle, 2), restarts};
+        size_t shared = cursor.varint();
+        size_t name_length = cursor.varint();
+        const char *name = cursor.bytes(name_length);
+        if (cursor.failed || shared != 0)
+        {
+            return corrupt(path_);
+        }
+        if (from.compare(0, std::string::npos, name, name_length) >= 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    Cursor cursor{start + get_be(restarts + 2 * (low == 0 ? 0 : low - 1), 2), restarts};
+    std::string name;
+    stopped = false;
+    while (cursor.at < cursor.end && !stopped)
+    {
+        size_t shared = cursor.varint();
+        size_t suffix_length = cursor.varint();
+        const char *suffix = cursor.bytes(suffix_length);
+        const char *sha = cursor.bytes(SHA_BYTES);
+        if (cursor.failed || shared > name.size())
+        {
+            return corrupt(path_);
+        }
+        name.resize(shared);
+        name.append(suffix, suffix_length);
+        stopped = !visit(name, sha);
+    }
+    return {};
+}
+
+Status RefTable::lookup(const std::string &name, std::string &sha) const
+{
+    sha.clear();
+    size_t block = find_block(name);
+    if (block == block_count_)
+    {
+        return {};
+    }
+    bool stopped = false;
+    return scan_block(block, name, [&](const std::string &found, const char *binary_sha) {
+        if (found == name)
+        {
+            sha = to_hex_sha(binary_sha);
+        }
+        return found < name;
+    }, stopped);
+}
+
+Status RefTable::list(const std::string &prefix, std::map<std::string, std::string> &refs) const
+{
+    size_t block = find_block(prefix);
+    bool stopped = false;
+    for (block = block == block_count_ ? 0 : block; block < block_count_ && !stopped; ++block)
+    {
+        Status status = scan_block(block, prefix, [&](const std::string &name, const char *binary_sha) {
+            if (name.compare(0, prefix.size(), prefix) == 0)
+            {
+                refs[name] = to_hex_sha(binary_sha);
+            }
+            return name < prefix || name.compare(0, prefix.size(), prefix) == 0;
+        }, stopped);
+        if (!status.ok())
+        {
+            return status;
+        }
+    }
+    return {};
+}
+
+bool RefTable::verify() const
+{
+    if (!data_)
+    {
+        return true;
+    }
+    size_t covered = size_ - 8;
+    uLong crc = crc32(0, reinterpret_cast<const Bytef *>(data_), covered);
+    return crc == get_be(data_ + covered, 4);
+}
+
+RefTableLock::~RefTableLock()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        unlink(lock_path_.c_str());
+    }
+}
+
+Status RefTableLock::acquire(const fs::path &table_path)
+{
+    table_path_ = table_path;
+    lock_path_ = table_path.string() + ".lock";
+    fd_ = ::open(lock_path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to lock " + lock_path_.string() +
+                                                     (errno == EEXIST ? ": another process is updating refs." : "."));
+    }
+    return {};
+}
+
+Status RefTableLock::commit(const std::map<std::string, std::string> &refs)
+{
+    std::string table = RefTable::encode(refs);
+    size_t written = 0;
+    while (written < table.size())
+    {
+        ssize_t result = write(fd_, table.data() + written, table.size() - written);
+        if (result <= 0)
+        {
+            break;
+        }
+        written += result;
+    }
+    bool ok = written == table.size() && fsync(fd_) == 0;
+    close(fd_);
+    fd_ = -1;
+    if (!ok || rename(lock_path_.c_str(), table_path_.c_str()) != 0)
+    {
+        unlink(lock_path_.c_str());
+        return Status::error(ErrorCode::IoError, "Error: Unable to write " + table_path_.string());
+    }
+    return {};
+}
+
+bool is_valid_ref_name(const std::string &name)
+{
+    if (name.empty() || name.back() == '/' || name.front() == '-' ||
+        (name.size() >= 5 && name.compare(name.size() - 5, 5, ".lock") == 0))
+    {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size())
+    {
+        size_t slash = name.find('/', start);
+        size_t end = slash == std::string::npos ? name.size() : slash;
+        if (end == start || name[start] == '.')
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    for (char c : name)
+    {
+        if (static_cast<unsigned char>(c) <= ' ' || c == 0x7f || std::strchr("~^:?*[\\", c))
+        {
+            return false;
+        }
+    }
+    return name.find("..") == std::string::npos && name.find("@{") == std::string::npos;
+}
@@ -1,615 +1,1655 @@
-#include <iostream>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
-#include <openssl/sha.h>
-#include <openssl/evp.h>
-#include <zlib.h>
 #include <iomanip>
 #include <map>
 #include <ctime>
+#include <cstdio>
 #include <algorithm>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "headers/repository.h"
+#include "headers/batch_io.h"
+#include "headers/chunking.h"
+#include "headers/merge.h"
+#include "headers/object_pipeline.h"
+#include "headers/reftable.h"
+#include "headers/scanner.h"
+#include "headers/sparse.h"
+#include "headers/tree_builder.h"
 #include "headers/utils.h"
-#include <queue>
+#include "headers/worktree.h"
 
 namespace fs = std::filesystem;
 
-struct Commit
+namespace
 {
-    std::string tree_sha;
-    std::string parent_sha;
-    std::string message;
-    std::string author;
-    std::string committer;
-    std::string timestamp;
+const std::string HEAD_REF = "refs/heads/master";
+const size_t CHECKOUT_BATCH = 128;
+const size_t DEFAULT_CHUNK_THRESHOLD = 8 << 20;
+// An index entry with this mode stages the path's deletion
+const std::string DELETED_MODE = "000000";
 
-    std::string serialize() const
-    {
-        std::ostringstream oss;
-        oss << "tree " << tree_sha << "\n";
-        if (!parent_sha.empty())
-        {
-            oss << "parent " << parent_sha << "\n";
-        }
-        oss << "author " << author << " " << timestamp << "\n";
-        oss << "committer " << committer << " " << timestamp << "\n";
-        oss << "\n"
-            << message << "\n";
-        return oss.str();
-    }
-};
+Status io_error(const std::string &what, const fs::path &path)
+{
+    return Status::error(ErrorCode::IoError, "Error: " + what + " " + path.string());
+}
 
-void init_repository()
+// Index and tree entries are named by their path relative to the repository
+// root, always with forward slashes.
+std::string relative_name(const fs::path &path, const fs::path &root)
 {
-    fs::create_directories(".mygit/objects");
-    std::ofstream index_file(".mygit/index");
-    fs::create_directories(".mygit/refs/heads");
-    std::ofstream master_file(".mygit/refs/heads/master");
-    master_file.close();
-    index_file.close();
+    return path.lexically_relative(root).lexically_normal().generic_string();
 }
 
-void add_to_index(const std::string &file_path, const std::string &sha, const std::string &mode)
+std::string trim(const std::string &text)
 {
-    std::ofstream index_file(".mygit/index", std::ios::app);
-    if (index_file)
-    {
-        index_file << mode << " " << file_path << " " << sha << "\n";
-    }
+    std::size_t first = text.find_first_not_of(" \t\r");
+    std::size_t last = text.find_last_not_of(" \t\r");
+    return first == std::string::npos ? "" : text.substr(first, last - first + 1);
 }
 
-std::string get_file_mode(const fs::path &file_path)
+// "8388608", "8M", "512k"; returns false on anything else.
+bool parse_byte_size(const std::string &text, size_t &bytes)
 {
-    auto status = fs::status(file_path);
-    if (fs::is_regular_file(status))
+    size_t used = 0;
+    try
+    {
+        bytes = std::stoull(text, &used);
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    std::string suffix = text.substr(used);
+    if (suffix == "k" || suffix == "K")
     {
-        return "100644"; // Regular file mode
+        bytes <<= 10;
     }
-    else if (fs::is_directory(status))
+    else if (suffix == "m" || suffix == "M")
     {
-        return "40000"; // Directory mode
+        bytes <<= 20;
     }
-    // Additional modes can be added as needed
-    return "000000"; // Unknown or unsupported file type
+    else if (suffix == "g" || suffix == "G")
+    {
+        bytes <<= 30;
+    }
+    else if (!suffix.empty())
+    {
+        return false;
+    }
+    return true;
 }
 
-void add_file(const fs::path &file_path)
+Status chunk_threshold(const Repository &repo, size_t &bytes)
 {
-    std::string file_content = read_file_content(file_path);
-    std::string sha = get_or_create_blob(file_content);
-    std::string mode = get_file_mode(file_path);
-    add_to_index(file_path.string(), sha, mode);
+    bytes = DEFAULT_CHUNK_THRESHOLD;
+    std::string setting = repo.config_value("chunking.threshold");
+    if (!setting.empty() && !parse_byte_size(setting, bytes))
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid chunking.threshold in .mygit/config.");
+    }
+    return {};
 }
 
-void add_files(const std::vector<std::string> &files)
+// Splits an object file as stored (uncompressed header, then zlib data) and
+// inflates it.
+Status parse_stored_object(const std::string &sha, const std::string &stored, Object &object)
+{
+    std::size_t null_pos = stored.find('\0');
+    size_t original_size = 0;
+    if (null_pos == std::string::npos || !parse_object_header(stored.substr(0, null_pos), object.type, original_size))
+    {
+        return Status::error(ErrorCode::Corrupt, "Error: Object " + sha + " has an invalid header.");
+    }
+
+    object.content = decompress_data(stored.data() + null_pos + 1, stored.size() - null_pos - 1, original_size);
+    if (object.content.size() != original_size)
+    {
+        return Status::error(ErrorCode::Corrupt, "Error: Object " + sha + " could not be decompressed.");
+    }
+    return {};
+}
+// Small LRU of inflated objects, bounded by total content bytes, so repeated
+// reads of the same trees and blobs skip both the disk and zlib.
+class ObjectCache
 {
-    for (const auto &file : files)
+public:
+    explicit ObjectCache(size_t byte_budget) : byte_budget_(byte_budget) {}
+
+    const Object *find(const std::string &sha)
     {
-        fs::path file_path(file);
-        if (fs::exists(file_path) && fs::is_regular_file(file_path))
+        auto it = index_.find(sha);
+        if (it == index_.end())
         {
-            add_file(file_path);
+            return nullptr;
         }
-        else if (fs::is_directory(file_path))
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &it->second->second;
+    }
+
+    void insert(const std::string &sha, Object object)
+    {
+        if (object.content.size() > byte_budget_ / 4 || index_.count(sha))
         {
-            for (auto &p : fs::recursive_directory_iterator(file_path))
-            {
-                if (fs::is_regular_file(p.path()))
-                {
-                    add_file(p.path());
-                }
-            }
+            return; // Too big to be worth evicting everything else for
         }
-        else
+
+        bytes_used_ += object.content.size();
+        entries_.emplace_front(sha, std::move(object));
+        index_[sha] = entries_.begin();
+
+        while (bytes_used_ > byte_budget_)
         {
-            std::cerr << "Warning: " << file << " not found.\n";
+            bytes_used_ -= entries_.back().second.content.size();
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
         }
     }
-}
 
-std::map<std::string, TreeEntry> read_from_index()
+private:
+    typedef std::list<std::pair<std::string, Object>> EntryList;
+
+    size_t byte_budget_;
+    size_t bytes_used_ = 0;
+    EntryList entries_;
+    std::unordered_map<std::string, EntryList::iterator> index_;
+};
+} // namespace
+
+struct Repository::Cache
 {
+    explicit Cache(size_t object_cache_bytes) : objects(object_cache_bytes) {}
+
+    ObjectCache objects;
+
+    // Parsed index, trusted while the file's size and mtime are unchanged.
+    bool index_valid = false;
+    fs::file_time_type index_mtime;
+    std::uintmax_t index_size = 0;
     std::map<std::string, TreeEntry> index_entries;
-    std::ifstream index_file(".mygit/index");
 
-    std::string mode, path, sha;
-    while (index_file >> mode >> path >> sha)
+    // Mapped ref table, trusted while the file's inode, size and mtime are
+    // unchanged; updates always rename a new file into place.
+    bool ref_table_valid = false;
+    struct stat ref_table_stat = {};
+    RefTable ref_table;
+
+    // Recursive listing of the last tree write_tree started from.
+    std::string head_tree_sha;
+    std::map<std::string, TreeEntry> head_tree_entries;
+
+    // Blob IDs of working tree files hashed since they last changed; only
+    // consulted when someone is watching the working tree for changes.
+    bool working_tree_watched = false;
+    std::map<std::string, std::string> clean_files;
+
+    bool index_stamp_matches(const fs::path &index_path) const
     {
-        index_entries[path] = {mode, path, sha};
+        std::error_code ec;
+        return index_valid && fs::file_size(index_path, ec) == index_size &&
+               fs::last_write_time(index_path, ec) == index_mtime && !ec;
     }
 
-    return index_entries;
-}
+    void stamp_index(const fs::path &index_path)
+    {
+        std::error_code ec;
+        index_size = fs::file_size(index_path, ec);
+        index_mtime = fs::last_write_time(index_path, ec);
+        index_valid = !ec;
+    }
+};
 
-std::map<std::string, std::vector<std::string>> create_tree_from_index(const std::map<std::string, TreeEntry> &index_entries, std::map<std::string, std::vector<std::string>> &adjList)
+Repository::Repository() = default;
+Repository::~Repository() = default;
+Repository::Repository(Repository &&) noexcept = default;
+Repository &Repository::operator=(Repository &&) noexcept = default;
+
+std::string Commit::serialize() const
 {
-    if (adjList.find("") == adjList.end())
+    std::ostringstream oss;
+    oss << "tree " << tree_sha << "\n";
+    for (const auto &parent : parents)
     {
-        adjList[""] = {};
+        oss << "parent " << parent << "\n";
     }
+    oss << "author " << author << " " << timestamp << "\n";
+    oss << "committer " << committer << " " << timestamp << "\n";
+    oss << "\n"
+        << message << "\n";
+    return oss.str();
+}
 
-    for (const auto &[path, entry] : index_entries)
+int64_t Commit::time() const
+{
+    std::tm parts{};
+    const char *rest = strptime(timestamp.c_str(), "%Y-%m-%d %H:%M:%S", &parts);
+    if (!rest)
+    {
+        return 0;
+    }
+    int64_t seconds = timegm(&parts);
+    int sign = 0, hours = 0, minutes = 0;
+    char sign_char = 0;
+    if (std::sscanf(rest, " %c%2d%2d", &sign_char, &hours, &minutes) == 3)
     {
-        std::string current_path = "";
-        std::istringstream path_stream(path);
-        std::string component;
+        sign = sign_char == '-' ? -1 : 1;
+        seconds -= sign * (hours * 3600 + minutes * 60);
+    }
+    return std::max<int64_t>(seconds, 0);
+}
+
+bool Commit::parse(const std::string &content, Commit &commit)
+{
+    std::istringstream commit_stream(content);
+    std::string line;
 
-        while (std::getline(path_stream, component, '/'))
+    // Identity lines are "<name> <<email>> <timestamp>"; the timestamp is
+    // everything after the closing '>'.
+    auto split_identity = [&commit](const std::string &value, std::string &identity) {
+        std::size_t email_end = value.find('>');
+        if (email_end == std::string::npos)
         {
-            std::string next_path = current_path.empty() ? component : current_path + "/" + component;
-            auto &children = adjList[current_path];
-            if (std::find(children.begin(), children.end(), next_path) == children.end())
-            {
-                children.push_back(next_path);
-            }
-            current_path = next_path;
+            identity = value;
+            return;
         }
-
-        if (adjList.find(current_path) == adjList.end())
+        identity = value.substr(0, email_end + 1);
+        if (email_end + 2 <= value.size())
         {
-            adjList[current_path] = {};
+            commit.timestamp = value.substr(email_end + 2);
         }
-    }
+    };
 
-    for (const auto &[path, entry] : index_entries)
+    while (std::getline(commit_stream, line) && !line.empty())
     {
-        if (adjList.find(path) == adjList.end())
+        if (line.rfind("tree ", 0) == 0)
+        {
+            commit.tree_sha = line.substr(5);
+        }
+        else if (line.rfind("parent ", 0) == 0)
         {
-            adjList[path] = {};
+            commit.parents.push_back(line.substr(7));
+        }
+        else if (line.rfind("author ", 0) == 0)
+        {
+            split_identity(line.substr(7), commit.author);
+        }
+        else if (line.rfind("committer ", 0) == 0)
+        {
+            split_identity(line.substr(10), commit.committer);
         }
     }
 
-    return adjList;
-}
-std::map<std::string, TreeEntry> read_tree(const std::string &tree_sha)
-{
-    std::map<std::string, TreeEntry> tree_entries;
-    populate_tree_entries(tree_sha, tree_entries);
-    return tree_entries;
+    std::ostringstream message;
+    message << commit_stream.rdbuf();
+    commit.message = message.str();
+    if (!commit.message.empty() && commit.message.back() == '\n')
+    {
+        commit.message.pop_back();
+    }
+    return commit.tree_sha.size() == 40;
 }
 
-void populate_tree_entries(const std::string &tree_sha, std::map<std::string, TreeEntry> &tree_entries)
+Status Repository::init(const fs::path &root, Repository &repo)
 {
-    std::stringstream buffer;
-    std::streambuf *old_buf = std::cout.rdbuf(buffer.rdbuf());
-
-    cat_file("-p", tree_sha);
-
-    std::cout.rdbuf(old_buf);
-
-    std::string line;
-    while (std::getline(buffer, line))
+    std::error_code ec;
+    fs::path git_dir = fs::absolute(root) / ".mygit";
+    fs::create_directories(git_dir / "objects", ec);
+    fs::create_directories(git_dir / "refs/heads", ec);
+    if (ec)
     {
-        std::istringstream iss(line);
-        std::string mode, name, sha;
-        iss >> mode >> name >> sha;
+        return io_error("Unable to create", git_dir);
+    }
 
-        tree_entries[name] = {mode, name, sha};
+    // Re-running init must not wipe an existing index or history.
+    if (!fs::exists(git_dir / "index"))
+    {
+        std::ofstream create(git_dir / "index");
+    }
+    if (!fs::exists(git_dir / "HEAD"))
+    {
+        std::ofstream create(git_dir / "HEAD");
+        create << "ref: " << HEAD_REF << std::endl;
+    }
+    Status status = open(root, repo);
+    std::string sha;
+    if (status.ok() && repo.read_ref(HEAD_REF, sha).code == ErrorCode::NotFound)
+    {
+        // An empty ref file: master exists but has no commits yet
+        std::ofstream create(git_dir / HEAD_REF);
+    }
+    return status;
+}
 
-        if (mode == "040000")
+Status Repository::open(const fs::path &root, Repository &repo)
+{
+    fs::path absolute_root = fs::absolute(root).lexically_normal();
+    if (!absolute_root.has_filename())
+    {
+        absolute_root = absolute_root.parent_path();
+    }
+    fs::path dot_git = absolute_root / ".mygit";
+    repo.root_ = absolute_root;
+    repo.git_dir_ = dot_git;
+    repo.common_dir_ = dot_git;
+    if (fs::is_regular_file(dot_git))
+    {
+        // A linked worktree: "worktree: <main .mygit>/worktrees/<name>"
+        std::ifstream link_file(dot_git);
+        std::string line;
+        std::getline(link_file, line);
+        if (line.rfind("worktree: ", 0) == 0)
         {
-            populate_tree_entries(sha, tree_entries);
+            repo.git_dir_ = fs::path(trim(line.substr(10)));
+            repo.common_dir_ = repo.git_dir_.parent_path().parent_path();
         }
     }
+    if (!fs::is_directory(repo.git_dir_) || !fs::is_directory(repo.common_dir_ / "objects"))
+    {
+        return Status::error(ErrorCode::NotARepository,
+                             "Error: Not a mygit repository: " + absolute_root.string());
+    }
+    return {};
 }
 
-std::string get_tree_sha_from_commit(const std::string &commit_sha)
+std::string Repository::config_value(const std::string &key, const std::string &fallback) const
 {
-    std::stringstream buffer;
-    std::streambuf *old_buf = std::cout.rdbuf(buffer.rdbuf());
-
-    cat_file("-p", commit_sha);
-
-    std::cout.rdbuf(old_buf);
-
-    std::string line;
-    std::string tree_sha;
-
-    while (std::getline(buffer, line))
+    std::string value = fallback;
+    for (const fs::path &config_path : {common_dir_ / "config", git_dir_ / "config"})
     {
-        if (line.find("tree ") == 0)
+        std::ifstream config_file(config_path);
+        std::string line;
+        while (std::getline(config_file, line))
+        {
+            line = line.substr(0, line.find('#'));
+            std::size_t equals = line.find('=');
+            if (equals != std::string::npos && trim(line.substr(0, equals)) == key)
+            {
+                value = trim(line.substr(equals + 1)); // The last setting wins
+            }
+        }
+        if (!is_linked_worktree())
         {
-            tree_sha = line.substr(5);
             break;
         }
     }
+    return value;
+}
 
-    return tree_sha;
+void Repository::enable_caching(size_t object_cache_bytes, bool working_tree_watched)
+{
+    cache_ = std::make_unique<Cache>(object_cache_bytes);
+    cache_->working_tree_watched = working_tree_watched;
 }
-void create_tree_from_commit(std::map<std::string, std::vector<std::string>> &adjList, const std::string &commit_sha)
+
+// Drops what is known about a path and, if it is a directory, everything
+// below it.
+void Repository::forget_working_tree_path(const std::string &relative_path)
 {
-    std::string tree_sha = get_tree_sha_from_commit(commit_sha);
-    if (tree_sha.empty())
+    if (!cache_)
     {
         return;
     }
+    auto &clean_files = cache_->clean_files;
+    clean_files.erase(relative_path);
+    std::string prefix = relative_path + "/";
+    for (auto it = clean_files.lower_bound(prefix); it != clean_files.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+    {
+        it = clean_files.erase(it);
+    }
+}
 
-    std::map<std::string, TreeEntry> tree_entries = read_tree(tree_sha);
-    create_tree_from_index(tree_entries, adjList);
+void Repository::forget_working_tree()
+{
+    if (cache_)
+    {
+        cache_->clean_files.clear();
+    }
 }
 
-TreeEntry generate_tree_sha(const std::map<std::string, std::vector<std::string>> &adjList,
-                            const std::map<std::string, TreeEntry> &tree_entries,
-                            const std::string &current)
+fs::path Repository::object_path(const std::string &sha) const
 {
-    std::ostringstream serialized_tree;
+    return common_dir_ / "objects" / sha.substr(0, 2) / sha.substr(2);
+}
 
-    // std::cout << "Adjacency List:" << std::endl;
-    // for (const auto &pair : adjList) {
-    //     std::cout << pair.first << ": ";
-    //     for (const auto &child : pair.second) {
-    //         std::cout << child << " ";
-    //     }
-    //     std::cout << std::endl;
-    // }
-    // std::cout << "Generating tree SHA for: " << current << std::endl;
+bool Repository::has_object(const std::string &sha) const
+{
+    return sha.size() == 40 && fs::exists(object_path(sha));
+}
 
-    // Iterate through the children of the current directory
-    for (const auto &child : adjList.at(current))
+Status Repository::list_objects(std::vector<std::string> &shas) const
+{
+    std::error_code ec;
+    for (const auto &directory : fs::directory_iterator(common_dir_ / "objects", ec))
     {
-        std::cout << "  Processing child: " << child << std::endl;
-
-        // Check if the child is a file or a directory
-        if (adjList.at(child).empty())
+        std::string prefix = directory.path().filename().string();
+        if (prefix.size() != 2 || !is_hex_string(prefix) || !directory.is_directory(ec))
         {
-            // It's a file (leaf), retrieve its SHA from tree_entries
-            auto it = tree_entries.find(child);
-            if (it != tree_entries.end())
-            {
-                std::string blob_sha = it->second.sha;                            // Correctly retrieve the SHA of the file
-                serialized_tree << "100644 " << child << " " << blob_sha << '\n'; // Blob entry
-
-                // Debugging output for files
-                std::cout << "    Found file: " << child << " with SHA: " << blob_sha << std::endl;
-            }
-            else
-            {
-                std::cerr << "Error: Leaf file not found in tree_entries: " << child << std::endl;
-                throw std::runtime_error("Leaf file not found in tree_entries: " + child);
-            }
+            continue;
         }
-        else
+        for (const auto &entry : fs::directory_iterator(directory.path(), ec))
         {
-            // It's a directory
-            TreeEntry child_entry = generate_tree_sha(adjList, tree_entries, child);
-
-            // Debugging output for directories
-            std::cout << "    Found directory: " << child_entry.name << " with SHA: " << child_entry.sha << std::endl;
-
-            // Append directory information to serialized tree representation
-            serialized_tree << "040000 " << child_entry.name << " " << child_entry.sha << '\n'; // Directory entry
+            std::string rest = entry.path().filename().string();
+            if (rest.size() == 38 && is_hex_string(rest))
+            {
+                shas.push_back(prefix + rest);
+            }
         }
     }
-
-    // Only create the tree object if the current entry is a directory
-    if (!adjList.at(current).empty())
+    if (ec)
     {
-        // Serialize the tree data after processing all children
-        std::string serialized_data = serialized_tree.str();
-        std::string tree_object = "tree " + std::to_string(serialized_data.size()) + '\0';
-        std::string tree_sha = calculate_sha1(tree_object + serialized_data); // Calculate SHA for the directory tree
-
-        // Debugging output for the tree object
-        std::cout << "  Writing tree object for directory: " << current << " with SHA: " << tree_sha << std::endl;
-
-        // Write the tree object to the object store
-        write_blob(tree_sha, tree_object + compress_data(serialized_data));
-
-        return {"040000", current, tree_sha}; // Returns the current directory's TreeEntry
+        return io_error("Unable to list", common_dir_ / "objects");
     }
-
-    // If current is a directory with no children, return an empty TreeEntry
-    std::cout << "  Current directory is empty: " << current << std::endl;
-    return {"040000", current, ""}; // Returning an empty sha for empty directories
+    std::sort(shas.begin(), shas.end());
+    return {};
 }
 
-TreeEntry write_tree()
+bool Repository::freshen_object(const std::string &sha) const
 {
-    std::map<std::string, std::vector<std::string>> adjList;
-    std::map<std::string, TreeEntry> tree_entries;
+    return sha.size() == 40 && utimensat(AT_FDCWD, object_path(sha).c_str(), nullptr, 0) == 0;
+}
 
-    // Read parent commit SHA if available
-    std::ifstream parent_file(".mygit/refs/heads/master");
-    std::string parent_sha;
-    if (parent_file)
+// Resolves HEAD, a branch, a tag or a full ref name to its commit, or
+// expands an abbreviated (at least 4 hex digits) object name to the full
+// SHA-1 of the one object it matches. Refs win over abbreviations, but a
+// full SHA-1 is taken as is.
+Status Repository::resolve_object_name(const std::string &name, std::string &sha) const
+{
+    if (name == "HEAD")
     {
-        std::getline(parent_file, parent_sha);
-        if (!parent_sha.empty())
-            create_tree_from_commit(adjList, parent_sha); // Populate adjList from the commit tree
+        Status status = read_head(sha);
+        return status.ok() && sha.empty() ? Status::error(ErrorCode::NotFound, "Error: HEAD has no commits yet.")
+                                          : status;
     }
-
-    // Debug output for parent SHA
-    std::cout << "Parent SHA: " << (parent_sha.empty() ? "None" : parent_sha) << std::endl;
-
-    if (!parent_sha.empty())
+    bool full_sha = name.size() == 40 && is_hex_string(name);
+    for (const std::string &ref_name : {"refs/heads/" + name, "refs/tags/" + name, name})
     {
-        tree_entries = read_tree(get_tree_sha_from_commit(parent_sha)); // Read tree entries from the commit
+        if (!full_sha && ref_name.rfind("refs/", 0) == 0 && is_valid_ref_name(ref_name.substr(5)) &&
+            read_ref(ref_name, sha).ok() && !sha.empty())
+        {
+            return {};
+        }
     }
 
-    // Debug output for tree entries after reading parent
-    std::cout << "Tree Entries after reading parent commit:" << std::endl;
-    for (const auto &entry : tree_entries)
+    if (name.size() < 4 || name.size() > 40 || !is_hex_string(name))
     {
-        std::cout << entry.first << " -> Mode: " << entry.second.mode
-                  << ", SHA: " << entry.second.sha << std::endl;
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid SHA-1 hash provided.");
     }
-
-    // Read index entries
-    auto index_entries = read_from_index();
-
-    // Debug output for index entries
-    // std::cout << "Index Entries:" << std::endl;
-    // for (const auto &entry : index_entries)
-    // {
-    //     std::cout << entry.first << " -> Mode: " << entry.second.mode
-    //               << ", SHA: " << entry.second.sha << std::endl;
-    // }
-
-    // Populate tree_entries with index entries
-    for (const auto &entry : index_entries)
+    if (name.size() == 40)
     {
-        tree_entries[entry.first] = {entry.second.mode, entry.first, entry.second.sha};
+        sha = name;
+        return has_object(name) ? Status() : Status::error(ErrorCode::NotFound, "Error: Object with SHA-1 " + name + " not found.");
     }
 
-    // Debug output for tree_entries after updating with index entries
-    // std::cout << "Tree Entries after updating with index entries:" << std::endl;
-    // for (const auto &entry : tree_entries)
-    // {
-    //     std::cout << entry.first << " -> Mode: " << entry.second.mode
-    //               << ", SHA: " << entry.second.sha << std::endl;
-    // }
-
-    // Build adjList from index entries
-    create_tree_from_index(index_entries, adjList);
+    std::string match;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(common_dir_ / "objects" / name.substr(0, 2), ec))
+    {
+        std::string rest = entry.path().filename().string();
+        if (rest.compare(0, name.size() - 2, name, 2) == 0)
+        {
+            if (!match.empty())
+            {
+                return Status::error(ErrorCode::Ambiguous, "Error: Short SHA-1 " + name + " is ambiguous.");
+            }
+            match = name.substr(0, 2) + rest;
+        }
+    }
+    if (match.empty())
+    {
+        return Status::error(ErrorCode::NotFound, "Error: Object with SHA-1 " + name + " not found.");
+    }
+    sha = std::move(match);
+    return {};
+}
 
-    // Debug output for adjacency list
-    std::cout << "Adjacency List:" << std::endl;
-    for (const auto &pair : adjList)
+Status Repository::read_object(const std::string &sha, Object &object) const
+{
+    if (cache_)
     {
-        std::cout << pair.first << ": ";
-        for (const auto &child : pair.second)
+        if (const Object *cached = cache_->objects.find(sha))
         {
-            std::cout << child << " ";
+            object = *cached;
+            return {};
         }
-        std::cout << std::endl;
     }
 
-    // Generate the final tree SHA using the combined tree_entries
-    TreeEntry rootEntry = generate_tree_sha(adjList, tree_entries, ""); // Pass tree_entries to generate_tree_sha
-    return rootEntry;
-}
+    std::ifstream ifs(object_path(sha), std::ios::binary);
+    if (sha.size() != 40 || !ifs)
+    {
+        return Status::error(ErrorCode::NotFound, "Error: Object with SHA-1 " + sha + " not found.");
+    }
 
+    std::ostringstream buffer;
+    buffer << ifs.rdbuf();
+    Status status = parse_stored_object(sha, buffer.str(), object);
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (cache_)
+    {
+        cache_->objects.insert(sha, object);
+    }
+    return {};
+}
 
-void log()
+// Reads only the "<type> <size>" prefix of an object, without inflating it.
+Status Repository::read_object_header(const std::string &sha, std::string &type, size_t &size) const
 {
-    std::ifstream head_file(".mygit/refs/heads/master");
-    if (!head_file)
+    std::ifstream ifs(object_path(sha), std::ios::binary);
+    if (sha.size() != 40 || !ifs)
     {
-        std::cerr << "Error: HEAD not found." << std::endl;
-        return;
+        return Status::error(ErrorCode::NotFound, "Error: Object with SHA-1 " + sha + " not found.");
     }
 
-    std::string commit_sha;
-    std::getline(head_file, commit_sha);
-
-    while (!commit_sha.empty())
+    std::string header;
+    if (!std::getline(ifs, header, '\0') || ifs.eof() || !parse_object_header(header, type, size))
     {
-        std::string commit_content;
-        std::ostringstream oss;
-        std::streambuf *original_cout_buffer = std::cout.rdbuf(oss.rdbuf());
+        return Status::error(ErrorCode::Corrupt, "Error: Object " + sha + " has an invalid header.");
+    }
+    return {};
+}
 
-        cat_file("-p", commit_sha);
-        std::cout.rdbuf(original_cout_buffer);
+Status Repository::write_object(const std::string &type, std::string content, std::string &sha)
+{
+    std::string header = object_header(type, content.size());
+    Sha1Stream hasher;
+    hasher.update(header);
+    hasher.update(content);
+    sha = hasher.hex_digest();
 
-        commit_content = oss.str();
-        std::istringstream commit_stream(commit_content);
-        std::string line;
-        std::string parent_sha;
-        std::string message;
-        std::string author;
-        std::string committer;
-        std::string tree_sha;
+    if (freshen_object(sha))
+    {
+        return {};
+    }
 
-        while (std::getline(commit_stream, line))
-        {
-            if (line.find("tree ") == 0)
-            {
-                tree_sha = line.substr(5);
-            }
-            else if (line.find("parent ") == 0)
-            {
-                parent_sha = line.substr(7);
-            }
-            else if (line.find("author ") == 0)
-            {
-                author = line.substr(7);
-            }
-            else if (line.find("committer ") == 0)
-            {
-                committer = line.substr(11);
-            }
-            else if (line.empty())
-            {
-                continue;
-            }
-            else
-            {
-                message += line + "\n";
-            }
-        }
-        std::cout << "commit " << commit_sha << "\n";
-        std::cout << "tree " << tree_sha << "\n";
-        if (!parent_sha.empty())
+    fs::path temp_path = temp_object_path();
+    {
+        std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+        ofs << header << compress_data(content);
+        if (!ofs)
         {
-            std::cout << "parent " << parent_sha << "\n";
+            fs::remove(temp_path);
+            return io_error("Unable to write object", temp_path);
         }
-        std::cout << "author " << author << "\n";
-        std::cout << "committer " << committer << "\n";
-        std::cout << "\n"
-                  << message << "\n";
-        std::cout << "------------------------------------\n";
-
-        commit_sha = parent_sha;
     }
+    if (cache_)
+    {
+        // Freshly written trees are read straight back by the next commit.
+        cache_->objects.insert(sha, {type, std::move(content)});
+    }
+    return store_raw_object(sha, temp_path);
 }
 
-void commit(std::string message)
+Status Repository::write_file_object(std::string content, std::string &sha)
 {
-    std::string tree_sha = write_tree().sha;
-    std::string parent_sha;
-
-    std::ifstream parent_file(".mygit/refs/heads/master");
-    if (parent_file)
+    size_t threshold = 0;
+    Status status = chunk_threshold(*this, threshold);
+    if (!status.ok() || threshold == 0 || content.size() < threshold)
     {
-        std::getline(parent_file, parent_sha);
+        return status.ok() ? write_object("blob", std::move(content), sha) : status;
     }
 
-    std::string author = "Your Name <you@example.com>";
-    std::string committer = author;
-
-    std::time_t now = std::time(nullptr);
-    std::ostringstream timestamp_stream;
-    timestamp_stream << std::put_time(std::localtime(&now), "%Y-%m-%d %H:%M:%S %z");
-    std::string timestamp = timestamp_stream.str();
-
-    std::ostringstream serialized_commit;
-    serialized_commit << "tree " << tree_sha << "\n";
-    if (!parent_sha.empty())
+    ChunkingParams params;
+    std::string chunk_list;
+    const auto *data = reinterpret_cast<const unsigned char *>(content.data());
+    for (size_t offset = 0; offset < content.size();)
     {
-        serialized_commit << "parent " << parent_sha << "\n";
+        size_t size = next_chunk_boundary(data + offset, content.size() - offset, params);
+        std::string chunk_sha;
+        status = write_object("blob", content.substr(offset, size), chunk_sha);
+        if (!status.ok())
+        {
+            return status;
+        }
+        chunk_list += chunk_sha + " " + std::to_string(size) + "\n";
+        offset += size;
     }
-    serialized_commit << "author " << author << " " << timestamp << "\n";
-    serialized_commit << "committer " << committer << " " << timestamp << "\n";
-    serialized_commit << "\n"
-                      << message << "\n";
-
-    std::string serialized_data = serialized_commit.str();
-    std::string commit_object = "commit " + std::to_string(serialized_data.size()) + '\0';
-    std::string commit_sha = calculate_sha1(commit_object + serialized_data);
+    return write_object("chunks", std::move(chunk_list), sha);
+}
 
-    write_blob(commit_sha, commit_object + compress_data(serialized_data));
+// A blob goes to `sink` whole; a chunk list is read and checked chunk by chunk.
+Status Repository::stream_blob(const std::string &sha,
+                               const std::function<Status(const std::string &data)> &sink) const
+{
+    Object object;
+    Status status = read_object(sha, object);
+    if (!status.ok() || object.type != "chunks")
+    {
+        return status.ok() ? sink(object.content) : status;
+    }
 
-    std::ofstream head_file(".mygit/refs/heads/master");
-    if (head_file)
+    std::vector<ChunkRef> chunks;
+    if (!parse_chunk_list(object.content, chunks))
     {
-        head_file << commit_sha << std::endl;
+        return Status::error(ErrorCode::Corrupt, "Error: Object " + sha + " is not a valid chunk list.");
     }
-    std::ofstream index_file(".mygit/index", std::ios::trunc);
-    if (index_file)
+    for (const auto &chunk : chunks)
     {
-        index_file.close();
+        Object piece;
+        status = read_object(chunk.sha, piece);
+        if (status.ok() && (piece.type != "blob" || piece.content.size() != chunk.size))
+        {
+            status = Status::error(ErrorCode::Corrupt, "Error: Chunk " + chunk.sha + " of " + sha + " is damaged.");
+        }
+        if (status.ok())
+        {
+            status = sink(piece.content);
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
     }
-    std::cout << "Committed: " << commit_sha << std::endl;
-    std::cout << serialized_data;
+    return {};
 }
 
-bool has_uncommitted_changes()
+// Objects are written under a unique temporary name and renamed into place,
+// so readers never observe a partially written object.
+fs::path Repository::temp_object_path() const
 {
-    auto index_entries = read_from_index();
-
-    // If the index is empty, return false (no uncommitted changes)
-    return !index_entries.empty();
+    static std::atomic<unsigned long> counter{0};
+    return common_dir_ / "objects" / ("tmp_obj_" + std::to_string(getpid()) + "_" + std::to_string(counter++));
 }
 
-void restore_blob(const std::string &blob_sha, const std::string &file_path)
+Status Repository::store_raw_object(const std::string &sha, const fs::path &raw_file)
 {
-    std::stringstream buffer;
-    std::streambuf *old_buf = std::cout.rdbuf(buffer.rdbuf());
-
-    cat_file("-p", blob_sha);
-
-    std::cout.rdbuf(old_buf);
+    fs::path destination = object_path(sha);
+    std::error_code ec;
+    fs::create_directories(destination.parent_path(), ec);
+    fs::rename(raw_file, destination, ec);
+    if (ec)
+    {
+        fs::remove(raw_file, ec);
+        return io_error("Unable to store object", destination);
+    }
+    return {};
+}
 
-    std::string content = buffer.str();
-    std::ofstream file(file_path);
-    if (file)
+// Tree lines are "<mode> <path> <sha>", where path is relative to the root.
+Status Repository::read_tree(const std::string &tree_sha, std::vector<TreeEntry> &entries) const
+{
+    Object object;
+    Status status = read_object(tree_sha, object);
+    if (!status.ok())
     {
-        file << content;
+        return status;
     }
-    else
+    if (object.type != "tree")
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: " + tree_sha + " is not a tree.");
+    }
+
+    std::istringstream tree_stream(object.content);
+    std::string line;
+    while (std::getline(tree_stream, line))
     {
-        throw std::runtime_error("Error: Unable to create file " + file_path);
+        std::size_t first_space = line.find(' ');
+        std::size_t last_space = line.rfind(' ');
+        if (first_space == std::string::npos || first_space == last_space)
+        {
+            return Status::error(ErrorCode::Corrupt, "Error: Malformed entry in tree " + tree_sha);
+        }
+        entries.push_back({line.substr(0, first_space),
+                           line.substr(first_space + 1, last_space - first_space - 1),
+                           line.substr(last_space + 1)});
     }
+    return {};
 }
 
-void clear_project_directory(const fs::path &project_root)
+Status Repository::read_tree_recursive(const std::string &tree_sha, std::map<std::string, TreeEntry> &tree_entries,
+                                       const SparseCheckout *sparse) const
 {
-    try
+    std::vector<TreeEntry> entries;
+    Status status = read_tree(tree_sha, entries);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    for (auto &entry : entries)
     {
-        for (const auto &entry : fs::directory_iterator(project_root))
+        std::string sha = entry.sha;
+        bool descend = entry.mode == "040000" && (!sparse || sparse->includes_directory(entry.name));
+        tree_entries[entry.name] = std::move(entry);
+        if (descend)
         {
-            // Check if the current entry is the .mygit directory
-            if (entry.path().filename() != ".mygit")
+            status = read_tree_recursive(sha, tree_entries, sparse);
+            if (!status.ok())
             {
-                fs::remove_all(entry.path()); // Remove files and directories
+                return status;
             }
         }
-        std::cout << "Cleared project directory, preserving .mygit." << std::endl;
     }
-    catch (const fs::filesystem_error &e)
+    return {};
+}
+
+Status Repository::read_commit(const std::string &commit_sha, Commit &commit) const
+{
+    Object object;
+    Status status = read_object(commit_sha, object);
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (object.type != "commit" || !Commit::parse(object.content, commit))
     {
-        std::cerr << "Error clearing project directory: " << e.what() << std::endl;
+        return Status::error(ErrorCode::InvalidArgument, "Error: " + commit_sha + " is not a valid commit.");
     }
+    return {};
 }
 
-void restore_tree(const std::string &tree_sha)
+fs::path Repository::ref_table_path() const
 {
-    std::map<std::string, TreeEntry> tree_entries = read_tree(tree_sha);
+    return common_dir_ / "reftable";
+}
 
-    for (const auto &[file_name, entry] : tree_entries)
+Status Repository::with_ref_table(const std::function<Status(const RefTable &table)> &use) const
+{
+    fs::path path = ref_table_path();
+    if (!cache_)
     {
-        std::cout << "Restoring: " << file_name << " (SHA: " << entry.sha << ", Mode: " << entry.mode << ")\n";
+        RefTable table;
+        Status status = RefTable::open(path, table);
+        return status.ok() ? use(table) : status;
+    }
 
-        if (entry.mode == "100644") // Regular file
-        {
-            // Restore the file from the blob using its SHA
-            restore_blob(entry.sha, file_name);
-            std::cout << "Restored file: " << file_name << std::endl;
-        }
-        else if (entry.mode == "040000") // Directory
+    struct stat info = {};
+    stat(path.c_str(), &info);
+    const struct stat &cached = cache_->ref_table_stat;
+    if (!cache_->ref_table_valid || info.st_ino != cached.st_ino || info.st_size != cached.st_size ||
+        info.st_mtim.tv_sec != cached.st_mtim.tv_sec || info.st_mtim.tv_nsec != cached.st_mtim.tv_nsec)
+    {
+        Status status = RefTable::open(path, cache_->ref_table);
+        cache_->ref_table_valid = status.ok();
+        cache_->ref_table_stat = info;
+        if (!status.ok())
         {
-            // Create directory if it doesn't exist
-            fs::create_directory(file_name);
-            std::cout << "Created directory: " << file_name << std::endl;
-
-            // If the entry is a directory, we need to restore its tree as well
-            // This might require reading the entries under this directory
-            // Here, you can call a function to restore the directory contents, if needed.
+            return status;
         }
-        // Add additional handling for other modes if necessary
     }
+    return use(cache_->ref_table);
 }
 
-void checkout(std::string commit_sha)
+// A loose ref file, where one exists, wins over the table: refs written
+// before the table existed stay readable until their next update.
+Status Repository::read_ref(const std::string &ref_name, std::string &sha) const
 {
-    std::ifstream head_file(".mygit/refs/heads/master");
-    if (!head_file)
+    std::error_code ec;
+    fs::path ref_path = common_dir_ / ref_name;
+    if (fs::is_regular_file(ref_path, ec))
     {
-        std::cerr << "Error: HEAD not found." << std::endl;
-        return;
+        std::ifstream ref_file(ref_path);
+        sha.clear();
+        std::getline(ref_file, sha);
+        return {};
     }
-
-    std::string current_commit_sha;
-    std::getline(head_file, current_commit_sha);
-
-    std::string commit_tree_sha = get_tree_sha_from_commit(commit_sha);
-    if (commit_tree_sha.empty())
+    if (ref_name.rfind("refs/", 0) == 0)
     {
-        std::cerr << "Error: Invalid commit SHA." << std::endl;
-        return;
+        Status status = with_ref_table([&](const RefTable &table) { return table.lookup(ref_name, sha); });
+        if (!status.ok() || !sha.empty())
+        {
+            return status;
+        }
+    }
+    return Status::error(ErrorCode::NotFound, "Error: " + ref_name + " not found.");
+}
+
+// Refs under refs/ go to the ref table; a linked worktree's own HEAD stays
+// a file in its directory.
+Status Repository::update_ref(const std::string &ref_name, const std::string &sha)
+{
+    if (ref_name.rfind("refs/", 0) == 0)
+    {
+        return update_refs({{ref_name, sha, false, ""}});
+    }
+    fs::path ref_path = common_dir_ / ref_name;
+    std::error_code ec;
+    fs::create_directories(ref_path.parent_path(), ec);
+    std::ofstream ref_file(ref_path, std::ios::trunc);
+    ref_file << sha << std::endl;
+    if (!ref_file)
+    {
+        return io_error("Unable to update", ref_path);
+    }
+    return {};
+}
+
+Status Repository::delete_ref(const std::string &ref_name)
+{
+    return update_refs({{ref_name, "", false, ""}});
+}
+
+Status Repository::update_refs(const std::vector<RefUpdate> &updates)
+{
+    for (const auto &update : updates)
+    {
+        if (update.name.rfind("refs/", 0) != 0 || !is_valid_ref_name(update.name.substr(5)))
+        {
+            return Status::error(ErrorCode::InvalidArgument, "Error: Invalid ref name " + update.name + ".");
+        }
+        if (!update.new_sha.empty() && (update.new_sha.size() != 40 || !is_hex_string(update.new_sha)))
+        {
+            return Status::error(ErrorCode::InvalidArgument, "Error: Invalid SHA-1 for " + update.name + ".");
+        }
+    }
+
+    RefTableLock lock;
+    Status status = lock.acquire(ref_table_path());
+    RefTable table;
+    std::map<std::string, std::string> refs;
+    if (status.ok())
+    {
+        status = RefTable::open(ref_table_path(), table);
+    }
+    if (status.ok())
+    {
+        status = table.list("", refs);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    // Checks see loose refs too, and every update's loose file goes once the
+    // table holds the new value
+    std::vector<fs::path> loose_files;
+    for (const auto &update : updates)
+    {
+        std::string current;
+        read_ref(update.name, current);
+        if (update.check_old && current != update.old_sha)
+        {
+            return Status::error(ErrorCode::InvalidArgument,
+                                 update.old_sha.empty() ? "Error: " + update.name + " already exists."
+                                                        : "Error: " + update.name + " has changed.");
+        }
+        if (update.new_sha.empty())
+        {
+            refs.erase(update.name);
+        }
+        else
+        {
+            refs[update.name] = update.new_sha;
+        }
+        std::error_code ec;
+        if (fs::is_regular_file(common_dir_ / update.name, ec))
+        {
+            loose_files.push_back(common_dir_ / update.name);
+        }
+    }
+    status = lock.commit(refs);
+    for (const auto &path : loose_files)
+    {
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+    return status;
+}
+
+Status Repository::list_refs(std::map<std::string, std::string> &refs, const std::string &prefix) const
+{
+    Status status = with_ref_table([&](const RefTable &table) { return table.list(prefix, refs); });
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    std::error_code ec;
+    fs::path refs_dir = common_dir_ / "refs";
+    for (auto it = fs::recursive_directory_iterator(refs_dir, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec))
+    {
+        std::string name = relative_name(it->path(), common_dir_);
+        std::string sha;
+        if (name.compare(0, prefix.size(), prefix) == 0 && it->is_regular_file(ec) && read_ref(name, sha).ok())
+        {
+            if (sha.empty())
+            {
+                refs.erase(name);
+            }
+            else
+            {
+                refs[name] = sha;
+            }
+        }
+    }
+    if (ec)
+    {
+        return io_error("Unable to list", refs_dir);
+    }
+
+    // Worktree HEADs naming a branch are covered by the branch itself
+    std::error_code worktrees_ec;
+    for (const auto &worktree : fs::directory_iterator(common_dir_ / "worktrees", worktrees_ec))
+    {
+        std::string name = relative_name(worktree.path() / "HEAD", common_dir_);
+        std::string sha;
+        if (name.compare(0, prefix.size(), prefix) == 0 && read_ref(name, sha).ok() && !sha.empty() &&
+            sha.rfind("ref: ", 0) != 0)
+        {
+            refs[name] = sha;
+        }
+    }
+    return {};
+}
+
+// HEAD either names a branch ("ref: refs/heads/<name>") or, in a linked
+// worktree, holds a commit of its own. A repository from before HEAD files
+// is on master.
+std::string Repository::head_ref() const
+{
+    std::ifstream head_file(git_dir_ / "HEAD");
+    std::string line;
+    if (std::getline(head_file, line) && line.rfind("ref: ", 0) == 0)
+    {
+        return trim(line.substr(5));
+    }
+    return is_linked_worktree() ? relative_name(git_dir_ / "HEAD", common_dir_) : HEAD_REF;
+}
+
+std::string Repository::head_branch() const
+{
+    std::string ref_name = head_ref();
+    return ref_name.rfind("refs/heads/", 0) == 0 ? ref_name : "";
+}
+
+Status Repository::set_head_branch(const std::string &ref_name)
+{
+    fs::path head_path = git_dir_ / "HEAD";
+    std::ofstream head_file(head_path, std::ios::trunc);
+    head_file << "ref: " << ref_name << std::endl;
+    if (!head_file)
+    {
+        return io_error("Unable to update", head_path);
+    }
+    return {};
+}
+
+// An empty HEAD (no commits yet) is not an error.
+Status Repository::read_head(std::string &commit_sha) const
+{
+    Status status = read_ref(head_ref(), commit_sha);
+    if (status.code == ErrorCode::NotFound)
+    {
+        return Status::error(ErrorCode::NotFound, "Error: HEAD not found.");
+    }
+    return status;
+}
+
+Status Repository::update_head(const std::string &commit_sha)
+{
+    return update_ref(head_ref(), commit_sha);
+}
+
+Status Repository::read_index(std::map<std::string, TreeEntry> &index_entries) const
+{
+    fs::path index_path = git_dir_ / "index";
+    if (cache_ && cache_->index_stamp_matches(index_path))
+    {
+        index_entries = cache_->index_entries;
+        return {};
+    }
+
+    std::ifstream index_file(index_path);
+
+    std::string mode, path, sha;
+    while (index_file >> mode >> path >> sha)
+    {
+        index_entries[path] = {mode, path, sha};
+    }
+
+    if (cache_)
+    {
+        cache_->index_entries = index_entries;
+        cache_->stamp_index(index_path);
+    }
+    return {};
+}
+
+Status Repository::read_all_indexes(std::vector<TreeEntry> &entries) const
+{
+    std::vector<fs::path> index_paths = {common_dir_ / "index"};
+    std::error_code ec;
+    for (const auto &worktree : fs::directory_iterator(common_dir_ / "worktrees", ec))
+    {
+        index_paths.push_back(worktree.path() / "index");
+    }
+    for (const auto &index_path : index_paths)
+    {
+        std::ifstream index_file(index_path);
+        std::string mode, path, sha;
+        while (index_file >> mode >> path >> sha)
+        {
+            if (mode != DELETED_MODE)
+            {
+                entries.push_back({mode, path, sha});
+            }
+        }
+    }
+    return {};
+}
+
+// Stages files and directories (recursively, minus what .mygitignore
+// excludes and what lies outside a sparse checkout). Paths are relative to
+// the repository root unless absolute; ones that do not exist are reported
+// back through `missing` rather than failing the whole call.
+Status Repository::add(const std::vector<std::string> &paths, std::vector<std::string> &missing,
+                       PipelineReport *report)
+{
+    std::vector<TreeEntry> staged_entries;
+    std::vector<std::pair<size_t, size_t>> pending; // Entry index, pipeline slot
+    std::vector<std::string> directories;
+    bool reuse_hashes = cache_ && cache_->working_tree_watched;
+    size_t threshold = 0;
+    Status threshold_status = chunk_threshold(*this, threshold);
+    if (!threshold_status.ok())
+    {
+        return threshold_status;
     }
+    SparseCheckout sparse;
+    SparseCheckout::load(*this, sparse);
+    ObjectPipeline pipeline(*this);
 
-    std::cout << "Checking out commit " << commit_sha << std::endl;
-    clear_project_directory(".");
-    // Restore the tree at the specified commit
-    restore_tree(commit_tree_sha);
+    auto stage_file = [&](const fs::path &file_path) -> Status {
+        std::string name = relative_name(file_path, root_);
+        if (!sparse.includes_file(name))
+        {
+            return Status::error(ErrorCode::InvalidArgument,
+                                 "Error: " + name + " is outside the sparse checkout; update it with sparse-checkout set.");
+        }
+        std::string sha;
+        if (reuse_hashes)
+        {
+            auto clean = cache_->clean_files.find(name);
+            if (clean != cache_->clean_files.end() && freshen_object(clean->second))
+            {
+                sha = clean->second;
+            }
+        }
+
+        std::error_code ec;
+        uintmax_t size = sha.empty() ? fs::file_size(file_path, ec) : 0;
+        if (sha.empty() && threshold > 0 && !ec && size >= threshold)
+        {
+            // Large files are read here a chunk at a time; the chunks share
+            // the pipeline's compress and write stages
+            std::string chunk_list;
+            Status status = split_file_into_chunks(file_path, ChunkingParams(), [&](std::string chunk) {
+                size_t size = chunk.size();
+                chunk_list += pipeline.add_object("blob", std::move(chunk)) + " " + std::to_string(size) + "\n";
+                return Status();
+            });
+            if (!status.ok())
+            {
+                return status;
+            }
+            sha = pipeline.add_object("chunks", std::move(chunk_list));
+            if (reuse_hashes)
+            {
+                cache_->clean_files[name] = sha;
+            }
+        }
+        else if (sha.empty())
+        {
+            pending.emplace_back(staged_entries.size(), pipeline.add_file(file_path, ec ? 0 : size));
+        }
+        staged_entries.push_back({"100644", name, sha});
+        return {};
+    };
 
-    std::ofstream head_file_out(".mygit/refs/heads/master");
-    if (head_file_out)
+    for (const auto &path : paths)
+    {
+        fs::path file_path = fs::path(path).is_absolute() ? fs::path(path) : root_ / path;
+        file_path = file_path.lexically_normal();
+        std::error_code ec;
+        auto status = fs::status(file_path, ec);
+
+        if (fs::is_regular_file(status))
+        {
+            Status staged = stage_file(file_path);
+            if (!staged.ok())
+            {
+                return staged;
+            }
+        }
+        else if (fs::is_directory(status))
+        {
+            std::string dir_name = relative_name(file_path, root_);
+            directories.push_back(dir_name == "." ? "" : dir_name);
+        }
+        else
+        {
+            missing.push_back(path);
+        }
+    }
+
+    if (!directories.empty())
+    {
+        // Ignore rules only filter what a directory expands to; files named
+        // explicitly are always staged.
+        std::vector<std::string> files;
+        Status scanned = scan_working_tree(root_, directories, IgnoreRules::load(root_), files);
+        if (!scanned.ok())
+        {
+            return scanned;
+        }
+        for (const auto &name : files)
+        {
+            if (!sparse.includes_file(name))
+            {
+                continue;
+            }
+            Status staged = stage_file(root_ / name);
+            if (!staged.ok())
+            {
+                return staged;
+            }
+        }
+    }
+
+    std::vector<std::string> file_shas;
+    Status stored = pipeline.finish(file_shas, report);
+    if (!stored.ok())
+    {
+        return stored;
+    }
+    for (const auto &[entry, slot] : pending)
+    {
+        staged_entries[entry].sha = file_shas[slot];
+        if (reuse_hashes)
+        {
+            cache_->clean_files[staged_entries[entry].name] = file_shas[slot];
+        }
+    }
+
+    return append_to_index(std::move(staged_entries));
+}
+
+// Stages the deletion of tracked files and removes them from the working
+// tree. Paths that are neither staged nor in the tree `commit` would start
+// from are reported back through `missing`.
+Status Repository::remove(const std::vector<std::string> &paths, std::vector<std::string> &missing)
+{
+    std::map<std::string, TreeEntry> tracked;
+    std::map<std::string, TreeEntry> index_entries;
+    std::string base_tree_sha;
+    Status status = base_tree(base_tree_sha);
+    if (status.ok() && !base_tree_sha.empty())
+    {
+        status = read_tree_recursive(base_tree_sha, tracked);
+    }
+    if (status.ok())
+    {
+        status = read_index(index_entries);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    for (auto &[path, entry] : index_entries)
+    {
+        tracked[path] = std::move(entry);
+    }
+
+    std::vector<TreeEntry> deletions;
+    for (const auto &path : paths)
+    {
+        fs::path file_path = fs::path(path).is_absolute() ? fs::path(path) : root_ / path;
+        file_path = file_path.lexically_normal();
+        std::string name = relative_name(file_path, root_);
+        auto entry = tracked.find(name);
+        if (entry == tracked.end() || entry->second.mode == DELETED_MODE || entry->second.mode == "040000")
+        {
+            missing.push_back(path);
+            continue;
+        }
+        std::error_code ec;
+        fs::remove(file_path, ec);
+        if (ec)
+        {
+            return io_error("Unable to remove", file_path);
+        }
+        // Directories left empty go too
+        for (fs::path dir = file_path.parent_path(); dir != root_ && fs::is_empty(dir, ec) && !ec;
+             dir = dir.parent_path())
+        {
+            fs::remove(dir, ec);
+        }
+        deletions.push_back({DELETED_MODE, name, std::string(40, '0')});
+    }
+    return append_to_index(std::move(deletions));
+}
+
+Status Repository::append_to_index(std::vector<TreeEntry> entries)
+{
+    std::ostringstream index_lines;
+    for (const auto &entry : entries)
     {
-        head_file_out << commit_sha << std::endl; // Update HEAD
+        index_lines << entry.mode << " " << entry.name << " " << entry.sha << "\n";
     }
 
-    std::cout << "Successfully checked out to commit: " << commit_sha << std::endl;
+    fs::path index_path = git_dir_ / "index";
+    bool index_cached = cache_ && cache_->index_stamp_matches(index_path);
+    {
+        std::ofstream index_file(index_path, std::ios::app);
+        index_file << index_lines.str();
+        if (!index_file)
+        {
+            return io_error("Unable to update", index_path);
+        }
+    }
+
+    if (index_cached)
+    {
+        for (auto &entry : entries)
+        {
+            std::string name = entry.name;
+            cache_->index_entries[name] = std::move(entry);
+        }
+        cache_->stamp_index(index_path);
+    }
+    return {};
+}
+
+// The parent commit's tree (while a conflicted merge is pending, the merged
+// tree), or "" before the first commit
+Status Repository::base_tree(std::string &tree_sha) const
+{
+    tree_sha.clear();
+    std::string parent_sha;
+    MergeState merge;
+    Status status = read_head(parent_sha);
+    if (status.ok() && read_merge_state(*this, merge))
+    {
+        tree_sha = merge.tree_sha;
+    }
+    else if (status.ok() && !parent_sha.empty())
+    {
+        Commit parent;
+        status = read_commit(parent_sha, parent);
+        tree_sha = parent.tree_sha;
+    }
+    return status;
+}
+
+Status Repository::write_tree(TreeEntry &root_entry, PipelineReport *report)
+{
+    std::map<std::string, TreeEntry> tree_entries;
+    std::map<std::string, TreeEntry> index_entries;
+    Status status = read_index(index_entries);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    // In a sparse checkout, subtrees outside it are carried over by ID
+    // without being read, unless something was staged inside one
+    SparseCheckout sparse;
+    SparseCheckout::load(*this, sparse);
+    const SparseCheckout *prune = sparse.enabled() ? &sparse : nullptr;
+    for (const auto &entry : index_entries)
+    {
+        if (prune && !sparse.includes_file(entry.first))
+        {
+            prune = nullptr;
+        }
+    }
+
+    // Start from the parent commit's tree so unstaged paths keep their IDs
+    std::string base_tree_sha;
+    status = base_tree(base_tree_sha);
+    if (status.ok() && !base_tree_sha.empty())
+    {
+        if (!prune && cache_ && cache_->head_tree_sha == base_tree_sha)
+        {
+            tree_entries = cache_->head_tree_entries;
+        }
+        else
+        {
+            status = read_tree_recursive(base_tree_sha, tree_entries, prune);
+            if (status.ok() && !prune && cache_)
+            {
+                cache_->head_tree_sha = base_tree_sha;
+                cache_->head_tree_entries = tree_entries;
+            }
+        }
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    for (const auto &entry : index_entries)
+    {
+        if (entry.second.mode == DELETED_MODE)
+        {
+            tree_entries.erase(entry.first);
+        }
+        else
+        {
+            tree_entries[entry.first] = {entry.second.mode, entry.first, entry.second.sha};
+        }
+    }
+
+    TreeBuilder builder;
+    for (const auto &[path, entry] : tree_entries)
+    {
+        if (prune && entry.mode == "040000" && !prune->includes_directory(path))
+        {
+            builder.add_subtree(path, entry.sha);
+        }
+        else
+        {
+            builder.add(path, entry.mode, entry.sha);
+        }
+    }
+    builder.finish();
+
+    // Trees are hashed here, since a parent needs its children's IDs, and
+    // compressed and written behind on the pipeline's threads
+    ObjectPipeline pipeline(*this);
+    status = builder.write(
+        [&](const std::string &type, std::string content, std::string &sha) {
+            if (cache_)
+            {
+                // Freshly written trees are read straight back by the next commit.
+                Object object{type, content};
+                sha = pipeline.add_object(type, std::move(content));
+                cache_->objects.insert(sha, std::move(object));
+            }
+            else
+            {
+                sha = pipeline.add_object(type, std::move(content));
+            }
+            return Status();
+        },
+        root_entry);
+
+    std::vector<std::string> file_shas;
+    Status stored = pipeline.finish(file_shas, report);
+    return status.ok() ? stored : status;
+}
+
+Status Repository::create_commit(const std::string &tree_sha, const std::vector<std::string> &parents,
+                                 const std::string &message, std::string &commit_sha)
+{
+    Commit commit;
+    commit.tree_sha = tree_sha;
+    commit.parents = parents;
+    commit.message = message;
+    commit.author = "Your Name <you@example.com>";
+    commit.committer = commit.author;
+
+    std::time_t now = std::time(nullptr);
+    std::ostringstream timestamp_stream;
+    timestamp_stream << std::put_time(std::localtime(&now), "%Y-%m-%d %H:%M:%S %z");
+    commit.timestamp = timestamp_stream.str();
+    return write_object("commit", commit.serialize(), commit_sha);
+}
+
+// Concludes a conflicted merge once every conflicted file is staged again
+Status Repository::commit(const std::string &message, std::string &commit_sha, PipelineReport *report)
+{
+    MergeState merge;
+    bool merging = read_merge_state(*this, merge);
+    if (merging)
+    {
+        std::map<std::string, TreeEntry> index_entries;
+        Status status = read_index(index_entries);
+        for (const auto &path : merge.conflicts)
+        {
+            if (status.ok() && !index_entries.count(path))
+            {
+                status = Status::error(ErrorCode::InvalidArgument,
+                                       "Error: " + path + " has merge conflicts; add it once they are resolved.");
+            }
+        }
+        if (!status.ok())
+        {
+            return status;
+        }
+    }
+
+    TreeEntry root_entry;
+    Status status = write_tree(root_entry, report);
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (root_entry.sha.empty())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Nothing to commit.");
+    }
+
+    std::vector<std::string> parents;
+    std::string head_sha;
+    read_head(head_sha);
+    if (!head_sha.empty())
+    {
+        parents.push_back(head_sha);
+    }
+    if (merging)
+    {
+        parents.push_back(merge.their_sha);
+    }
+    status = create_commit(root_entry.sha, parents, message, commit_sha);
+    if (status.ok())
+    {
+        status = update_head(commit_sha);
+    }
+    if (!status.ok())
+    {
+        return status;
+    }
+    if (merging)
+    {
+        clear_merge_state(*this);
+    }
+    std::ofstream index_file(git_dir_ / "index", std::ios::trunc);
+    index_file.close();
+    if (cache_)
+    {
+        cache_->index_entries.clear();
+        cache_->stamp_index(git_dir_ / "index");
+    }
+    return {};
+}
+
+namespace
+{
+Status clear_project_directory(const fs::path &project_root)
+{
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(project_root, ec))
+    {
+        // Check if the current entry is the .mygit directory
+        if (entry.path().filename() != ".mygit")
+        {
+            fs::remove_all(entry.path(), ec); // Remove files and directories
+            if (ec)
+            {
+                break;
+            }
+        }
+    }
+    if (ec)
+    {
+        return Status::error(ErrorCode::IoError, "Error clearing project directory: " + ec.message());
+    }
+    return {};
+}
+
+Status restore_tree(const Repository &repo, const std::string &tree_sha, const SparseCheckout &sparse,
+                    MaterializeStats &stats)
+{
+    std::map<std::string, TreeEntry> tree_entries;
+    Status status = repo.read_tree_recursive(tree_sha, tree_entries, &sparse);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    // Entries are sorted by path, so every directory precedes its contents.
+    // A sparse checkout only creates the directories its files need.
+    std::vector<const TreeEntry *> files;
+    for (const auto &[file_name, entry] : tree_entries)
+    {
+        if (entry.mode == "100644" && sparse.includes_file(file_name)) // Regular file
+        {
+            files.push_back(&entry);
+            std::size_t slash = file_name.rfind('/');
+            if (sparse.enabled() && slash != std::string::npos)
+            {
+                std::error_code ec;
+                fs::create_directories(repo.root() / file_name.substr(0, slash), ec);
+            }
+        }
+        else if (entry.mode == "040000" && !sparse.enabled()) // Directory
+        {
+            std::error_code ec;
+            fs::create_directories(repo.root() / file_name, ec);
+        }
+    }
+
+    if (repo.config_value("checkout.fileCache") == "true")
+    {
+        for (const TreeEntry *entry : files)
+        {
+            status = materialize_from_cache(repo, entry->sha, repo.root() / entry->name, stats);
+            if (!status.ok())
+            {
+                return status;
+            }
+        }
+        return {};
+    }
+
+    // Blobs are read, and files written, a batch at a time
+    std::unique_ptr<BatchIO> io = BatchIO::create();
+    for (size_t start = 0; start < files.size(); start += CHECKOUT_BATCH)
+    {
+        size_t end = std::min(files.size(), start + CHECKOUT_BATCH);
+        std::vector<FileRead> reads(end - start);
+        for (size_t i = start; i < end; ++i)
+        {
+            reads[i - start].path = repo.object_path(files[i]->sha);
+        }
+        io->read_files(reads);
+
+        std::vector<FileWrite> writes;
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            const TreeEntry &entry = *files[start + i];
+            Object blob;
+            status = reads[i].error ? Status::error(ErrorCode::NotFound,
+                                                    "Error: Object with SHA-1 " + entry.sha + " not found.")
+                                    : parse_stored_object(entry.sha, reads[i].data, blob);
+            if (!status.ok())
+            {
+                return status;
+            }
+            reads[i].data.clear();
+            fs::path target = repo.root() / entry.name;
+            if (blob.type == "chunks")
+            {
+                // Large files are streamed a chunk at a time instead
+                std::ofstream file(target, std::ios::binary | std::ios::trunc);
+                status = repo.stream_blob(entry.sha, [&file](const std::string &data) {
+                    file << data;
+                    return Status();
+                });
+                if (status.ok() && !file)
+                {
+                    status = io_error("Unable to create file", target);
+                }
+                if (!status.ok())
+                {
+                    return status;
+                }
+                ++stats.written;
+                continue;
+            }
+            writes.push_back({target, std::move(blob.content)});
+        }
+
+        io->write_files(writes);
+        for (const auto &write : writes)
+        {
+            if (write.error)
+            {
+                return io_error("Unable to create file", write.path);
+            }
+        }
+        stats.written += writes.size();
+    }
+    stats.files += files.size();
+    return {};
+}
+} // namespace
+
+Status Repository::check_out_tree(const std::string &commit_sha, MaterializeStats *stats)
+{
+    std::string current_commit_sha;
+    Status status = read_head(current_commit_sha);
+    if (!status.ok())
+    {
+        return status;
+    }
+
+    MergeState merge;
+    if (read_merge_state(*this, merge))
+    {
+        return Status::error(ErrorCode::InvalidArgument,
+                             "Error: A merge is in progress; commit it or run `merge --abort` first.");
+    }
+
+    Commit commit;
+    if (!read_commit(commit_sha, commit).ok())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid commit SHA.");
+    }
+    return restore_working_tree(commit.tree_sha, stats);
+}
+
+Status Repository::restore_working_tree(const std::string &tree_sha, MaterializeStats *stats)
+{
+    SparseCheckout sparse;
+    Status status = SparseCheckout::load(*this, sparse);
+    if (status.ok())
+    {
+        status = clear_project_directory(root_);
+    }
+    if (status.ok())
+    {
+        MaterializeStats ignored;
+        status = restore_tree(*this, tree_sha, sparse, stats ? *stats : ignored);
+    }
+    return status;
+}
+
+Status Repository::checkout(const std::string &commit_sha, MaterializeStats *stats)
+{
+    Status status = check_out_tree(commit_sha, stats);
+    return status.ok() ? update_head(commit_sha) : status;
+}
+
+Status Repository::switch_branch(const std::string &ref_name, MaterializeStats *stats)
+{
+    std::string commit_sha;
+    Status status = read_ref(ref_name, commit_sha);
+    if (status.ok() && commit_sha.empty())
+    {
+        status = Status::error(ErrorCode::InvalidArgument, "Error: " + ref_name + " has no commits yet.");
+    }
+    if (status.ok())
+    {
+        status = check_out_tree(commit_sha, stats);
+    }
+    return status.ok() ? set_head_branch(ref_name) : status;
 }
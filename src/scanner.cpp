@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "headers/scanner.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+const size_t MAX_SCAN_THREADS = 8;
+
+bool has_wildcard(const std::string &text)
+{
+    return text.find_first_of("*?[\\") != std::string::npos;
+}
+
+bool ends_with(const std::string &text, const std::string &suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Matches one bracket expression at `p` against `c`. On success returns the
+// position after the closing ']'; returns nullptr on mismatch and sets
+// `malformed` if there is no closing bracket.
+const char *match_class(const char *p, char c, bool &malformed)
+{
+    const char *start = ++p; // Past '['
+    bool negate = *p == '!' || *p == '^';
+    if (negate)
+    {
+        ++p;
+    }
+
+    bool matched = false;
+    bool first = true;
+    for (; *p && (first || *p != ']'); ++p, first = false)
+    {
+        if (p[1] == '-' && p[2] && p[2] != ']')
+        {
+            matched = matched || (c >= p[0] && c <= p[2]);
+            p += 2;
+        }
+        else
+        {
+            matched = matched || c == *p;
+        }
+    }
+    if (!*p)
+    {
+        malformed = true;
+        return start;
+    }
+    return matched != negate ? p + 1 : nullptr;
+}
+} // namespace
+
+// '*' and '?' never match '/', '**' matches across directories and "**/"
+// also matches zero directories.
+bool glob_match(const char *p, const char *t)
+{
+    while (*p)
+    {
+        if (p[0] == '*' && p[1] == '*')
+        {
+            const char *rest = p + 2;
+            if (*rest == '/')
+            {
+                ++rest;
+                if (glob_match(rest, t))
+                {
+                    return true;
+                }
+                for (const char *s = t; *s; ++s)
+                {
+                    if (*s == '/' && glob_match(rest, s + 1))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (const char *s = t;; ++s)
+            {
+                if (glob_match(rest, s))
+                {
+                    return true;
+                }
+                if (!*s)
+                {
+                    return false;
+                }
+            }
+        }
+        if (*p == '*')
+        {
+            for (const char *s = t;; ++s)
+            {
+                if (glob_match(p + 1, s))
+                {
+                    return true;
+                }
+                if (!*s || *s == '/')
+                {
+                    return false;
+                }
+            }
+        }
+        if (!*t)
+        {
+            return false;
+        }
+        if (*p == '?')
+        {
+            if (*t == '/')
+            {
+                return false;
+            }
+        }
+        else if (*p == '[')
+        {
+            bool malformed = false;
+            const char *next = match_class(p, *t, malformed);
+            if (!malformed)
+            {
+                if (!next || *t == '/')
+                {
+                    return false;
+                }
+                p = next;
+                ++t;
+                continue;
+            }
+            if (*t != '[') // No closing bracket: '[' is literal
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (*p == '\\' && p[1])
+            {
+                ++p;
+            }
+            if (*p != *t)
+            {
+                return false;
+            }
+        }
+        ++p;
+        ++t;
+    }
+    return !*t;
+}
+
+IgnoreRules IgnoreRules::load(const fs::path &root)
+{
+    IgnoreRules rules;
+    std::ifstream ignore_file(root / ".mygitignore");
+    std::string line;
+    while (std::getline(ignore_file, line))
+    {
+        rules.add_pattern(line);
+    }
+    return rules;
+}
+
+void IgnoreRules::add_pattern(const std::string &line)
+{
+    std::string pattern = line;
+    if (!pattern.empty() && pattern.back() == '\r')
+    {
+        pattern.pop_back();
+    }
+    while (!pattern.empty() && pattern.back() == ' ' && (pattern.size() < 2 || pattern[pattern.size() - 2] != '\\'))
+    {
+        pattern.pop_back();
+    }
+    if (pattern.empty() || pattern[0] == '#')
+    {
+        return;
+    }
+
+    Rule rule;
+    if (pattern[0] == '!')
+    {
+        rule.negate = true;
+        pattern.erase(0, 1);
+    }
+    else if (pattern[0] == '\\')
+    {
+        pattern.erase(0, 1); // Escaped leading '#' or '!'
+    }
+    if (!pattern.empty() && pattern.back() == '/')
+    {
+        rule.directory_only = true;
+        pattern.pop_back();
+    }
+    rule.anchored = pattern.find('/') != std::string::npos;
+    if (!pattern.empty() && pattern[0] == '/')
+    {
+        pattern.erase(0, 1);
+    }
+    if (pattern.rfind("**/", 0) == 0 && pattern.find('/', 3) == std::string::npos)
+    {
+        // "**/name" is the same as an unanchored "name"
+        pattern.erase(0, 3);
+        rule.anchored = false;
+    }
+    if (pattern.empty())
+    {
+        return;
+    }
+
+    size_t index = rules_.size();
+    rule.pattern = pattern;
+    rules_.push_back(rule);
+
+    if (!has_wildcard(pattern))
+    {
+        (rule.anchored ? literal_paths_ : literal_names_)[pattern].push_back(index);
+    }
+    else if (!rule.anchored && pattern[0] == '*' && !has_wildcard(pattern.substr(1)))
+    {
+        std::string suffix = pattern.substr(1);
+        if (suffix.size() > 1 && suffix[0] == '.' && suffix.find('.', 1) == std::string::npos)
+        {
+            extensions_[suffix.substr(1)].push_back(index);
+        }
+        else
+        {
+            suffixes_.emplace_back(suffix, index);
+        }
+    }
+    else if (!rule.anchored && pattern.back() == '*' && !has_wildcard(pattern.substr(0, pattern.size() - 1)))
+    {
+        prefixes_.emplace_back(pattern.substr(0, pattern.size() - 1), index);
+    }
+    else
+    {
+        globs_.push_back(index);
+    }
+}
+
+bool IgnoreRules::is_ignored(const std::string &relative_path, bool is_directory) const
+{
+    if (rules_.empty())
+    {
+        return false;
+    }
+
+    std::size_t slash = relative_path.rfind('/');
+    std::string name = slash == std::string::npos ? relative_path : relative_path.substr(slash + 1);
+    long best = -1;
+
+    auto consider = [&](size_t index) {
+        if (static_cast<long>(index) > best && (is_directory || !rules_[index].directory_only))
+        {
+            best = index;
+        }
+    };
+    auto consider_all = [&](const RuleIndex &bucket, const std::string &key) {
+        auto it = bucket.find(key);
+        if (it != bucket.end())
+        {
+            for (size_t index : it->second)
+            {
+                consider(index);
+            }
+        }
+    };
+
+    consider_all(literal_names_, name);
+    consider_all(literal_paths_, relative_path);
+    std::size_t dot = name.rfind('.');
+    if (dot != std::string::npos)
+    {
+        consider_all(extensions_, name.substr(dot + 1));
+    }
+    for (const auto &[suffix, index] : suffixes_)
+    {
+        if (ends_with(name, suffix))
+        {
+            consider(index);
+        }
+    }
+    for (const auto &[prefix, index] : prefixes_)
+    {
+        if (name.compare(0, prefix.size(), prefix) == 0)
+        {
+            consider(index);
+        }
+    }
+    for (size_t index : globs_)
+    {
+        if (static_cast<long>(index) > best)
+        {
+            const Rule &rule = rules_[index];
+            if (glob_match(rule.pattern.c_str(), rule.anchored ? relative_path.c_str() : name.c_str()))
+            {
+                consider(index);
+            }
+        }
+    }
+
+    return best >= 0 && !rules_[best].negate;
+}
+
+namespace
+{
+// Directories waiting to be read, shared by the scanning threads. The walk
+// is over when the queue is empty and no thread is still reading.
+struct ScanState
+{
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::string> pending;
+    size_t busy = 0;
+    std::vector<std::string> files;
+    std::string error;
+};
+
+void scan_directory(const fs::path &root, const std::string &relative_dir, const IgnoreRules &rules,
+                    std::vector<std::string> &subdirs, std::vector<std::string> &files, std::string &error)
+{
+    fs::path dir_path = relative_dir.empty() ? root : root / relative_dir;
+    DIR *dir = opendir(dir_path.c_str());
+    if (!dir)
+    {
+        if (errno != ENOENT)
+        {
+            error = "Error: Unable to read directory " + dir_path.string() + ": " + std::strerror(errno);
+        }
+        return;
+    }
+
+    while (dirent *entry = readdir(dir))
+    {
+        const char *name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0 || std::strcmp(name, ".mygit") == 0)
+        {
+            continue;
+        }
+
+        std::string relative_path = relative_dir.empty() ? name : relative_dir + "/" + name;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK)
+        {
+            // Symlinks are staged by their target's content but never
+            // followed into directories.
+            struct stat info;
+            bool is_link = type == DT_LNK;
+            if ((is_link ? stat : lstat)((dir_path / name).c_str(), &info) != 0)
+            {
+                continue;
+            }
+            type = S_ISREG(info.st_mode) ? DT_REG : (S_ISDIR(info.st_mode) && !is_link ? DT_DIR : DT_UNKNOWN);
+        }
+
+        if (type == DT_DIR && !rules.is_ignored(relative_path, true))
+        {
+            subdirs.push_back(std::move(relative_path));
+        }
+        else if (type == DT_REG && !rules.is_ignored(relative_path, false))
+        {
+            files.push_back(std::move(relative_path));
+        }
+    }
+    closedir(dir);
+}
+
+void scan_worker(const fs::path &root, const IgnoreRules &rules, ScanState &state)
+{
+    std::vector<std::string> subdirs;
+    std::vector<std::string> files;
+    std::string error;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true)
+    {
+        state.wakeup.wait(lock, [&] { return !state.pending.empty() || state.busy == 0; });
+        if (state.pending.empty())
+        {
+            return; // Nothing queued and nobody left to queue more
+        }
+
+        std::string relative_dir = std::move(state.pending.front());
+        state.pending.pop_front();
+        ++state.busy;
+        lock.unlock();
+
+        subdirs.clear();
+        files.clear();
+        scan_directory(root, relative_dir, rules, subdirs, files, error);
+
+        lock.lock();
+        --state.busy;
+        for (auto &subdir : subdirs)
+        {
+            state.pending.push_back(std::move(subdir));
+        }
+        state.files.insert(state.files.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+        if (!error.empty() && state.error.empty())
+        {
+            state.error = error;
+        }
+        state.wakeup.notify_all();
+    }
+}
+} // namespace
+
+Status scan_working_tree(const fs::path &root, const std::vector<std::string> &relative_dirs, const IgnoreRules &rules,
+                         std::vector<std::string> &files)
+{
+    ScanState state;
+    state.pending.assign(relative_dirs.begin(), relative_dirs.end());
+
+    size_t thread_count = std::min<size_t>(MAX_SCAN_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back(scan_worker, std::cref(root), std::cref(rules), std::ref(state));
+    }
+    scan_worker(root, rules, state);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (!state.error.empty())
+    {
+        return Status::error(ErrorCode::IoError, state.error);
+    }
+    std::sort(state.files.begin(), state.files.end());
+    state.files.erase(std::unique(state.files.begin(), state.files.end()), state.files.end());
+    files = std::move(state.files);
+    return {};
+}
@@ -0,0 +1,141 @@
+#include <fstream>
+#include <sstream>
+#include "headers/scanner.h"
+#include "headers/sparse.h"
+
+namespace
+{
+bool has_wildcard(const std::string &text)
+{
+    return text.find_first_of("*?[") != std::string::npos;
+}
+
+bool is_inside(const std::string &path, const std::string &directory)
+{
+    return path.size() > directory.size() && path[directory.size()] == '/' &&
+           path.compare(0, directory.size(), directory) == 0;
+}
+
+std::vector<std::string> split_path(const std::string &path)
+{
+    std::vector<std::string> components;
+    std::istringstream stream(path);
+    std::string component;
+    while (std::getline(stream, component, '/'))
+    {
+        components.push_back(component);
+    }
+    return components;
+}
+} // namespace
+
+fs::path SparseCheckout::config_path(const Repository &repo)
+{
+    return repo.git_dir() / "info" / "sparse-checkout";
+}
+
+Status SparseCheckout::load(const Repository &repo, SparseCheckout &sparse)
+{
+    sparse = SparseCheckout();
+    std::ifstream config_file(config_path(repo));
+    std::string line;
+    while (std::getline(config_file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::size_t first = line.find_first_not_of(" \t\r/");
+        std::size_t last = line.find_last_not_of(" \t\r/");
+        if (first == std::string::npos)
+        {
+            continue;
+        }
+        std::string entry = line.substr(first, last - first + 1);
+        sparse.lines_.push_back(line.substr(first, line.find_last_not_of(" \t\r") - first + 1));
+        if (has_wildcard(entry))
+        {
+            sparse.patterns_.push_back({entry, split_path(entry)});
+        }
+        else
+        {
+            sparse.cones_.push_back(entry);
+        }
+    }
+    return {};
+}
+
+Status SparseCheckout::save(const Repository &repo, const std::vector<std::string> &lines)
+{
+    fs::path path = config_path(repo);
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    std::ofstream config_file(path, std::ios::trunc);
+    for (const auto &line : lines)
+    {
+        config_file << line << "\n";
+    }
+    if (!config_file)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to write " + path.string());
+    }
+    return {};
+}
+
+bool SparseCheckout::includes_file(const std::string &path) const
+{
+    if (!enabled())
+    {
+        return true;
+    }
+    for (const auto &cone : cones_)
+    {
+        if (path == cone || is_inside(path, cone))
+        {
+            return true;
+        }
+    }
+
+    for (const auto &pattern : patterns_)
+    {
+        if (glob_match(pattern.text.c_str(), path.c_str()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SparseCheckout::includes_directory(const std::string &path) const
+{
+    if (!enabled() || path.empty())
+    {
+        return true;
+    }
+    for (const auto &cone : cones_)
+    {
+        if (path == cone || is_inside(path, cone) || is_inside(cone, path))
+        {
+            return true;
+        }
+    }
+
+    // A pattern can match below `path` only if its leading components match
+    // the directory's, with at least a file name left over
+    std::vector<std::string> components = split_path(path);
+    for (const auto &pattern : patterns_)
+    {
+        bool possible = true;
+        const auto &parts = pattern.components;
+        for (size_t i = 0; i < components.size() && possible; ++i)
+        {
+            if (i < parts.size() && parts[i] == "**")
+            {
+                break;
+            }
+            possible = i + 1 < parts.size() && glob_match(parts[i].c_str(), components[i].c_str());
+        }
+        if (possible)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "headers/tree_builder.h"
+
+namespace
+{
+const std::string_view FILE_MODE = "100644";
+const std::string_view DIRECTORY_MODE = "040000";
+} // namespace
+
+Arena::Arena(size_t block_size) : block_size_(block_size)
+{
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    auto padding_at = [alignment](const char *at) {
+        return (alignment - reinterpret_cast<std::uintptr_t>(at) % alignment) % alignment;
+    };
+
+    size_t padding = padding_at(next_);
+    if (!next_ || padding + size > static_cast<size_t>(end_ - next_))
+    {
+        // Oversized requests get a block of their own
+        size_t capacity = std::max(block_size_, size + alignment);
+        blocks_.emplace_back(new char[capacity]);
+        next_ = blocks_.back().get();
+        end_ = next_ + capacity;
+        padding = padding_at(next_);
+    }
+
+    char *result = next_ + padding;
+    next_ = result + size;
+    bytes_used_ += size;
+    return result;
+}
+
+std::string_view Arena::copy(std::string_view text)
+{
+    if (text.empty())
+    {
+        return {};
+    }
+    char *bytes = static_cast<char *>(allocate(text.size(), 1));
+    std::memcpy(bytes, text.data(), text.size());
+    return {bytes, text.size()};
+}
+
+void TreeBuilder::add(std::string_view path, std::string_view mode, std::string_view sha)
+{
+    std::string_view stored = enter_parent(path);
+    if (mode == DIRECTORY_MODE)
+    {
+        open_directory(stored);
+        return;
+    }
+    add_leaf(stored, mode == FILE_MODE ? FILE_MODE : arena_.copy(mode), sha);
+}
+
+void TreeBuilder::add_subtree(std::string_view path, std::string_view sha)
+{
+    add_leaf(enter_parent(path), DIRECTORY_MODE, sha);
+}
+
+std::string_view TreeBuilder::enter_parent(std::string_view path)
+{
+    std::string_view stored = arena_.copy(path);
+
+    // Close the directories this path is not inside
+    while (depth_ > 1)
+    {
+        std::string_view directory = levels_[depth_ - 1].path;
+        if (stored.size() > directory.size() && stored[directory.size()] == '/' &&
+            stored.compare(0, directory.size(), directory) == 0)
+        {
+            break;
+        }
+        close_directory();
+    }
+
+    size_t start = depth_ == 1 ? 0 : levels_[depth_ - 1].path.size() + 1;
+    for (size_t slash = stored.find('/', start); slash != std::string_view::npos; slash = stored.find('/', slash + 1))
+    {
+        open_directory(stored.substr(0, slash));
+    }
+    return stored;
+}
+
+void TreeBuilder::add_leaf(std::string_view stored, std::string_view mode, std::string_view sha)
+{
+    auto &siblings = levels_[depth_ - 1].children;
+    Node leaf;
+    leaf.path = stored;
+    leaf.mode = mode;
+    leaf.sha = arena_.copy(sha);
+    siblings.push_back(leaf);
+    ++node_count_;
+}
+
+void TreeBuilder::open_directory(std::string_view path)
+{
+    // A file of the same name sorts before everything inside the directory,
+    // so it can only be a recent sibling
+    auto &siblings = levels_[depth_ - 1].children;
+    for (auto it = siblings.rbegin(); it != siblings.rend() && it->path >= path; ++it)
+    {
+        if (it->path == path)
+        {
+            siblings.erase(std::next(it).base());
+            --node_count_;
+            break;
+        }
+    }
+
+    if (levels_.size() == depth_)
+    {
+        levels_.emplace_back();
+    }
+    levels_[depth_].path = path;
+    levels_[depth_].children.clear();
+    ++depth_;
+}
+
+void TreeBuilder::close_directory()
+{
+    Level &level = levels_[--depth_];
+    if (level.children.empty())
+    {
+        return;
+    }
+
+    Node *children = arena_.allocate_array<Node>(level.children.size());
+    std::uninitialized_copy(level.children.begin(), level.children.end(), children);
+
+    Node directory;
+    directory.path = level.path;
+    directory.mode = DIRECTORY_MODE;
+    directory.children = children;
+    directory.child_count = level.children.size();
+    directory.is_directory = true;
+    levels_[depth_ - 1].children.push_back(directory);
+    ++node_count_;
+    level.children.clear();
+}
+
+const TreeBuilder::Node &TreeBuilder::finish()
+{
+    while (depth_ > 1)
+    {
+        close_directory();
+    }
+
+    auto &top = levels_[0].children;
+    Node *children = top.empty() ? nullptr : arena_.allocate_array<Node>(top.size());
+    std::uninitialized_copy(top.begin(), top.end(), children);
+    root_.mode = DIRECTORY_MODE;
+    root_.children = children;
+    root_.child_count = top.size();
+    root_.is_directory = true;
+    top.clear();
+    return root_;
+}
+
+Status TreeBuilder::write_directory(const ObjectStore &store, const Node &directory, std::string &sha) const
+{
+    std::string serialized_tree;
+    for (size_t i = 0; i < directory.child_count; ++i)
+    {
+        const Node &child = directory.children[i];
+        std::string child_sha;
+        if (child.is_directory)
+        {
+            Status status = write_directory(store, child, child_sha);
+            if (!status.ok())
+            {
+                return status;
+            }
+        }
+
+        serialized_tree.append(child.mode).append(" ").append(child.path).append(" ");
+        serialized_tree.append(child.is_directory ? std::string_view(child_sha) : child.sha).append("\n");
+    }
+    return store("tree", std::move(serialized_tree), sha);
+}
+
+Status TreeBuilder::write(const ObjectStore &store, TreeEntry &root_entry) const
+{
+    root_entry = {std::string(DIRECTORY_MODE), "", ""};
+    if (root_.child_count == 0)
+    {
+        return {};
+    }
+    return write_directory(store, root_, root_entry.sha);
+}
@@ -6,10 +6,41 @@
 #include <openssl/evp.h>
 #include <zlib.h>
 #include <iomanip>
+#include <algorithm>
+#include <cctype>
 #include "headers/utils.h"
 
 namespace fs = std::filesystem;
 
+Sha1Stream::Sha1Stream() : ctx_(EVP_MD_CTX_new())
+{
+    EVP_DigestInit_ex(ctx_, EVP_sha1(), nullptr);
+}
+
+Sha1Stream::~Sha1Stream()
+{
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Sha1Stream::update(const char *data, size_t len)
+{
+    EVP_DigestUpdate(ctx_, data, len);
+}
+
+std::string Sha1Stream::hex_digest()
+{
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_length;
+    EVP_DigestFinal_ex(ctx_, hash, &hash_length);
+
+    std::ostringstream oss;
+    for (unsigned int i = 0; i < hash_length; ++i)
+    {
+        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+    }
+    return oss.str();
+}
+
 std::string calculate_sha1(const std::string &content)
 {
     unsigned char hash[EVP_MAX_MD_SIZE];
@@ -36,7 +67,6 @@ std::string compress_data(const std::string &data)
 
     if (compress((Bytef *)compressed_data.data(), &compressed_size, (const Bytef *)data.data(), data.size()) != Z_OK)
     {
-        std::cerr << "Error compressing data." << std::endl;
         return {};
     }
 
@@ -45,203 +75,107 @@ std::string compress_data(const std::string &data)
 }
 
 std::string decompress_data(const std::string &compressed_data, size_t original_size)
-    {
-        std::string decompressed_data(original_size, '\0');
-        if (uncompress((Bytef *)decompressed_data.data(), &original_size, (const Bytef *)compressed_data.data(), compressed_data.size()) != Z_OK)
-        {
-            std::cerr << "Error decompressing data." << std::endl;
-            return {};
-        }
-        return decompressed_data;
-    }
-
-void write_blob(const std::string &hash, const std::string &content)
 {
-    fs::path blob_file = fs::path(".mygit/objects") / hash.substr(0, 2) / hash.substr(2);
-    if (!fs::exists(blob_file))
-    {
-        fs::create_directories(blob_file.parent_path());
-        std::ofstream ofs(blob_file, std::ios::binary);
-        if (ofs)
-        {
-            ofs << content;
-        }
-    }
+    return decompress_data(compressed_data.data(), compressed_data.size(), original_size);
 }
 
-std::string read_file_content(const fs::path &filepath)
+// Returns an empty string if the data does not inflate to exactly
+// original_size bytes.
+std::string decompress_data(const char *compressed_data, size_t compressed_size, size_t original_size)
 {
-    std::ifstream file(filepath, std::ios::binary);
-    std::ostringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
-std::string get_or_create_blob(const std::string &file_content)
-{
-    std::string object_data = "blob " + std::to_string(file_content.size()) + '\0';
-    std::string hash = calculate_sha1(object_data + file_content);
-
-    fs::path blob_dir = fs::path(".mygit/objects") / hash.substr(0, 2);
-    fs::path blob_file = blob_dir / hash.substr(2);
-
-    if (fs::exists(blob_file))
-    {
-        return hash; // Blob already exists
-    }
-
-    if (!fs::exists(blob_dir))
+    std::string decompressed_data(original_size, '\0');
+    uLongf decompressed_size = original_size;
+    if (uncompress((Bytef *)decompressed_data.data(), &decompressed_size, (const Bytef *)compressed_data, compressed_size) != Z_OK ||
+        decompressed_size != original_size)
     {
-        fs::create_directories(blob_dir);
+        return {};
     }
-    write_blob(hash, object_data + compress_data(file_content));
-
-    return hash;
+    return decompressed_data;
 }
 
-void hash_object(const std::string &filename, bool write)
+std::string object_header(const std::string &type, size_t size)
 {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file)
-    {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        return;
-    }
-
-    std::ostringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-
-    std::string hash = get_or_create_blob(content);
-    std::cout << hash << std::endl;
-
-    if (write)
-    {
-        write_blob(hash, content);
-    }
+    return type + " " + std::to_string(size) + '\0';
 }
 
-void cat_file(const std::string &flag, const std::string &file_sha)
+// Parses a "<type> <size>" object header (without the trailing null byte).
+bool parse_object_header(const std::string &header, std::string &type, size_t &size)
 {
-    fs::path blob_file = fs::path(".mygit/objects") / file_sha.substr(0, 2) / file_sha.substr(2);
-
-    if (!fs::exists(blob_file))
-    {
-        std::cerr << "Error: Object with SHA-1 " << file_sha << " not found." << std::endl;
-        return;
-    }
-
-    std::ifstream ifs(blob_file, std::ios::binary);
-    if (!ifs)
+    std::size_t space_pos = header.find(' ');
+    if (space_pos == std::string::npos)
     {
-        std::cerr << "Error: Unable to open blob file." << std::endl;
-        return;
+        return false;
     }
 
-    std::string compressed_data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-    std::size_t null_pos = compressed_data.find('\0');
-    if (null_pos == std::string::npos)
+    type = header.substr(0, space_pos);
+    if (type != "blob" && type != "tree" && type != "commit" && type != "chunks")
     {
-        std::cerr << "Error: Null terminator not found in decompressed data." << std::endl;
-        return;
+        return false;
     }
 
-    std::string header = compressed_data.substr(0, null_pos);
-    std::string content = compressed_data.substr(null_pos + 1);
-
-    std::string type;
-    size_t original_size = 0;
-
-    if (header.substr(0, 5) == "blob ")
-    {
-        type = "blob";
-        original_size = std::stoul(header.substr(5));
-    }
-    else if (header.substr(0, 5) == "tree ")
-    {
-        type = "tree";
-        original_size = std::stoul(header.substr(5));
-    }
-    else if (header.substr(0, 7) == "commit ")
+    try
     {
-        type = "commit";
-        original_size = std::stoul(header.substr(7));
+        size = std::stoul(header.substr(space_pos + 1));
     }
-    else
+    catch (const std::exception &)
     {
-        std::cerr << "Error: Unknown object type." << std::endl;
-        return;
-    }
-    content = decompress_data(content, original_size);
-
-    if (flag == "-p")
-    {
-        std::cout << content;
-    }
-    else if (flag == "-s")
-    {
-        std::cout << original_size << " bytes" << std::endl;
-    }
-    else if (flag == "-t")
-    {
-        std::cout << type << std::endl;
-    }
-    else
-    {
-        std::cerr << "Error: Unknown flag " << flag << std::endl;
+        return false;
     }
+    return true;
 }
 
-void ls_tree(const std::string &tree_sha, bool name_only)
+std::vector<ObjectRef> referenced_objects(const std::string &type, const std::string &content)
 {
-    fs::path tree_file = fs::path(".mygit/objects") / tree_sha.substr(0, 2) / tree_sha.substr(2);
-
-    if (!fs::exists(tree_file))
-    {
-        std::cerr << "Error: Tree object not found." << std::endl;
-        return;
-    }
-
-    std::ifstream ifs(tree_file, std::ios::binary);
-    std::string object_data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-
-    std::istringstream iss(object_data);
-    std::string header;
-    std::getline(iss, header, '\0');
-
-    if (header.substr(0, 5) != "tree ")
-    {
-        std::cerr << "Error: Invalid tree object." << std::endl;
-        return;
-    }
-
-    size_t original_size = std::stoul(header.substr(5)); // Skip "tree " and parse size
-    std::string compressed_content(object_data.begin() + header.size() + 1, object_data.end());
-    std::string tree_content = decompress_data(compressed_content, original_size);
-
-    if (tree_content.empty())
-    {
-        std::cerr << "Error: Decompression failed." << std::endl;
-        return;
-    }
-
-    std::istringstream tree_iss(tree_content);
+    std::vector<ObjectRef> refs;
+    std::istringstream stream(content);
     std::string line;
 
-    while (std::getline(tree_iss, line))
+    while (std::getline(stream, line))
     {
-        std::istringstream entry_stream(line);
-        std::string mode, sha, name;
-
-        entry_stream >> mode >> sha >> name; // Assuming format: <mode> <sha> <name>
-
-        if (name_only)
+        if (type == "commit")
         {
-            std::cout << name << std::endl;
+            if (line.empty())
+            {
+                break; // Headers end at the first blank line
+            }
+            if (line.rfind("tree ", 0) == 0)
+            {
+                refs.push_back({line.substr(5), "tree"});
+            }
+            else if (line.rfind("parent ", 0) == 0)
+            {
+                refs.push_back({line.substr(7), "commit"});
+            }
         }
-        else
+        else if (type == "tree")
         {
-            std::cout << mode << "\t" << sha << "\t" << name << std::endl;
+            // Tree lines are "<mode> <path> <sha>"
+            std::size_t last_space = line.rfind(' ');
+            if (last_space == std::string::npos)
+            {
+                continue;
+            }
+            std::string mode = line.substr(0, line.find(' '));
+            refs.push_back({line.substr(last_space + 1), mode == "040000" ? "tree" : "blob"});
+        }
+        else if (type == "chunks")
+        {
+            // Chunk list lines are "<sha> <size>"
+            refs.push_back({line.substr(0, line.find(' ')), "blob"});
         }
     }
+    return refs;
+}
+
+std::string read_file_content(const fs::path &filepath)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+bool is_hex_string(const std::string &text)
+{
+    return std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isxdigit(c) && !std::isupper(c); });
 }
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include "headers/worktree.h"
+
+namespace
+{
+Status write_text(const fs::path &path, const std::string &text)
+{
+    std::ofstream file(path, std::ios::trunc);
+    file << text;
+    if (!file)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to write " + path.string());
+    }
+    return {};
+}
+
+std::string read_line(const fs::path &path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Writes the blob to a temporary file in the cache and renames it into
+// place, so readers never see a partial entry
+Status add_cache_entry(const Repository &repo, const std::string &sha, const fs::path &entry)
+{
+    static std::atomic<unsigned> counter{0};
+    std::error_code ec;
+    fs::create_directories(entry.parent_path(), ec);
+    fs::path temp = entry.parent_path() / ("tmp_" + std::to_string(getpid()) + "_" + std::to_string(counter++));
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    Status status = repo.stream_blob(sha, [&file](const std::string &data) {
+        file << data;
+        return Status();
+    });
+    file.close();
+    if (status.ok() && !file)
+    {
+        status = Status::error(ErrorCode::IoError, "Error: Unable to write " + temp.string());
+    }
+    if (status.ok() && (chmod(temp.c_str(), 0444) != 0 || rename(temp.c_str(), entry.c_str()) != 0))
+    {
+        status = Status::error(ErrorCode::IoError, "Error: Unable to add " + entry.string() + " to the file cache.");
+    }
+    if (!status.ok())
+    {
+        fs::remove(temp, ec);
+    }
+    return status;
+}
+
+bool clone_file(const fs::path &source, const fs::path &target)
+{
+#ifdef FICLONE
+    int source_fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0)
+    {
+        return false;
+    }
+    int target_fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    bool cloned = target_fd >= 0 && ioctl(target_fd, FICLONE, source_fd) == 0;
+    if (target_fd >= 0)
+    {
+        close(target_fd);
+        if (!cloned)
+        {
+            unlink(target.c_str());
+        }
+    }
+    close(source_fd);
+    return cloned;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+// Whether files in the cache can be cloned into `dir`: both must be on one
+// filesystem, and it must support reflinks
+bool can_clone_from_cache(const fs::path &cache_dir, const fs::path &dir)
+{
+    std::error_code ec;
+    fs::create_directories(cache_dir, ec);
+    fs::path source = cache_dir / ("tmp_probe_" + std::to_string(getpid()));
+    fs::path target = dir / ("tmp_probe_" + std::to_string(getpid()));
+    bool cloned = write_text(source, "probe\n").ok() && clone_file(source, target);
+    fs::remove(source, ec);
+    fs::remove(target, ec);
+    return cloned;
+}
+} // namespace
+
+fs::path file_cache_dir(const Repository &repo)
+{
+    return repo.common_dir() / "file-cache";
+}
+
+Status materialize_from_cache(const Repository &repo, const std::string &sha, const fs::path &target,
+                              MaterializeStats &stats)
+{
+    fs::path entry = file_cache_dir(repo) / sha.substr(0, 2) / sha.substr(2);
+    std::error_code ec;
+    if (!fs::exists(entry, ec))
+    {
+        Status status = add_cache_entry(repo, sha, entry);
+        if (!status.ok())
+        {
+            return status;
+        }
+        ++stats.cache_entries_added;
+    }
+
+    // Never a hardlink: a file edited in place would change the cache entry
+    // and every other worktree sharing its inode. A reflink is a private
+    // file that shares blocks until written. What is at `target` now is
+    // unlinked rather than overwritten, in case it is a hardlink an older
+    // mygit made.
+    ++stats.files;
+    fs::remove(target, ec);
+    if (clone_file(entry, target))
+    {
+        ++stats.cloned;
+        return {};
+    }
+    // No reflinks on this filesystem: a private, writable copy
+    fs::copy_file(entry, target, fs::copy_options::overwrite_existing, ec);
+    if (!ec)
+    {
+        fs::permissions(target, fs::perms::owner_write, fs::perm_options::add, ec);
+    }
+    if (ec)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to create file " + target.string());
+    }
+    ++stats.copied;
+    return {};
+}
+
+Status add_worktree(const Repository &repo, const fs::path &dir, const std::string &commit_sha,
+                    bool &use_file_cache, MaterializeStats &stats)
+{
+    Commit commit;
+    if (!repo.read_commit(commit_sha, commit).ok())
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: Invalid commit SHA.");
+    }
+
+    fs::path root = fs::absolute(dir).lexically_normal();
+    if (!root.has_filename())
+    {
+        root = root.parent_path();
+    }
+    std::error_code ec;
+    if (fs::exists(root, ec) && !fs::is_empty(root, ec))
+    {
+        return Status::error(ErrorCode::InvalidArgument, "Error: " + root.string() + " already exists.");
+    }
+    fs::create_directories(root, ec);
+    if (ec)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to create " + root.string());
+    }
+
+    // Without reflinks every file would be copied out of the cache, which
+    // costs more than writing it from the object store
+    use_file_cache = use_file_cache && can_clone_from_cache(file_cache_dir(repo), root);
+
+    std::string name = root.filename().string();
+    fs::path admin_dir = repo.common_dir() / "worktrees" / name;
+    for (int suffix = 1; fs::exists(admin_dir, ec); ++suffix)
+    {
+        admin_dir = repo.common_dir() / "worktrees" / (name + std::to_string(suffix));
+    }
+    fs::create_directories(admin_dir, ec);
+    if (ec)
+    {
+        return Status::error(ErrorCode::IoError, "Error: Unable to create " + admin_dir.string());
+    }
+
+    Status status = write_text(admin_dir / "HEAD", "");
+    if (status.ok())
+    {
+        status = write_text(admin_dir / "index", "");
+    }
+    if (status.ok())
+    {
+        status = write_text(admin_dir / "gitdir", (root / ".mygit").string() + "\n");
+    }
+    if (status.ok() && use_file_cache)
+    {
+        status = write_text(admin_dir / "config", "checkout.fileCache = true\n");
+    }
+    if (status.ok())
+    {
+        status = write_text(root / ".mygit", "worktree: " + admin_dir.string() + "\n");
+    }
+    Repository worktree;
+    if (status.ok())
+    {
+        status = Repository::open(root, worktree);
+    }
+    if (status.ok())
+    {
+        status = worktree.checkout(commit_sha, &stats);
+    }
+    if (!status.ok())
+    {
+        fs::remove_all(admin_dir, ec);
+        fs::remove(root / ".mygit", ec);
+    }
+    return status;
+}
+
+Status list_worktrees(const Repository &repo, std::vector<WorktreeInfo> &worktrees)
+{
+    std::vector<WorktreeInfo> found = {{"", repo.common_dir().parent_path(), ""}};
+    std::error_code ec;
+    for (const auto &admin_dir : fs::directory_iterator(repo.common_dir() / "worktrees", ec))
+    {
+        fs::path link_file = read_line(admin_dir.path() / "gitdir");
+        found.push_back({admin_dir.path().filename().string(), link_file.parent_path(), ""});
+    }
+    std::sort(found.begin() + 1, found.end(),
+              [](const WorktreeInfo &a, const WorktreeInfo &b) { return a.name < b.name; });
+
+    for (auto &info : found)
+    {
+        // A worktree whose directory was deleted still shows up, without a HEAD
+        Repository worktree;
+        if (Repository::open(info.root, worktree).ok())
+        {
+            worktree.read_head(info.head);
+        }
+    }
+    worktrees = std::move(found);
+    return {};
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Renames and deletes files through `rm` and `add`, commits, and checks that
+# the commit's tree drops the old paths and that diff-tree pairs them up as
+# renames.
+#
+# Usage: tests/rename_detection.sh
+set -e
+
+MYGIT=${MYGIT:-$(pwd)/mygit}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export MYGIT_NO_DAEMON=1
+
+fail() { echo "FAIL: $*" >&2; exit 1; }
+
+cd "$WORK"
+"$MYGIT" init > /dev/null
+mkdir -p src docs
+seq 1 200 | sed 's/^/parser line /' > src/parser.c
+seq 1 100 | sed 's/^/notes line /' > docs/notes.txt
+echo "gone" > docs/old.txt
+"$MYGIT" add . > /dev/null
+"$MYGIT" commit -m "first" > /dev/null
+
+# An exact rename, a rename with an edit, and a plain deletion
+mkdir lib
+mv src/parser.c lib/parser.c
+"$MYGIT" rm src/parser.c > /dev/null
+mv docs/notes.txt docs/NOTES.txt
+echo "one more line" >> docs/NOTES.txt
+"$MYGIT" rm docs/notes.txt docs/old.txt > /dev/null
+"$MYGIT" add lib/parser.c docs/NOTES.txt > /dev/null
+"$MYGIT" commit -m "second" > /dev/null
+
+[ ! -e src ] || fail "rm left the emptied src directory behind"
+tree=$("$MYGIT" cat-file -p HEAD | awk '/^tree/ { print $2 }')
+"$MYGIT" ls-tree --name-only "$tree" | grep -qx src && fail "src is still in the committed tree"
+
+changes=$("$MYGIT" diff-tree HEAD)
+echo "$changes" | grep -qP '^R100\tsrc/parser.c\tlib/parser.c$' || fail "exact rename not found: $changes"
+echo "$changes" | grep -qP '^R\d+\tdocs/notes.txt\tdocs/NOTES.txt$' || fail "edited rename not found: $changes"
+echo "$changes" | grep -qP '^D\tdocs/old.txt$' || fail "deletion not found: $changes"
+[ "$(echo "$changes" | wc -l)" -eq 3 ] || fail "unexpected changes: $changes"
+
+"$MYGIT" rm docs/old.txt 2>&1 | grep -q "not tracked" || fail "rm of a deleted path was accepted"
+echo "ok"